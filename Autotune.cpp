@@ -0,0 +1,335 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#include "cuda_runtime.h"
+#include "Autotune.h"
+#include "CpuKang.h"
+#include "Jumps.h"
+#include "ThreadPool.h"
+
+//speed doesn't depend on range much, large DP so DPs don't take time
+#define AUTOTUNE_RANGE			76
+#define AUTOTUNE_GPU_DP			24
+#define AUTOTUNE_GPU_TIME_MS	3000
+#define AUTOTUNE_CPU_TIME_MS	2000
+#define AUTOTUNE_CPU_KANGS		1024
+#define AUTOTUNE_CPU_STEP_CNT	20
+
+//kangs per CPU walker, more kangs make inversion cheaper per jump but don't fit CPU cache
+static int CpuBatches[] = { 256, 512, 1024, 2048, 4096 };
+
+#define WALK_CFG_ITEM(bs, gc, jc, md, sc) { bs, gc, jc, md, sc },
+
+static TWalkCfg WalkCfgs[] = { WALK_CFG_LIST(WALK_CFG_ITEM) };
+
+//hw_id is a single word, replace spaces and other separators
+static void FixHwId(char* hw_id)
+{
+	for (char* s = hw_id; *s; s++)
+		if ((*s <= ' ') || (*s > '~'))
+			*s = '_';
+}
+
+void GetGpuHwId(int cuda_index, char* hw_id)
+{
+	cudaDeviceProp prop;
+	cudaGetDeviceProperties(&prop, cuda_index);
+	sprintf(hw_id, "gpu:%.64s:cc%d.%d:%dcu:%dkb", prop.name, prop.major, prop.minor, prop.multiProcessorCount, prop.l2CacheSize / 1024);
+	FixHwId(hw_id);
+}
+
+void GetCpuHwId(char* hw_id)
+{
+	char name[64];
+	GetCpuName(name);
+	char* s = name;
+	while (*s == ' ')
+		s++;
+	sprintf(hw_id, "cpu:%s:%dt", s, GetCpuCnt());
+	FixHwId(hw_id);
+}
+
+bool TMachineProfile::LoadFromFile(const char* fn)
+{
+	FILE* fp = fopen(fn, "r");
+	if (!fp)
+		return false;
+	recs.clear();
+	char line[512];
+	while (fgets(line, sizeof(line), fp))
+	{
+		if (line[0] == '#')
+			continue;
+		TMachineProfileRec rec;
+		TWalkCfg* c = &rec.cfg;
+		if (sscanf(line, "%127s %u:%u:%u:%u:%u %d %lf", rec.hw_id, &c->BlockSize, &c->GroupCnt, &c->JmpCnt, &c->MdLen, &c->StepCnt, &rec.thr_cnt, &rec.speed) != 8)
+			continue;
+		recs.push_back(rec);
+	}
+	fclose(fp);
+	return true;
+}
+
+bool TMachineProfile::SaveToFile(const char* fn)
+{
+	FILE* fp = fopen(fn, "w");
+	if (!fp)
+		return false;
+	fprintf(fp, "# RCKangaroo machine profile: hw_id BlockSize:GroupCnt:JmpCnt:MdLen:StepCnt threads speed(MKeys/s)\n");
+	for (int i = 0; i < (int)recs.size(); i++)
+	{
+		TWalkCfg* c = &recs[i].cfg;
+		fprintf(fp, "%s %u:%u:%u:%u:%u %d %.3f\n", recs[i].hw_id, c->BlockSize, c->GroupCnt, c->JmpCnt, c->MdLen, c->StepCnt, recs[i].thr_cnt, recs[i].speed);
+	}
+	fclose(fp);
+	return true;
+}
+
+void TMachineProfile::Set(TMachineProfileRec& rec)
+{
+	for (int i = 0; i < (int)recs.size(); i++)
+		if (strcmp(recs[i].hw_id, rec.hw_id) == 0)
+		{
+			recs[i] = rec;
+			return;
+		}
+	recs.push_back(rec);
+}
+
+TMachineProfileRec* TMachineProfile::Find(char* hw_id)
+{
+	for (int i = 0; i < (int)recs.size(); i++)
+		if (strcmp(recs[i].hw_id, hw_id) == 0)
+			return &recs[i];
+	return NULL;
+}
+
+//non-zero fields of filter must match, JmpCnt is default if not set because it changes jumps tables and makes old tames incompatible
+static bool IsCfgMatch(TWalkCfg* cfg, TWalkCfg* filter)
+{
+	if (filter->BlockSize && (cfg->BlockSize != filter->BlockSize))
+		return false;
+	if (filter->GroupCnt && (cfg->GroupCnt != filter->GroupCnt))
+		return false;
+	if (cfg->JmpCnt != (filter->JmpCnt ? filter->JmpCnt : DEF_JMP_CNT))
+		return false;
+	if (filter->MdLen && (cfg->MdLen != filter->MdLen))
+		return false;
+	if (filter->StepCnt && (cfg->StepCnt != filter->StepCnt))
+		return false;
+	return true;
+}
+
+static bool AutotuneGpu(RCGpuKang* gpu, TWalkCfg* filter, TMachineProfileRec* res)
+{
+	Ec ec;
+	EcInt key;
+	key.RndBits(AUTOTUNE_RANGE);
+	EcPoint pnt = ec.MultiplyG(key);
+	TJmpStrategy st;
+	SetDefaultJmpStrategy(&st);
+	EcJMP* jumps = new EcJMP[3 * MAX_JMP_CNT];
+	for (int i = 0; i < 3; i++)
+		gpu->HerdParts[i] = 1.0 / 3;
+
+	res->speed = 0;
+	res->thr_cnt = 0;
+	int cfg_cnt = sizeof(WalkCfgs) / sizeof(WalkCfgs[0]);
+	for (int i = 0; i < cfg_cnt; i++)
+	{
+		TWalkCfg* cfg = &WalkCfgs[i];
+		if (!IsCfgMatch(cfg, filter) || !gpu->SetWalkCfg(cfg))
+			continue;
+		GenerateJumps(&st, AUTOTUNE_RANGE, cfg->JmpCnt, jumps, jumps + cfg->JmpCnt, jumps + 2 * cfg->JmpCnt);
+		int speed = gpu->Benchmark(pnt, AUTOTUNE_RANGE, AUTOTUNE_GPU_DP, 1ull << (64 - AUTOTUNE_GPU_DP), jumps, jumps + cfg->JmpCnt, jumps + 2 * cfg->JmpCnt, AUTOTUNE_GPU_TIME_MS);
+		printf("GPU %d: config %d:%d:%d:%d:%d, speed: %d MKeys/s\r\n", gpu->CudaIndex, cfg->BlockSize, cfg->GroupCnt, cfg->JmpCnt, cfg->MdLen, cfg->StepCnt, speed);
+		if (speed > res->speed)
+		{
+			res->speed = speed;
+			res->cfg = *cfg;
+		}
+	}
+	delete[] jumps;
+	return res->speed > 0;
+}
+
+struct TCpuTrial
+{
+	TWalkCfg cfg;
+	EcPoint pnt;
+	EcJMP* jumps;
+	volatile bool stop;
+	volatile int started;
+	u64 jumps_done;
+	CriticalSection cs;
+};
+
+static void cpu_trial_task_proc(void* data)
+{
+	TCpuTrial* trial = (TCpuTrial*)data;
+	RCCpuKang* kang = new RCCpuKang();
+	double herd_parts[3] = { 1.0 / 3, 1.0 / 3, 1.0 / 3 };
+	int jc = trial->cfg.JmpCnt;
+	int kang_cnt = trial->cfg.BlockSize;
+	kang->Prepare(trial->pnt, AUTOTUNE_RANGE, 64, 0, trial->jumps, trial->jumps + jc, trial->jumps + 2 * jc, kang_cnt, herd_parts, &trial->cfg);
+	trial->cs.Enter();
+	trial->started++;
+	trial->cs.Leave();
+	u64 cnt = 0;
+	while (!trial->stop)
+	{
+		kang->Step(AUTOTUNE_CPU_STEP_CNT, NULL, 0);
+		cnt += (u64)kang_cnt * AUTOTUNE_CPU_STEP_CNT;
+	}
+	trial->cs.Enter();
+	trial->jumps_done += cnt;
+	trial->cs.Leave();
+	delete kang;
+}
+
+//runs CPU walker in thr_cnt pool workers, returns speed in MKeys/s
+static double CpuTrial(TCpuTrial* trial, int thr_cnt)
+{
+	trial->stop = false;
+	trial->started = 0;
+	trial->jumps_done = 0;
+	//all walkers must run at the same time
+	RCThreadPool* pool = GetThreadPool();
+	if (thr_cnt > pool->GetWorkerCnt())
+		thr_cnt = pool->GetWorkerCnt();
+	TTaskGroup group;
+	group.Pending = 0;
+	for (int i = 0; i < thr_cnt; i++)
+		pool->Submit(cpu_trial_task_proc, trial, &group);
+	//don't count time of kangs preparing
+	while (trial->started < thr_cnt)
+		Sleep(1);
+	u64 t1 = GetTickCount64();
+	Sleep(AUTOTUNE_CPU_TIME_MS);
+	trial->stop = true;
+	pool->Wait(&group);
+	u64 tm = GetTickCount64() - t1;
+	return trial->jumps_done / (tm * 1000.0);
+}
+
+//CPU walker speed doesn't grow linearly with threads because of SMT and memory bandwidth, so we check several thread counts
+//with default walk config first, then kangs per walker and JmpCnt/MdLen pairs of CPU walks (same filter as for GPU) with best thread count
+static bool AutotuneCpu(TWalkCfg* filter, TMachineProfileRec* res)
+{
+	TCpuTrial* trial = new TCpuTrial();
+	SetDefaultWalkCfg(&trial->cfg, false);
+	if (filter->JmpCnt)
+		trial->cfg.JmpCnt = filter->JmpCnt;
+	if (filter->MdLen)
+		trial->cfg.MdLen = filter->MdLen;
+	trial->cfg.BlockSize = AUTOTUNE_CPU_KANGS;
+	trial->cfg.GroupCnt = 1;
+	trial->cfg.StepCnt = 0;
+	Ec ec;
+	EcInt key;
+	key.RndBits(AUTOTUNE_RANGE);
+	trial->pnt = ec.MultiplyG(key);
+	TJmpStrategy st;
+	SetDefaultJmpStrategy(&st);
+	trial->jumps = new EcJMP[3 * MAX_JMP_CNT];
+	int jc = trial->cfg.JmpCnt;
+	GenerateJumps(&st, AUTOTUNE_RANGE, jc, trial->jumps, trial->jumps + jc, trial->jumps + 2 * jc);
+
+	res->cfg = trial->cfg;
+	res->speed = 0;
+	res->thr_cnt = 0;
+	int cpu_cnt = GetCpuCnt();
+	for (int thr_cnt = 1; ; thr_cnt *= 2)
+	{
+		if (thr_cnt > cpu_cnt)
+			thr_cnt = cpu_cnt;
+		double speed = CpuTrial(trial, thr_cnt);
+		printf("CPU: %d threads, speed: %.3f MKeys/s\r\n", thr_cnt, speed);
+		if (speed > res->speed)
+		{
+			res->speed = speed;
+			res->thr_cnt = thr_cnt;
+		}
+		if (thr_cnt == cpu_cnt)
+			break;
+	}
+
+	int cfg_cnt = sizeof(WalkCfgs) / sizeof(WalkCfgs[0]);
+	for (int i = 0; i < cfg_cnt; i++)
+	{
+		TWalkCfg* cfg = &WalkCfgs[i];
+		bool done = false;
+		for (int j = 0; j < i; j++)
+			if ((WalkCfgs[j].JmpCnt == cfg->JmpCnt) && (WalkCfgs[j].MdLen == cfg->MdLen))
+				done = true;
+		if (done || (cfg->JmpCnt != (filter->JmpCnt ? filter->JmpCnt : DEF_JMP_CNT)) || (filter->MdLen && (cfg->MdLen != filter->MdLen)))
+			continue;
+		trial->cfg.JmpCnt = cfg->JmpCnt;
+		trial->cfg.MdLen = cfg->MdLen;
+		GenerateJumps(&st, AUTOTUNE_RANGE, cfg->JmpCnt, trial->jumps, trial->jumps + cfg->JmpCnt, trial->jumps + 2 * cfg->JmpCnt);
+		for (int k = 0; k < (int)(sizeof(CpuBatches) / sizeof(CpuBatches[0])); k++)
+		{
+			trial->cfg.BlockSize = CpuBatches[k];
+			double speed = CpuTrial(trial, res->thr_cnt);
+			printf("CPU: %d threads, %d kangs per thread, JmpCnt %d, MdLen %d, speed: %.3f MKeys/s\r\n", res->thr_cnt, trial->cfg.BlockSize, trial->cfg.JmpCnt, trial->cfg.MdLen, speed);
+			if (speed > res->speed)
+			{
+				res->speed = speed;
+				res->cfg = trial->cfg;
+			}
+		}
+	}
+	delete[] trial->jumps;
+	delete trial;
+	return res->speed > 0;
+}
+
+//runs timed trials for every supported config on every type of GPU and for CPU walker, saves best ones to profile
+//filter - non-zero fields limit configs for trials
+bool RunAutotune(const char* profile_fn, RCGpuKang** gpus, int gpu_cnt, TWalkCfg* filter)
+{
+	TMachineProfile prof;
+	prof.LoadFromFile(profile_fn);
+	char hw_ids[MAX_GPU_CNT][128];
+	for (int i = 0; i < gpu_cnt; i++)
+	{
+		GetGpuHwId(gpus[i]->CudaIndex, hw_ids[i]);
+		//same GPUs are checked once
+		bool done = false;
+		for (int j = 0; j < i; j++)
+			if (strcmp(hw_ids[i], hw_ids[j]) == 0)
+				done = true;
+		if (done)
+			continue;
+		printf("Autotune GPU %d: %s\r\n", gpus[i]->CudaIndex, hw_ids[i]);
+		TMachineProfileRec rec;
+		if (!AutotuneGpu(gpus[i], filter, &rec))
+		{
+			printf("Autotune GPU %d: no working configs\r\n", gpus[i]->CudaIndex);
+			continue;
+		}
+		strcpy(rec.hw_id, hw_ids[i]);
+		printf("Autotune GPU %d: best config %d:%d:%d:%d:%d, speed: %.0f MKeys/s\r\n", gpus[i]->CudaIndex, rec.cfg.BlockSize, rec.cfg.GroupCnt, rec.cfg.JmpCnt, rec.cfg.MdLen, rec.cfg.StepCnt, rec.speed);
+		prof.Set(rec);
+	}
+
+	TMachineProfileRec rec;
+	GetCpuHwId(rec.hw_id);
+	printf("Autotune CPU: %s\r\n", rec.hw_id);
+	if (AutotuneCpu(filter, &rec))
+	{
+		printf("Autotune CPU: best %d threads, %d kangs per thread, JmpCnt %d, MdLen %d, speed: %.3f MKeys/s\r\n", rec.thr_cnt, rec.cfg.BlockSize, rec.cfg.JmpCnt, rec.cfg.MdLen, rec.speed);
+		prof.Set(rec);
+	}
+
+	if (!prof.SaveToFile(profile_fn))
+	{
+		printf("Autotune: cannot save profile to %s\r\n", profile_fn);
+		return false;
+	}
+	printf("Autotune: profile saved to %s\r\n", profile_fn);
+	return true;
+}
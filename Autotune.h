@@ -0,0 +1,36 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#pragma once
+
+#include "GpuKang.h"
+
+//machine profile is loaded automatically if it exists in current folder
+#define MACHINE_PROFILE_FILE	"MACHINE_PROFILE.TXT"
+
+struct TMachineProfileRec
+{
+	char hw_id[128]; //"gpu:..." or "cpu:..."
+	TWalkCfg cfg; //best walk config for GPU, for CPU walker: BlockSize is kangs per walker (one inversion per jump for all of them), JmpCnt and MdLen
+	int thr_cnt; //best number of threads for CPU walker
+	double speed; //measured speed, MKeys/s
+};
+
+//keeps best walk parameters for every hardware type, text file
+class TMachineProfile
+{
+public:
+	std::vector <TMachineProfileRec> recs;
+
+	bool LoadFromFile(const char* fn);
+	bool SaveToFile(const char* fn);
+	void Set(TMachineProfileRec& rec);
+	TMachineProfileRec* Find(char* hw_id);
+};
+
+void GetGpuHwId(int cuda_index, char* hw_id);
+void GetCpuHwId(char* hw_id);
+bool RunAutotune(const char* profile_fn, RCGpuKang** gpus, int gpu_cnt, TWalkCfg* filter);
@@ -0,0 +1,353 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#include <math.h>
+#include "Bsgs.h"
+#include "ThreadPool.h"
+
+//points in one batch, one inversion per batch step
+#define BSGS_BATCH			256
+//baby points or giant steps in one work item
+#define BSGS_ITEM_LEN		(64 * 1024)
+//rough speed of one CPU thread, baby points or giant steps per second, used if CPU was not autotuned
+#define BSGS_THR_SPEED		1500000.0
+
+#ifdef _WIN32
+	#define CAS64(ptr, old_val, new_val)	(InterlockedCompareExchange64((volatile LONG64*)(ptr), (LONG64)(new_val), (LONG64)(old_val)) == (LONG64)(old_val))
+#else
+	#define CAS64(ptr, old_val, new_val)	__sync_bool_compare_and_swap((ptr), (old_val), (new_val))
+#endif
+
+//hash table has 2m entries
+double CalcBsgsRam(int baby_bits)
+{
+	return 16.0 * pow(2.0, baby_bits) / (1024 * 1024 * 1024);
+}
+
+//baby table size with min total work for all points, limited by RAM, returns 0 if BSGS cannot be used
+int CalcBsgsBits(int Range, int pnt_cnt, double ram_gb)
+{
+	if (Range > BSGS_MAX_RANGE)
+		return 0;
+	//work is m + cnt * 2^Range / 2m
+	int bits = (int)ceil((Range - 1 + log2((double)pnt_cnt)) / 2);
+	if (bits > Range - 1)
+		bits = Range - 1;
+	if (bits > BSGS_MAX_BITS)
+		bits = BSGS_MAX_BITS;
+	while ((bits >= BSGS_MIN_BITS) && (CalcBsgsRam(bits) > ram_gb))
+		bits--;
+	return (bits < BSGS_MIN_BITS) ? 0 : bits;
+}
+
+//seconds, thr_speed - points per second of one thread, 0 - default
+double EstimateBsgsTime(int Range, int baby_bits, int pnt_cnt, int thr_cnt, double thr_speed)
+{
+	double work = pow(2.0, baby_bits) + pnt_cnt * pow(2.0, Range - 1 - baby_bits);
+	return work / (((thr_speed > 0) ? thr_speed : BSGS_THR_SPEED) * thr_cnt);
+}
+
+struct TBsgsTask
+{
+	RCBsgs* bsgs;
+	CriticalSection cs;
+	u64 NextItem;
+	u64 ItemCnt;
+	bool IsBuild;
+	//giant steps
+	EcPoint* pnts;
+	u64 items_per_pnt;
+	u64 giant_cnt;
+	EcInt* keys;
+	bool* found;
+	int solved;
+};
+
+RCBsgs::RCBsgs()
+{
+	Table = NULL;
+	StopFlag = false;
+}
+
+RCBsgs::~RCBsgs()
+{
+	Release();
+}
+
+void RCBsgs::Release()
+{
+	free(Table);
+	Table = NULL;
+}
+
+void RCBsgs::Insert(u64 x, u32 j)
+{
+	u64 ind = x & TableMask;
+	u64 val = (x & 0xFFFFFFFF00000000ull) | j;
+	while (!CAS64(&Table[ind], 0, val))
+		ind = (ind + 1) & TableMask;
+}
+
+//adds q to all points, one inversion for all points, x[i] must not be q.x
+static void AddPointBatch(EcInt* x, EcInt* y, int cnt, EcPoint& q, EcInt* dx, EcInt* pref)
+{
+	EcInt acc;
+	acc.Set(1);
+	for (int i = 0; i < cnt; i++)
+	{
+		dx[i] = q.x;
+		dx[i].SubModP(x[i]);
+		pref[i] = acc;
+		acc.MulModP(dx[i]);
+	}
+	acc.InvModP();
+	for (int i = cnt - 1; i >= 0; i--)
+	{
+		EcInt inv = acc;
+		inv.MulModP(pref[i]);
+		acc.MulModP(dx[i]);
+		EcInt lambda = q.y;
+		lambda.SubModP(y[i]);
+		lambda.MulModP(inv);
+		EcInt nx = lambda;
+		nx.MulModP(lambda);
+		nx.SubModP(x[i]);
+		nx.SubModP(q.x);
+		EcInt ny = x[i];
+		ny.SubModP(nx);
+		ny.MulModP(lambda);
+		ny.SubModP(y[i]);
+		x[i] = nx;
+		y[i] = ny;
+	}
+}
+
+//baby points j*G for j in [2 + item * BSGS_ITEM_LEN, ...), j = 1 is added by Build
+void RCBsgs::BuildItem(u64 item)
+{
+	u64 start = 2 + item * BSGS_ITEM_LEN;
+	u64 end = start + BSGS_ITEM_LEN;
+	if (end > BabyCnt + 1)
+		end = BabyCnt + 1;
+	u64 len = end - start;
+	u64 stream_len = (len + BSGS_BATCH - 1) / BSGS_BATCH;
+	int cnt = (int)((len + stream_len - 1) / stream_len);
+	EcInt x[BSGS_BATCH], y[BSGS_BATCH], dx[BSGS_BATCH], pref[BSGS_BATCH];
+	EcInt k[BSGS_BATCH];
+	EcPoint p[BSGS_BATCH];
+	for (int i = 0; i < cnt; i++)
+		k[i].Set(start + i * stream_len);
+	Ec::MultiplyGBatch(k, p, cnt);
+	for (int i = 0; i < cnt; i++)
+	{
+		x[i] = p[i].x;
+		y[i] = p[i].y;
+	}
+	EcInt one;
+	one.Set(1);
+	EcPoint g = Ec::MultiplyG(one);
+	for (u64 step = 0; step < stream_len; step++)
+	{
+		for (int i = 0; i < cnt; i++)
+		{
+			u64 j = start + i * stream_len + step;
+			if (j < end)
+				Insert(x[i].data[0], (u32)j);
+		}
+		if (step + 1 < stream_len)
+			AddPointBatch(x, y, cnt, g, dx, pref);
+	}
+}
+
+//key candidate for point, returns true and sets key if it's correct
+static bool CheckBsgsKey(TBsgsTask* task, int pnt_ind, u64 val)
+{
+	EcInt k;
+	k.Set(val);
+	EcPoint p = Ec::MultiplyG(k);
+	if (!p.IsEqual(task->pnts[pnt_ind]))
+		return false;
+	task->cs.Enter();
+	if (!task->found[pnt_ind])
+	{
+		task->keys[pnt_ind] = k;
+		task->found[pnt_ind] = true;
+		task->solved++;
+	}
+	task->cs.Leave();
+	return true;
+}
+
+//every item is a stream of giant steps for one point, streams are processed together
+//point of stream is pnt - base * G, it's +-j*G if key is base +- j
+void RCBsgs::GiantItems(u64* items, int cnt, TBsgsTask* task)
+{
+	EcInt x[BSGS_BATCH], y[BSGS_BATCH], dx[BSGS_BATCH], pref[BSGS_BATCH];
+	int pnt_ind[BSGS_BATCH];
+	u64 base[BSGS_BATCH], left[BSGS_BATCH];
+	u64 step2m = 2 * BabyCnt;
+	int act = 0;
+	for (int i = 0; i < cnt; i++)
+	{
+		int pi = (int)(items[i] / task->items_per_pnt);
+		if (task->found[pi])
+			continue;
+		u64 first = (items[i] % task->items_per_pnt) * BSGS_ITEM_LEN;
+		u64 b = first * step2m + BabyCnt;
+		EcInt k;
+		k.Set(b);
+		EcPoint p = Ec::MultiplyG(k);
+		if (p.x.IsEqual(task->pnts[pi].x))
+		{
+			CheckBsgsKey(task, pi, b); //point at infinity, key is base or -base
+			continue;
+		}
+		p.y.NegModP();
+		p = Ec::AddPoints(task->pnts[pi], p);
+		x[act] = p.x;
+		y[act] = p.y;
+		pnt_ind[act] = pi;
+		base[act] = b;
+		left[act] = task->giant_cnt - first;
+		if (left[act] > BSGS_ITEM_LEN)
+			left[act] = BSGS_ITEM_LEN;
+		act++;
+	}
+
+	EcInt k2m;
+	k2m.Set(step2m);
+	EcPoint neg2m = Ec::MultiplyG(k2m);
+	neg2m.y.NegModP();
+	while (act)
+	{
+		for (int i = 0; i < act; i++)
+		{
+			u64 x0 = x[i].data[0];
+			u64 ind = x0 & TableMask;
+			while (Table[ind])
+			{
+				if ((Table[ind] >> 32) == (x0 >> 32))
+				{
+					u64 j = Table[ind] & 0xFFFFFFFF;
+					if (CheckBsgsKey(task, pnt_ind[i], base[i] + j) || CheckBsgsKey(task, pnt_ind[i], base[i] - j))
+						break;
+				}
+				ind = (ind + 1) & TableMask;
+			}
+		}
+		//remove finished streams and streams that would need doubling
+		int n = 0;
+		for (int i = 0; i < act; i++)
+		{
+			if (task->found[pnt_ind[i]] || !--left[i])
+				continue;
+			if (x[i].IsEqual(neg2m.x))
+			{
+				CheckBsgsKey(task, pnt_ind[i], base[i] - step2m) || CheckBsgsKey(task, pnt_ind[i], base[i] + step2m);
+				continue;
+			}
+			x[n] = x[i];
+			y[n] = y[i];
+			pnt_ind[n] = pnt_ind[i];
+			base[n] = base[i] + step2m;
+			left[n] = left[i];
+			n++;
+		}
+		act = n;
+		if (act)
+			AddPointBatch(x, y, act, neg2m, dx, pref);
+	}
+}
+
+static void bsgs_task_proc(void* data)
+{
+	TBsgsTask* task = (TBsgsTask*)data;
+	u64 items[BSGS_BATCH];
+	while (1)
+	{
+		int cnt = task->IsBuild ? 1 : BSGS_BATCH;
+		task->cs.Enter();
+		u64 first = task->NextItem;
+		if (first + cnt > task->ItemCnt)
+			cnt = (int)(task->ItemCnt - first);
+		task->NextItem += cnt;
+		task->cs.Leave();
+		if ((cnt <= 0) || task->bsgs->IsStopped())
+			break;
+		if (task->IsBuild)
+			task->bsgs->BuildItem(first);
+		else
+		{
+			for (int i = 0; i < cnt; i++)
+				items[i] = first + i;
+			task->bsgs->GiantItems(items, cnt, task);
+		}
+	}
+}
+
+static void RunBsgsTask(TBsgsTask* task, int thr_cnt)
+{
+	task->NextItem = 0;
+	GetThreadPool()->Run(bsgs_task_proc, task, thr_cnt);
+}
+
+//thr_cnt - 0 means all CPUs
+bool RCBsgs::Build(int _Range, int baby_bits, int thr_cnt)
+{
+	Release();
+	if ((_Range > BSGS_MAX_RANGE) || (baby_bits < BSGS_MIN_BITS) || (baby_bits > BSGS_MAX_BITS))
+		return false;
+	Range = _Range;
+	BabyBits = baby_bits;
+	BabyCnt = 1ull << baby_bits;
+	ThrCnt = thr_cnt ? thr_cnt : GetCpuCnt();
+	u64 size = 2 * BabyCnt;
+	Table = (u64*)calloc(size, sizeof(u64));
+	if (!Table)
+	{
+		printf("BSGS: cannot allocate %.3f GB for baby table\r\n", CalcBsgsRam(baby_bits));
+		return false;
+	}
+	TableMask = size - 1;
+
+	u64 tm = GetTickCount64();
+	EcInt one;
+	one.Set(1);
+	Insert(Ec::MultiplyG(one).x.data[0], 1);
+	TBsgsTask* task = new TBsgsTask();
+	task->bsgs = this;
+	task->IsBuild = true;
+	task->ItemCnt = (BabyCnt - 1 + BSGS_ITEM_LEN - 1) / BSGS_ITEM_LEN;
+	RunBsgsTask(task, ThrCnt);
+	delete task;
+	if (StopFlag)
+		return false;
+	printf("BSGS: baby table 2^%d points, %.3f GB, %d threads, built in %llu ms\r\n", baby_bits, CalcBsgsRam(baby_bits), ThrCnt, GetTickCount64() - tm);
+	return true;
+}
+
+//keys are in [0, 2^Range), returns number of solved points
+int RCBsgs::Solve(EcPoint* pnts, int pnt_cnt, EcInt* keys, bool* found)
+{
+	u64 tm = GetTickCount64();
+	TBsgsTask* task = new TBsgsTask();
+	task->bsgs = this;
+	task->IsBuild = false;
+	task->pnts = pnts;
+	task->keys = keys;
+	task->found = found;
+	task->solved = 0;
+	task->giant_cnt = ((1ull << Range) + 2 * BabyCnt - 1) / (2 * BabyCnt);
+	task->items_per_pnt = (task->giant_cnt + BSGS_ITEM_LEN - 1) / BSGS_ITEM_LEN;
+	task->ItemCnt = task->items_per_pnt * pnt_cnt;
+	for (int i = 0; i < pnt_cnt; i++)
+		found[i] = false;
+	RunBsgsTask(task, ThrCnt);
+	int res = task->solved;
+	delete task;
+	printf("BSGS: %d of %d points solved, 2^%.3f giant steps per point, %llu ms\r\n", res, pnt_cnt, log2((double)(((1ull << Range) + 2 * BabyCnt - 1) / (2 * BabyCnt))), GetTickCount64() - tm);
+	return res;
+}
@@ -0,0 +1,48 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#pragma once
+
+#include "Ec.h"
+#include "utils.h"
+
+//BSGS is used for small ranges only, keys must fit u64
+#define BSGS_MAX_RANGE		62
+#define BSGS_MIN_BITS		10
+#define BSGS_MAX_BITS		31
+
+double CalcBsgsRam(int baby_bits);
+int CalcBsgsBits(int Range, int pnt_cnt, double ram_gb);
+double EstimateBsgsTime(int Range, int baby_bits, int pnt_cnt, int thr_cnt, double thr_speed);
+
+//baby-step giant-step solver on CPU
+//baby table keeps x of j*G for j in [1, m], -j*G has same x, so one giant step covers 2m keys
+//table is built once and is used for many points, giant steps of all points are made in batches with one inversion per step
+class RCBsgs
+{
+private:
+	int BabyBits;
+	u64 BabyCnt; //m
+	u64* Table; //hash table by low 32 bits of x, every entry is high 32 bits of x and j, 0 - empty
+	u64 TableMask;
+	int ThrCnt;
+	volatile bool StopFlag;
+
+	void Insert(u64 x, u32 j);
+public:
+	int Range;
+
+	RCBsgs();
+	~RCBsgs();
+	bool Build(int _Range, int baby_bits, int thr_cnt);
+	void Release();
+	int Solve(EcPoint* pnts, int pnt_cnt, EcInt* keys, bool* found);
+	void Stop() { StopFlag = true; };
+	bool IsStopped() { return StopFlag; };
+
+	void BuildItem(u64 item);
+	void GiantItems(u64* items, int cnt, struct TBsgsTask* task);
+};
@@ -0,0 +1,348 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#include "CpuKang.h"
+
+static void Add192to192(u64* res, u64* val)
+{
+	u8 c = _addcarry_u64(0, res[0], val[0], res + 0);
+	c = _addcarry_u64(c, res[1], val[1], res + 1);
+	_addcarry_u64(c, res[2], val[2], res + 2);
+}
+
+static void Sub192from192(u64* res, u64* val)
+{
+	u8 c = _subborrow_u64(0, res[0], val[0], res + 0);
+	c = _subborrow_u64(c, res[1], val[1], res + 1);
+	_subborrow_u64(c, res[2], val[2], res + 2);
+}
+
+RCCpuKang::RCCpuKang()
+{
+	Kangs = NULL;
+	Dx = NULL;
+	Pref = NULL;
+	KangCnt = 0;
+}
+
+RCCpuKang::~RCCpuKang()
+{
+	Release();
+}
+
+void RCCpuKang::Release()
+{
+	delete[] Kangs;
+	delete[] Dx;
+	delete[] Pref;
+	Kangs = NULL;
+	Dx = NULL;
+	Pref = NULL;
+}
+
+#define CPU_WALK_CHECK(bs, gc, jc, md, sc) if ((jmp_cnt == jc) && (md_len == md)) return true;
+
+static bool IsCpuWalkSupported(u32 jmp_cnt, u32 md_len)
+{
+	WALK_CFG_LIST(CPU_WALK_CHECK)
+	return false;
+}
+
+//only JmpCnt and MdLen are used from cfg
+bool RCCpuKang::Prepare(EcPoint PntToSolve, int _Range, int _DPBits, u64 _DPThr, EcJMP* _EcJumps1, EcJMP* _EcJumps2, EcJMP* _EcJumps3, int _KangCnt, double* herd_parts, TWalkCfg* cfg)
+{
+	Release();
+	if (!IsCpuWalkSupported(cfg->JmpCnt, cfg->MdLen))
+		return false;
+	JmpCnt = cfg->JmpCnt;
+	MdLen = cfg->MdLen;
+	Range = _Range;
+	DPBits = _DPBits;
+	DPThr = _DPThr;
+	EcJumps1 = _EcJumps1;
+	EcJumps2 = _EcJumps2;
+	EcJumps3 = _EcJumps3;
+	KangCnt = _KangCnt;
+	memset(LoopStats, 0, sizeof(LoopStats));
+
+	Kangs = new TCpuKangState[KangCnt];
+	Dx = new EcInt[KangCnt];
+	Pref = new EcInt[KangCnt];
+
+	//start points, same as on GPU
+	EcInt HalfRange;
+	HalfRange.Set(1);
+	HalfRange.ShiftLeft(Range - 1);
+	EcPoint PntA = ec.MultiplyG(HalfRange);
+	PntA.y.NegModP();
+	PntA = ec.AddPoints(PntToSolve, PntA);
+	EcPoint PntB = PntA;
+	PntB.y.NegModP();
+
+	int tame_cnt = (int)(KangCnt * herd_parts[TAME]);
+	int wild1_cnt = (int)(KangCnt * herd_parts[WILD1]);
+	//Jacobian points, one inversion for all kangs
+	EcJPoint* jpnts = new EcJPoint[KangCnt];
+	EcPoint* pnts = new EcPoint[KangCnt];
+	for (int i = 0; i < KangCnt; i++)
+	{
+		TCpuKangState* kang = &Kangs[i];
+		kang->type = (i < tame_cnt) ? TAME : ((i < tame_cnt + wild1_cnt) ? WILD1 : WILD2);
+		EcInt d;
+		if (kang->type == TAME)
+			d.RndBits(Range - 4);
+		else
+		{
+			d.RndBits(Range - 1);
+			d.data[0] &= 0xFFFFFFFFFFFFFFFE; //must be even
+		}
+		jpnts[i] = ec.MultiplyGJ(d);
+		if (kang->type != TAME)
+			jpnts[i] = ec.AddPointsJA(jpnts[i], (kang->type == WILD1) ? PntA : PntB);
+		memcpy(kang->d, d.data, 24);
+	}
+	ec.ToAffineBatch(jpnts, pnts, KangCnt);
+	for (int i = 0; i < KangCnt; i++)
+	{
+		TCpuKangState* kang = &Kangs[i];
+		kang->x = pnts[i].x;
+		kang->y = pnts[i].y;
+		kang->L1S2 = false;
+		kang->looped = false;
+		kang->hist_ind = 0;
+		memset(kang->hist, 0, sizeof(kang->hist));
+	}
+	delete[] pnts;
+	delete[] jpnts;
+	return true;
+}
+
+//inv is 1/(x - jmp_x)
+template <int JMP_CNT, int MD_LEN>
+void RCCpuKang::MakeJump(TCpuKangState* kang, EcInt& inv, u32 step_ind, TDPRec* dps_out, int max_dps, int* dp_cnt)
+{
+	u32 jmp_ind = kang->x.data[0] % JMP_CNT;
+	EcJMP* jmp = kang->L1S2 ? &EcJumps2[jmp_ind] : &EcJumps1[jmp_ind];
+	EcInt jmp_y = jmp->p.y;
+	bool inv_flag = kang->y.data[0] & 1;
+	if (inv_flag)
+	{
+		jmp_ind |= INV_FLAG;
+		jmp_y.NegModP();
+	}
+
+	EcInt lambda, x, y;
+	lambda = kang->y;
+	lambda.SubModP(jmp_y);
+	lambda.MulModP(inv);
+	x = lambda;
+	x.MulModP(lambda);
+	x.SubModP(jmp->p.x);
+	x.SubModP(kang->x);
+	y = kang->x;
+	y.SubModP(x);
+	y.MulModP(lambda);
+	y.SubModP(kang->y);
+	kang->x = x;
+	kang->y = y;
+
+	//same as KernelA
+	if (!kang->L1S2)
+	{
+		u32 jmp_next = x.data[0] % JMP_CNT;
+		jmp_next |= (y.data[0] & 1) ? 0 : INV_FLAG;
+		if (jmp_ind == jmp_next)
+		{
+			kang->L1S2 = true;
+			LoopStats[2]++;
+		}
+	}
+	else
+		kang->L1S2 = false;
+
+	//same as KernelB
+	if (inv_flag)
+		Sub192from192(kang->d, jmp->dist.data);
+	else
+		Add192to192(kang->d, jmp->dist.data);
+
+	u32 iter = kang->hist_ind;
+	int found_ind = -1;
+	for (int ofs = 4; ofs < MD_LEN; ofs += 2)
+		if ((found_ind < 0) && (kang->hist[(iter + MD_LEN - ofs) % MD_LEN] == kang->d[0]))
+			found_ind = (iter + MD_LEN - ofs) % MD_LEN;
+	if ((found_ind < 0) && (kang->hist[iter] == kang->d[0]))
+		found_ind = iter;
+	kang->hist[iter] = kang->d[0];
+	kang->hist_ind = (iter + 1) % MD_LEN;
+	if (found_ind >= 0)
+	{
+		u32 LoopSize = (iter + MD_LEN - found_ind) % MD_LEN;
+		if (!LoopSize)
+			LoopSize = MD_LEN;
+		LoopStats[LoopSize]++;
+		kang->looped = true;
+		return;
+	}
+
+	if ((x.data[3] < DPThr) && (*dp_cnt < max_dps))
+	{
+		TDPRec* dp = dps_out + *dp_cnt;
+		memcpy(dp->x, x.data, 12);
+		dp->lvl_bits = (u32)((x.data[3] << DPBits) >> 32);
+		memcpy(dp->d, kang->d, 24);
+		dp->type = (u16)kang->type;
+		dp->step = (u16)step_ind;
+		dp->kang = (u32)(kang - Kangs);
+		(*dp_cnt)++;
+	}
+}
+
+//same as KernelC
+void RCCpuKang::Escape(TCpuKangState* kang)
+{
+	EcPoint p;
+	p.x = kang->x;
+	p.y = kang->y;
+	EcJMP* jmp = &EcJumps3[kang->x.data[0] % JmpCnt];
+	EcPoint jp = jmp->p;
+	bool inv_flag = kang->y.data[0] & 1;
+	if (inv_flag)
+		jp.y.NegModP();
+	p = ec.AddPoints(p, jp);
+	kang->x = p.x;
+	kang->y = p.y;
+	if (inv_flag)
+		Sub192from192(kang->d, jmp->dist.data);
+	else
+		Add192to192(kang->d, jmp->dist.data);
+	kang->L1S2 = false;
+	kang->looped = false;
+}
+
+//makes step_cnt jumps for every kang, one inversion for all kangs per jump
+//returns number of DPs in dps_out, GPU format
+template <int JMP_CNT, int MD_LEN>
+int RCCpuKang::StepT(int step_cnt, TDPRec* dps_out, int max_dps)
+{
+	int dp_cnt = 0;
+	for (int step = 0; step < step_cnt; step++)
+	{
+		EcInt acc;
+		acc.Set(1);
+		for (int i = 0; i < KangCnt; i++)
+		{
+			TCpuKangState* kang = &Kangs[i];
+			if (kang->looped)
+				continue;
+			u32 jmp_ind = kang->x.data[0] % JMP_CNT;
+			Dx[i] = kang->x;
+			Dx[i].SubModP(kang->L1S2 ? EcJumps2[jmp_ind].p.x : EcJumps1[jmp_ind].p.x);
+			Pref[i] = acc;
+			acc.MulModP(Dx[i]);
+		}
+		acc.InvModP();
+		for (int i = KangCnt - 1; i >= 0; i--)
+		{
+			TCpuKangState* kang = &Kangs[i];
+			if (kang->looped)
+				continue;
+			EcInt inv = acc;
+			inv.MulModP(Pref[i]);
+			acc.MulModP(Dx[i]);
+			MakeJump<JMP_CNT, MD_LEN>(kang, inv, step, dps_out, max_dps, &dp_cnt);
+		}
+	}
+	//looped kangs wait for the end of batch as on GPU
+	for (int i = 0; i < KangCnt; i++)
+		if (Kangs[i].looped)
+			Escape(&Kangs[i]);
+	return dp_cnt;
+}
+
+#define CPU_STEP(bs, gc, jc, md, sc) if ((JmpCnt == jc) && (MdLen == md)) return StepT<jc, md>(step_cnt, dps_out, max_dps);
+
+int RCCpuKang::Step(int step_cnt, TDPRec* dps_out, int max_dps)
+{
+	WALK_CFG_LIST(CPU_STEP)
+	return 0;
+}
+
+//kangs in GPU format (TPointPriv), for comparison with kernels
+void RCCpuKang::SaveKangs(u64* buf)
+{
+	for (int i = 0; i < KangCnt; i++)
+	{
+		u64* p = buf + 12 * i;
+		memcpy(p, Kangs[i].x.data, 32);
+		memcpy(p + 4, Kangs[i].y.data, 32);
+		memcpy(p + 8, Kangs[i].d, 24);
+		p[11] = Kangs[i].type;
+	}
+}
+
+//replays walk of single kang from start point at kernel call boundary, cfg must be same as on GPU
+//returns distance after "steps" jumps, false if x of point after these jumps doesn't match or if stop is set during replay
+bool RCCpuKang::Replay(EcPoint Start, EcInt& StartDist, int _Range, EcJMP* _EcJumps1, EcJMP* _EcJumps2, EcJMP* _EcJumps3, TWalkCfg* cfg, u64 steps, u8* x, EcInt& dist, volatile bool* stop)
+{
+	Release();
+	if (!steps || !IsCpuWalkSupported(cfg->JmpCnt, cfg->MdLen))
+		return false;
+	JmpCnt = cfg->JmpCnt;
+	MdLen = cfg->MdLen;
+	Range = _Range;
+	DPBits = 0;
+	DPThr = 0xFFFFFFFFFFFFFFFFull; //every point is DP, so we get them all in last kernel call
+	EcJumps1 = _EcJumps1;
+	EcJumps2 = _EcJumps2;
+	EcJumps3 = _EcJumps3;
+	KangCnt = 1;
+	memset(LoopStats, 0, sizeof(LoopStats));
+	Kangs = new TCpuKangState[1];
+	Dx = new EcInt[1];
+	Pref = new EcInt[1];
+
+	TCpuKangState* kang = &Kangs[0];
+	kang->type = TAME;
+	kang->x = Start.x;
+	kang->y = Start.y;
+	memcpy(kang->d, StartDist.data, 24);
+	kang->L1S2 = false;
+	kang->looped = false;
+	kang->hist_ind = 0;
+	memset(kang->hist, 0, sizeof(kang->hist));
+
+	u64 done = 0;
+	while (done + cfg->StepCnt < steps)
+	{
+		if (stop && *stop)
+		{
+			Release();
+			return false;
+		}
+		Step(cfg->StepCnt, NULL, 0);
+		done += cfg->StepCnt;
+	}
+	TDPRec* dps = (TDPRec*)malloc((size_t)cfg->StepCnt * sizeof(TDPRec));
+	int cnt = Step(cfg->StepCnt, dps, cfg->StepCnt);
+	u32 step_ind = (u32)(steps - done - 1);
+	bool res = false;
+	for (int i = 0; i < cnt; i++)
+	{
+		TDPRec* dp = dps + i;
+		if ((dp->step != step_ind) || memcmp(dp->x, x, 12))
+			continue;
+		dist.SetZero();
+		memcpy(dist.data, dp->d, 24);
+		if (dist.data[2] >> 63) //negative
+			dist.data[3] = dist.data[4] = 0xFFFFFFFFFFFFFFFFull;
+		res = true;
+		break;
+	}
+	free(dps);
+	Release();
+	return res;
+}
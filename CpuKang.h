@@ -0,0 +1,57 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#pragma once
+
+#include "GpuKang.h"
+
+struct TCpuKangState
+{
+	EcInt x;
+	EcInt y;
+	u64 d[3];
+	u32 type;
+	bool L1S2; //next jump is from jumps2 table
+	bool looped; //loop detected, escape at the end of Step
+	u32 hist_ind;
+	u64 hist[MAX_MD_LEN]; //low 64 bits of last distances to detect loops, same as LoopTable on GPU
+};
+
+//CPU walker, makes same jumps as GPU kernels: jumps2 for L1S2 loops, loops detection by last MdLen distances and escape by jumps3
+//it's slow, used for jumps tuning on small ranges
+//jumps are templates like GPU kernels, prebuilt for JmpCnt and MdLen values from WALK_CFG_LIST
+class RCCpuKang
+{
+private:
+	int Range;
+	int DPBits;
+	u64 DPThr;
+	TCpuKangState* Kangs;
+	EcInt* Dx;
+	EcInt* Pref;
+	EcJMP* EcJumps1;
+	EcJMP* EcJumps2;
+	EcJMP* EcJumps3;
+	Ec ec;
+
+	template <int JMP_CNT, int MD_LEN> void MakeJump(TCpuKangState* kang, EcInt& inv, u32 step_ind, TDPRec* dps_out, int max_dps, int* dp_cnt);
+	template <int JMP_CNT, int MD_LEN> int StepT(int step_cnt, TDPRec* dps_out, int max_dps);
+	void Escape(TCpuKangState* kang);
+public:
+	int KangCnt;
+	int JmpCnt;
+	int MdLen;
+	u64 LoopStats[MAX_MD_LEN + 1]; //by loop size, [2] - L1S2 loops
+
+	RCCpuKang();
+	~RCCpuKang();
+	bool Prepare(EcPoint PntToSolve, int _Range, int _DPBits, u64 _DPThr, EcJMP* _EcJumps1, EcJMP* _EcJumps2, EcJMP* _EcJumps3, int _KangCnt, double* herd_parts, TWalkCfg* cfg);
+	int Step(int step_cnt, TDPRec* dps_out, int max_dps);
+	void SetDPThr(u64 _DPThr) { DPThr = _DPThr; };
+	bool Replay(EcPoint Start, EcInt& StartDist, int _Range, EcJMP* _EcJumps1, EcJMP* _EcJumps2, EcJMP* _EcJumps3, TWalkCfg* cfg, u64 steps, u8* x, EcInt& dist, volatile bool* stop);
+	void SaveKangs(u64* buf);
+	void Release();
+};
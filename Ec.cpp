@@ -8,13 +8,22 @@
 #include "Ec.h"
 #include <random>
 #include "utils.h"
+#include "RCGpuUtils.h"
+#include "ThreadPool.h"
 
 // https://en.bitcoin.it/wiki/Secp256k1
 EcInt g_P; //FFFFFFFF FFFFFFFF FFFFFFFF FFFFFFFF FFFFFFFF FFFFFFFF FFFFFFFE FFFFFC2F
 EcInt g_N; //FFFFFFFF FFFFFFFF FFFFFFFF FFFFFFFE BAAEDCE6 AF48A03B BFD25E8C D0364141
 EcPoint g_G; //Generator point
 
-#define P_REV	0x00000001000003D1
+// GLV endomorphism: lambda * (x, y) = (beta * x, y)
+EcInt g_Beta; //cube root of unity mod P
+EcInt g_GlvA1, g_GlvB1, g_GlvA2, g_GlvB2; //short basis of the lattice k1 + k2 * lambda = 0 mod N, b1 is negative so abs value is stored
+EcInt g_GlvG1, g_GlvG2; //round(2^384 * b2 / N), round(2^384 * -b1 / N)
+
+#define GLV_WND_CNT		33 //4-bit windows of 128-bit halves, one extra window for rounding
+EcPoint* GlvTable = NULL; //[GLV_WND_CNT][15]: i * 16^j * G, affine
+EcPoint* GlvTableL = NULL; //same for lambda * G
 
 #ifdef DEBUG_MODE
 u8* GTable = NULL; //16x16-bit table
@@ -104,8 +113,94 @@ bool EcPoint::SetHexStr(const char* str)
 	return true;
 }
 
+#define PARSE_BATCH		256
+
+struct TParseTask
+{
+	char** strs;
+	EcPoint* res;
+	u8* valid;
+	int cnt;
+	int next;
+	CriticalSection cs;
+};
+
+static void parse_task_proc(void* data)
+{
+	TParseTask* task = (TParseTask*)data;
+	while (1)
+	{
+		task->cs.Enter();
+		int first = task->next;
+		task->next += PARSE_BATCH;
+		task->cs.Leave();
+		if (first >= task->cnt)
+			break;
+		int last = (first + PARSE_BATCH < task->cnt) ? first + PARSE_BATCH : task->cnt;
+		for (int i = first; i < last; i++)
+			task->valid[i] = task->res[i].SetHexStr(task->strs[i]) ? 1 : 0;
+	}
+}
+
+//SetHexStr for many strings as high priority pool tasks, thr_cnt - 0 means all pool workers
+//returns index of first invalid string or -1 if all are valid
+int ParsePubKeys(char** strs, int cnt, EcPoint* res, int thr_cnt)
+{
+	if (cnt <= 0)
+		return -1;
+	if (!thr_cnt)
+		thr_cnt = GetThreadPool()->GetWorkerCnt();
+	int max_thr = (cnt + PARSE_BATCH - 1) / PARSE_BATCH;
+	if (thr_cnt > max_thr)
+		thr_cnt = max_thr;
+	TParseTask task;
+	task.strs = strs;
+	task.res = res;
+	task.valid = (u8*)malloc(cnt);
+	task.cnt = cnt;
+	task.next = 0;
+	if (thr_cnt <= 1)
+		parse_task_proc(&task);
+	else
+		GetThreadPool()->Run(parse_task_proc, &task, thr_cnt, TASK_PRI_HIGH);
+	int bad = -1;
+	for (int i = 0; i < cnt; i++)
+		if (!task.valid[i])
+		{
+			bad = i;
+			break;
+		}
+	free(task.valid);
+	return bad;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+//comb tables for MultiplyGJ, 15 multiples of 16^j * G for every window, one inversion per window
+static void BuildGlvTables()
+{
+	GlvTable = new EcPoint[GLV_WND_CNT * 15];
+	GlvTableL = new EcPoint[GLV_WND_CNT * 15];
+	EcPoint base = g_G;
+	EcJPoint row[15];
+	for (int j = 0; j < GLV_WND_CNT; j++)
+	{
+		row[0].SetAffine(base);
+		for (int i = 1; i < 15; i++)
+			row[i] = Ec::AddPointsJA(row[i - 1], base);
+		EcPoint* t = GlvTable + 15 * j;
+		Ec::ToAffineBatch(row, t, 15);
+		for (int i = 0; i < 15; i++)
+		{
+			GlvTableL[15 * j + i].x = t[i].x;
+			GlvTableL[15 * j + i].x.MulModP(g_Beta);
+			GlvTableL[15 * j + i].y = t[i].y;
+		}
+		EcJPoint next = Ec::DoublePointJ(row[7]); //16 * base
+		base = Ec::ToAffine(next);
+	}
+}
+
 // https://en.bitcoin.it/wiki/Secp256k1
 void InitEc()
 {
@@ -113,6 +208,14 @@ void InitEc()
 	g_G.x.SetHexStr("79BE667EF9DCBBAC55A06295CE870B07029BFCDB2DCE28D959F2815B16F81798"); //G.x
 	g_G.y.SetHexStr("483ADA7726A3C4655DA4FBFC0E1108A8FD17B448A68554199C47D08FFB10D4B8"); //G.y
 	g_N.SetHexStr("FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFEBAAEDCE6AF48A03BBFD25E8CD0364141"); //order of G
+	g_Beta.SetHexStr("7AE96A2B657C07106E64479EAC3434E99CF0497512F58995C1396C28719501EE");
+	g_GlvA1.SetHexStr("3086D221A7D46BCDE86C90E49284EB15");
+	g_GlvB1.SetHexStr("E4437ED6010E88286F547FA90ABFE4C3");
+	g_GlvA2.SetHexStr("114CA50F7A8E2F3F657C1108D9D44CFD8");
+	g_GlvB2.SetHexStr("3086D221A7D46BCDE86C90E49284EB15");
+	g_GlvG1.SetHexStr("3086D221A7D46BCDE86C90E49284EB153DAA8A1471E8CA7FE893209A45DBB031");
+	g_GlvG2.SetHexStr("E4437ED6010E88286F547FA90ABFE4C4221208AC9DF506C61571B4AE8AC47F71");
+	BuildGlvTables();
 #ifdef DEBUG_MODE
 	GTable = (u8*)malloc(16 * 256 * 256 * 64);
 	EcPoint pnt = g_G;
@@ -132,6 +235,10 @@ void InitEc()
 
 void DeInitEc()
 {
+	delete[] GlvTable;
+	delete[] GlvTableL;
+	GlvTable = NULL;
+	GlvTableL = NULL;
 #ifdef DEBUG_MODE
 	if (GTable)
 		free(GTable);
@@ -154,7 +261,7 @@ EcPoint Ec::AddPoints(EcPoint& pnt1, EcPoint& pnt2)
 	lambda = dy;
 	lambda.MulModP(dx);
 	lambda2 = lambda;
-	lambda2.MulModP(lambda);
+	lambda2.SqrModP();
 
 	res.x = lambda2;
 	res.x.SubModP(pnt1.x);
@@ -178,13 +285,13 @@ EcPoint Ec::DoublePoint(EcPoint& pnt)
 	t1.InvModP();
 
 	t2 = pnt.x;
-	t2.MulModP(pnt.x);
+	t2.SqrModP();
 	lambda = t2;
 	lambda.AddModP(t2);
 	lambda.AddModP(t2);
 	lambda.MulModP(t1);
 	lambda2 = lambda;
-	lambda2.MulModP(lambda);
+	lambda2.SqrModP();
 
 	res.x = lambda2;
 	res.x.SubModP(pnt.x);
@@ -197,37 +304,319 @@ EcPoint Ec::DoublePoint(EcPoint& pnt)
 	return res;
 }
 
-//k up to 256 bits
-EcPoint Ec::MultiplyG(EcInt& k)
+void EcJPoint::SetAffine(EcPoint& pnt)
+{
+	x = pnt.x;
+	y = pnt.y;
+	z.Set(1);
+}
+
+// https://hyperelliptic.org/EFD/g1p/auto-shortw-jacobian-0.html#doubling-dbl-2009-l
+EcJPoint Ec::DoublePointJ(EcJPoint& pnt)
+{
+	EcJPoint res;
+	EcInt a, b, c, d, e;
+	if (pnt.IsInfinity())
+		return pnt;
+	a = pnt.x;
+	a.SqrModP();
+	b = pnt.y;
+	b.SqrModP();
+	c = b;
+	c.SqrModP();
+	//d = 2 * ((x + b)^2 - a - c)
+	d = pnt.x;
+	d.AddModP(b);
+	d.SqrModP();
+	d.SubModP(a);
+	d.SubModP(c);
+	d.AddModP(d);
+	//e = 3 * a
+	e = a;
+	e.AddModP(a);
+	e.AddModP(a);
+
+	res.x = e;
+	res.x.SqrModP();
+	res.x.SubModP(d);
+	res.x.SubModP(d);
+
+	c.AddModP(c);
+	c.AddModP(c);
+	c.AddModP(c);
+	res.y = d;
+	res.y.SubModP(res.x);
+	res.y.MulModP(e);
+	res.y.SubModP(c);
+
+	res.z = pnt.y;
+	res.z.MulModP(pnt.z);
+	res.z.AddModP(res.z);
+	return res;
+}
+
+//mixed addition, pnt2 is affine
+// https://hyperelliptic.org/EFD/g1p/auto-shortw-jacobian-0.html#addition-madd-2004-hmv
+EcJPoint Ec::AddPointsJA(EcJPoint& pnt1, EcPoint& pnt2)
+{
+	EcJPoint res;
+	if (pnt1.IsInfinity())
+	{
+		res.SetAffine(pnt2);
+		return res;
+	}
+	EcInt t1, t2, t3, t4;
+	t1 = pnt1.z;
+	t1.SqrModP();
+	t2 = t1;
+	t2.MulModP(pnt1.z);
+	t1.MulModP(pnt2.x);
+	t2.MulModP(pnt2.y);
+	t1.SubModP(pnt1.x);
+	t2.SubModP(pnt1.y);
+	if (t1.IsZero())
+	{
+		if (!t2.IsZero())
+			return res; //pnt2 == -pnt1, infinity
+		res.SetAffine(pnt2);
+		return DoublePointJ(res);
+	}
+	res.z = pnt1.z;
+	res.z.MulModP(t1);
+	t4 = t1;
+	t4.SqrModP();
+	t3 = t4;
+	t3.MulModP(t1);
+	t4.MulModP(pnt1.x);
+
+	res.x = t2;
+	res.x.SqrModP();
+	res.x.SubModP(t4);
+	res.x.SubModP(t4);
+	res.x.SubModP(t3);
+
+	t4.SubModP(res.x);
+	t4.MulModP(t2);
+	t3.MulModP(pnt1.y);
+	res.y = t4;
+	res.y.SubModP(t3);
+	return res;
+}
+
+//infinity gives zero point
+EcPoint Ec::ToAffine(EcJPoint& pnt)
 {
 	EcPoint res;
-	EcPoint t = g_G;
-	bool first = true;
-	int n = 3;
-	while ((n >= 0) && !k.data[n])
-		n--;
-	if (n < 0)
-		return res; //error
-	int index;                     
-	_BitScanReverse64((DWORD*)&index, k.data[n]);
-	for (int i = 0; i <= 64 * n + index; i++)
+	if (pnt.IsInfinity())
+		return res;
+	EcInt zi, zi2;
+	zi = pnt.z;
+	zi.InvModP();
+	zi2 = zi;
+	zi2.SqrModP();
+	res.x = pnt.x;
+	res.x.MulModP(zi2);
+	zi2.MulModP(zi);
+	res.y = pnt.y;
+	res.y.MulModP(zi2);
+	return res;
+}
+
+//one inversion for all points, Montgomery trick
+void Ec::ToAffineBatch(EcJPoint* pnts, EcPoint* res, int cnt)
+{
+	EcInt* pref = new EcInt[cnt];
+	EcInt acc;
+	acc.Set(1);
+	for (int i = 0; i < cnt; i++)
 	{
-		u8 v = (k.data[i / 64] >> (i % 64)) & 1;	
-		if (v)
+		pref[i] = acc;
+		if (!pnts[i].IsInfinity())
+			acc.MulModP(pnts[i].z);
+	}
+	acc.InvModP();
+	for (int i = cnt - 1; i >= 0; i--)
+	{
+		if (pnts[i].IsInfinity())
+		{
+			res[i] = EcPoint();
+			continue;
+		}
+		EcInt zi, zi2;
+		zi = acc;
+		zi.MulModP(pref[i]);
+		acc.MulModP(pnts[i].z);
+		zi2 = zi;
+		zi2.SqrModP();
+		res[i].x = pnts[i].x;
+		res[i].x.MulModP(zi2);
+		zi2.MulModP(zi);
+		res[i].y = pnts[i].y;
+		res[i].y.MulModP(zi2);
+	}
+	delete[] pref;
+}
+
+//res = a * b, 512 bits
+static void Mul256(u64* a, u64* b, u64* res)
+{
+	memset(res, 0, 8 * 8);
+	for (int i = 0; i < 4; i++)
+	{
+		u64 carry = 0;
+		for (int j = 0; j < 4; j++)
 		{
-			if (first)
-			{
-				first = false;
-				res = t;
-			}
-			else
-				res = Ec::AddPoints(res, t);
+			u64 hi, lo;
+			lo = _umul128(a[i], b[j], &hi);
+			hi += _addcarry_u64(0, lo, res[i + j], &lo);
+			hi += _addcarry_u64(0, lo, carry, &res[i + j]);
+			carry = hi;
+		}
+		res[i + 4] = carry;
+	}
+}
+
+//round(k * g / 2^384), up to 128 bits
+static void GlvRound(EcInt& k, EcInt& g, EcInt& res)
+{
+	u64 prod[8];
+	Mul256(k.data, g.data, prod);
+	u8 c = _addcarry_u64(0, prod[5], 0x8000000000000000ull, prod + 5);
+	c = _addcarry_u64(c, prod[6], 0, prod + 6);
+	_addcarry_u64(c, prod[7], 0, prod + 7);
+	res.SetZero();
+	res.data[0] = prod[6];
+	res.data[1] = prod[7];
+}
+
+//res = a * c, c up to 128 bits, a up to 129 bits
+static void GlvMul(EcInt& a, EcInt& c, EcInt& res)
+{
+	EcInt t;
+	res.Mul_u64(a, c.data[0]);
+	t.Mul_u64(a, c.data[1]);
+	t.ShiftLeft(64);
+	res.Add(t);
+}
+
+//k = k1 + k2 * lambda mod N, |k1| and |k2| are below 2^128, signs are returned separately
+void Ec::SplitScalar(EcInt& k, EcInt& k1, bool& neg1, EcInt& k2, bool& neg2)
+{
+	EcInt kn = k;
+	if (!kn.IsLessThanU(g_N))
+		kn.Sub(g_N);
+	EcInt c1, c2, t;
+	GlvRound(kn, g_GlvG1, c1);
+	GlvRound(kn, g_GlvG2, c2);
+	//k1 = k - c1 * a1 - c2 * a2
+	k1 = kn;
+	GlvMul(g_GlvA1, c1, t);
+	k1.Sub(t);
+	GlvMul(g_GlvA2, c2, t);
+	k1.Sub(t);
+	//k2 = c1 * |b1| - c2 * b2
+	GlvMul(g_GlvB1, c1, k2);
+	GlvMul(g_GlvB2, c2, t);
+	k2.Sub(t);
+	neg1 = (k1.data[4] >> 63) != 0;
+	if (neg1)
+		k1.Neg();
+	neg2 = (k2.data[4] >> 63) != 0;
+	if (neg2)
+		k2.Neg();
+}
+
+//GLV split and comb tables: only mixed additions, no doublings
+EcJPoint Ec::MultiplyGJ(EcInt& k)
+{
+	EcJPoint res; //infinity
+	EcInt k1, k2;
+	bool neg1, neg2;
+	SplitScalar(k, k1, neg1, k2, neg2);
+	for (int j = 0; j < GLV_WND_CNT; j++)
+	{
+		u32 w1 = (k1.data[j / 16] >> (4 * (j % 16))) & 15;
+		if (w1)
+		{
+			EcPoint p = GlvTable[15 * j + w1 - 1];
+			if (neg1)
+				p.y.NegModP();
+			res = AddPointsJA(res, p);
+		}
+		u32 w2 = (k2.data[j / 16] >> (4 * (j % 16))) & 15;
+		if (w2)
+		{
+			EcPoint p = GlvTableL[15 * j + w2 - 1];
+			if (neg2)
+				p.y.NegModP();
+			res = AddPointsJA(res, p);
 		}
-		t = Ec::DoublePoint(t);
 	}
 	return res;
 }
 
+//GLV split and joint 4-bit windows: 15 multiples of pnt and lambda * pnt, 4 doublings and up to 2 mixed additions per window
+EcJPoint Ec::MultiplyPointJ(EcPoint& pnt, EcInt& k)
+{
+	EcJPoint res; //infinity
+	EcInt k1, k2;
+	bool neg1, neg2;
+	SplitScalar(k, k1, neg1, k2, neg2);
+	EcJPoint tj[15];
+	tj[0].SetAffine(pnt);
+	for (int i = 1; i < 15; i++)
+		tj[i] = AddPointsJA(tj[i - 1], pnt);
+	EcPoint t1[15], t2[15];
+	ToAffineBatch(tj, t1, 15);
+	for (int i = 0; i < 15; i++)
+	{
+		t2[i].x = t1[i].x;
+		t2[i].x.MulModP(g_Beta);
+		t2[i].y = t1[i].y;
+		if (neg1)
+			t1[i].y.NegModP();
+		if (neg2)
+			t2[i].y.NegModP();
+	}
+	for (int j = GLV_WND_CNT - 1; j >= 0; j--)
+	{
+		if (!res.IsInfinity())
+			for (int i = 0; i < 4; i++)
+				res = DoublePointJ(res);
+		u32 w1 = (k1.data[j / 16] >> (4 * (j % 16))) & 15;
+		if (w1)
+			res = AddPointsJA(res, t1[w1 - 1]);
+		u32 w2 = (k2.data[j / 16] >> (4 * (j % 16))) & 15;
+		if (w2)
+			res = AddPointsJA(res, t2[w2 - 1]);
+	}
+	return res;
+}
+
+//k up to 256 bits, zero k gives zero point
+EcPoint Ec::MultiplyPoint(EcPoint& pnt, EcInt& k)
+{
+	EcJPoint res = MultiplyPointJ(pnt, k);
+	return ToAffine(res);
+}
+
+//k up to 256 bits, zero k gives zero point
+EcPoint Ec::MultiplyG(EcInt& k)
+{
+	EcJPoint res = MultiplyGJ(k);
+	return ToAffine(res);
+}
+
+//same as MultiplyG for every k but with one inversion for all points
+void Ec::MultiplyGBatch(EcInt* k, EcPoint* res, int cnt)
+{
+	EcJPoint* pnts = new EcJPoint[cnt];
+	for (int i = 0; i < cnt; i++)
+		pnts[i] = MultiplyGJ(k[i]);
+	ToAffineBatch(pnts, res, cnt);
+	delete[] pnts;
+}
+
 #ifdef DEBUG_MODE
 //uses gTable (16x16-bit) to speedup calculation
 EcPoint Ec::MultiplyG_Fast(EcInt& k)
@@ -268,7 +657,7 @@ EcInt Ec::CalcY(EcInt& x, bool is_even)
 	EcInt tmp;
 	tmp.Set(7);
 	res = x;
-	res.MulModP(x);
+	res.SqrModP();
 	res.MulModP(x);
 	res.AddModP(tmp);
 	res.SqrtModP();
@@ -282,26 +671,16 @@ bool Ec::IsValidPoint(EcPoint& pnt)
 	EcInt x, y, seven;
 	seven.Set(7);
 	x = pnt.x;
-	x.MulModP(pnt.x);
+	x.SqrModP();
 	x.MulModP(pnt.x);
 	x.AddModP(seven);
 	y = pnt.y;
-	y.MulModP(pnt.y);
+	y.SqrModP();
 	return x.IsEqual(y);
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void Mul256_by_64(u64* input, u64 multiplier, u64* result)
-{
-	u64 h1, h2;
-	result[0] = _umul128(input[0], multiplier, &h1);
-	u8 carry = _addcarry_u64(0, _umul128(input[1], multiplier, &h2), h1, result + 1);
-	carry = _addcarry_u64(carry, _umul128(input[2], multiplier, &h1), h2, result + 2);
-	carry = _addcarry_u64(carry, _umul128(input[3], multiplier, &h2), h1, result + 3);
-	_addcarry_u64(carry, 0, h2, result + 4);
-}
-
 void Mul320_by_64(u64* input, u64 multiplier, u64* result)
 {
 	u64 h1, h2;
@@ -312,15 +691,6 @@ void Mul320_by_64(u64* input, u64 multiplier, u64* result)
 	_addcarry_u64(carry, _umul128(input[4], multiplier, &h1), h2, result + 4);
 }
 
-void Add320_to_256(u64* in_out, u64* val)
-{
-	u8 c = _addcarry_u64(0, in_out[0], val[0], in_out);
-	c = _addcarry_u64(c, in_out[1], val[1], in_out + 1);
-	c = _addcarry_u64(c, in_out[2], val[2], in_out + 2);
-	c = _addcarry_u64(c, in_out[3], val[3], in_out + 3);
-	_addcarry_u64(c, 0, val[4], in_out + 4);
-}
-
 EcInt::EcInt()
 {
 	SetZero();
@@ -455,24 +825,21 @@ bool EcInt::IsZero()
 	return ((data[0] == 0) && (data[1] == 0) && (data[2] == 0) && (data[3] == 0) && (data[4] == 0));
 }
 
+//field ops use same code as GPU kernels, see RCGpuUtils.h
 void EcInt::AddModP(EcInt& val)
 {
-	Add(val);
-	if (!IsLessThanU(g_P)) 
-		Sub(g_P);
+	::AddModP(data, data, val.data);
 }
 
 void EcInt::SubModP(EcInt& val)
 {
-	if (Sub(val))
-		Add(g_P);
+	::SubModP(data, data, val.data);
 }
 
 //assume value < P
 void EcInt::NegModP()
 {
-	Neg();
-	Add(g_P);
+	::NegModP(data);
 }
 
 //assume value < N
@@ -518,27 +885,21 @@ void EcInt::ShiftLeft(int nbits)
 	data[0] = data[0] << nbits;
 }
 
+//GPU MulModP result is < 2^256 but can be >= P, so here we reduce it
 void EcInt::MulModP(EcInt& val)
-{	
-	u64 buff[8], tmp[5], h;
-	//calc 512 bits
-	Mul256_by_64(val.data, data[0], buff);
-	Mul256_by_64(val.data, data[1], tmp);
-	Add320_to_256(buff + 1, tmp);
-	Mul256_by_64(val.data, data[2], tmp);
-	Add320_to_256(buff + 2, tmp);
-	Mul256_by_64(val.data, data[3], tmp);
-	Add320_to_256(buff + 3, tmp);
-	//fast mod P
-	Mul256_by_64(buff + 4, P_REV, tmp);
-	u8 c = _addcarry_u64(0, buff[0], tmp[0], buff);
-	c = _addcarry_u64(c, buff[1], tmp[1], buff + 1);
-	c = _addcarry_u64(c, buff[2], tmp[2], buff + 2);
-	tmp[4] += _addcarry_u64(c, buff[3], tmp[3], buff + 3);
-	c = _addcarry_u64(0, buff[0], _umul128(tmp[4], P_REV, &h), data);
-	c = _addcarry_u64(c, buff[1], h, data + 1);
-	c = _addcarry_u64(c, 0, buff[2], data + 2);
-	data[4] = _addcarry_u64(c, buff[3], 0, data + 3);
+{
+	::MulModP(data, data, val.data);
+	data[4] = 0;
+	if (!IsLessThanU(g_P))
+		Sub(g_P);
+}
+
+void EcInt::SqrModP()
+{
+	::SqrModP(data, data);
+	data[4] = 0;
+	if (!IsLessThanU(g_P))
+		Sub(g_P);
 }
 
 void EcInt::Mul_u64(EcInt& val, u64 multiplier)
@@ -558,146 +919,304 @@ void EcInt::Mul_i64(EcInt& val, i64 multiplier)
 	Mul320_by_64(data, (u64)multiplier, data);
 }
 
-#define APPLY_DIV_SHIFT() kbnt -= index; val >>= index; matrix[0] <<= index; matrix[1] <<= index; 
-	
-// https://tches.iacr.org/index.php/TCHES/article/download/8298/7648/4494
-//a bit tricky
-void DIV_62(i64& kbnt, i64 modp, i64 val, i64* matrix)
+// Host inversion: variable-time safegcd with 62 divsteps per round, https://eprint.iacr.org/2019/266
+// same approach as modinv64_var in libsecp256k1. Numbers are 5 signed 62-bit limbs, P = 2^256 - 0x1000003D1
+
+#define M62			0x3FFFFFFFFFFFFFFFull
+#define P_INV62		0x27C7F6E22DDACACFull //P^-1 mod 2^62
+#define P62_0		(-(i64)0x1000003D1ull) //P in 62-bit limbs: P62_0, 0, 0, 0, P62_4
+#define P62_4		256
+
+//signed 128-bit accumulator
+struct TAcc128
 {
-	int index, cnt;
-	_BitScanForward64((DWORD*)&index, val | 0x4000000000000000);
-	APPLY_DIV_SHIFT();
-	cnt = 62 - index;
-	while (cnt > 0)
+	u64 lo;
+	i64 hi;
+};
+
+static inline void acc_mul(TAcc128& r, i64 a, i64 b)
+{
+#ifdef _WIN32
+	r.lo = (u64)_mul128(a, b, &r.hi);
+#else
+	__int128 p = (__int128)a * b;
+	r.lo = (u64)p;
+	r.hi = (i64)(p >> 64);
+#endif
+}
+
+static inline void acc_add_mul(TAcc128& r, i64 a, i64 b)
+{
+	TAcc128 t;
+	acc_mul(t, a, b);
+	u8 c = _addcarry_u64(0, r.lo, t.lo, &r.lo);
+	r.hi += t.hi + c;
+}
+
+static inline void acc_shr62(TAcc128& r)
+{
+	r.lo = (r.lo >> 62) | ((u64)r.hi << 2);
+	r.hi >>= 62;
+}
+
+static inline int ctz64(u64 x)
+{
+#ifdef _WIN32
+	unsigned long index;
+	_BitScanForward64(&index, x);
+	return (int)index;
+#else
+	return __builtin_ctzll(x);
+#endif
+}
+
+//62 divsteps on low bits of f and g, returns new eta and transition matrix scaled by 2^62: u, v, q, r
+static i64 divsteps_62_var(i64 eta, u64 f0, u64 g0, i64* t)
+{
+	u64 u = 1, v = 0, q = 0, r = 1;
+	u64 f = f0, g = g0, m, tmp;
+	u32 w;
+	int i = 62, limit, zeros;
+	while (1)
 	{
-		if (kbnt < 0)
+		//zeros of g up to i at once, sentinel bit stops the count
+		zeros = ctz64(g | (0xFFFFFFFFFFFFFFFFull << i));
+		g >>= zeros;
+		u <<= zeros;
+		v <<= zeros;
+		eta -= zeros;
+		i -= zeros;
+		if (!i)
+			break;
+		if (eta < 0)
 		{
-			kbnt = -kbnt;
-			i64 tmp = -modp; modp = val; val = tmp;
-			tmp = -matrix[0]; matrix[0] = matrix[2]; matrix[2] = tmp;
-			tmp = -matrix[1]; matrix[1] = matrix[3]; matrix[3] = tmp;
+			eta = -eta;
+			tmp = f; f = g; g = 0 - tmp;
+			tmp = u; u = q; q = 0 - tmp;
+			tmp = v; v = r; r = 0 - tmp;
+			//cancel up to 6 low bits of g
+			limit = ((int)eta + 1) > i ? i : ((int)eta + 1);
+			m = (0xFFFFFFFFFFFFFFFFull >> (64 - limit)) & 63;
+			w = (u32)((f * g * (f * f - 2)) & m);
 		}
-		int thr = cnt;
-		if ((kbnt + 1) < cnt)
-			thr = (int)(kbnt + 1);
-		i64 mul = (-modp * val) & ((UINT64_MAX >> (64 - thr)) & 0x07);
-		val += (modp * mul);
-		matrix[2] += (matrix[0] * mul);
-		matrix[3] += (matrix[1] * mul);
-		_BitScanForward64((DWORD*)&index, val | (1ull << cnt));
-		APPLY_DIV_SHIFT();
-		cnt -= index;
+		else
+		{
+			//cancel up to 4 low bits of g
+			limit = ((int)eta + 1) > i ? i : ((int)eta + 1);
+			m = (0xFFFFFFFFFFFFFFFFull >> (64 - limit)) & 15;
+			w = (u32)(f + (((f + 1) & 4) << 1));
+			w = (u32)((0 - (u64)w * g) & m);
+		}
+		g += f * w;
+		q += u * w;
+		r += v * w;
 	}
+	t[0] = (i64)u;
+	t[1] = (i64)v;
+	t[2] = (i64)q;
+	t[3] = (i64)r;
+	return eta;
 }
 
-void EcInt::InvModP()
+//[d, e] = t * [d, e] / 2^62 mod P, d and e stay in (-2P, P)
+static void update_de_62(i64* d, i64* e, i64* t)
 {
-	i64 matrix[4];
-	EcInt result, a, tmp, tmp2;
-	EcInt modp, val;
-	i64 kbnt = -1;
-	matrix[1] = matrix[2] = 0;
-	matrix[0] = matrix[3] = 1;	
-	DIV_62(kbnt, g_P.data[0], data[0], matrix);
-	modp.Mul_i64(g_P, matrix[0]);
-	tmp.Mul_i64(*this, matrix[1]);
-	modp.Add(tmp);
-	modp.ShiftRight(62);
-	val.Mul_i64(g_P, matrix[2]);
-	tmp.Mul_i64(*this, matrix[3]);
-	val.Add(tmp);
-	val.ShiftRight(62);
-	if (matrix[1] >= 0)
-		result.Set(matrix[1]);
-	else
+	i64 u = t[0], v = t[1], q = t[2], r = t[3];
+	i64 sd = d[4] >> 63;
+	i64 se = e[4] >> 63;
+	i64 md = (u & sd) + (v & se);
+	i64 me = (q & sd) + (r & se);
+	TAcc128 cd, ce;
+	acc_mul(cd, u, d[0]);
+	acc_add_mul(cd, v, e[0]);
+	acc_mul(ce, q, d[0]);
+	acc_add_mul(ce, r, e[0]);
+	//md, me are chosen so that low 62 bits become zero
+	md -= (P_INV62 * cd.lo + md) & M62;
+	me -= (P_INV62 * ce.lo + me) & M62;
+	acc_add_mul(cd, P62_0, md);
+	acc_add_mul(ce, P62_0, me);
+	acc_shr62(cd);
+	acc_shr62(ce);
+	for (int i = 1; i < 5; i++)
 	{
-		result.Set(-matrix[1]);
-		result.Neg();
+		acc_add_mul(cd, u, d[i]);
+		acc_add_mul(cd, v, e[i]);
+		acc_add_mul(ce, q, d[i]);
+		acc_add_mul(ce, r, e[i]);
+		if (i == 4)
+		{
+			acc_add_mul(cd, P62_4, md);
+			acc_add_mul(ce, P62_4, me);
+		}
+		d[i - 1] = cd.lo & M62;
+		e[i - 1] = ce.lo & M62;
+		acc_shr62(cd);
+		acc_shr62(ce);
 	}
-	if (matrix[3] >= 0)
-		a.Set(matrix[3]);
-	else
-	{ 
-		a.Set(-matrix[3]);
-		a.Neg();
-	}
-	Mul320_by_64(g_P.data, (result.data[0] * 0xD838091DD2253531) & 0x3FFFFFFFFFFFFFFF, tmp.data);
-	result.Add(tmp);
-	result.ShiftRight(62);
-	Mul320_by_64(g_P.data, (a.data[0] * 0xD838091DD2253531) & 0x3FFFFFFFFFFFFFFF, tmp.data);
-	a.Add(tmp);
-	a.ShiftRight(62);
-	
-	while (val.data[0] || val.data[1] || val.data[2] || val.data[3])
-	{
-		matrix[1] = matrix[2] = 0;
-		matrix[0] = matrix[3] = 1;	
-		DIV_62(kbnt, modp.data[0], val.data[0], matrix);
-		tmp.Mul_i64(modp, matrix[0]);
-		tmp2.Mul_i64(val, matrix[1]);
-		tmp.Add(tmp2);
-		tmp2.Mul_i64(val, matrix[3]);
-		val.Mul_i64(modp, matrix[2]);
-		val.Add(tmp2);
-		val.ShiftRight(62);
-		modp = tmp;
-		modp.ShiftRight(62);
-		tmp.Mul_i64(result, matrix[0]);
-		tmp2.Mul_i64(a, matrix[1]);
-		tmp.Add(tmp2);
-		tmp2.Mul_i64(a, matrix[3]);
-		a.Mul_i64(result, matrix[2]);
-		a.Add(tmp2);
-		Mul320_by_64(g_P.data, (a.data[0] * 0xD838091DD2253531) & 0x3FFFFFFFFFFFFFFF, tmp2.data);
-		a.Add(tmp2);
-		a.ShiftRight(62);	
-		Mul320_by_64(g_P.data, (tmp.data[0] * 0xD838091DD2253531) & 0x3FFFFFFFFFFFFFFF, tmp2.data);
-		result = tmp;
-		result.Add(tmp2);
-		result.ShiftRight(62);
-	}
-	Assign(result);
-	if (modp.data[4] >> 63)
+	d[4] = (i64)cd.lo;
+	e[4] = (i64)ce.lo;
+}
+
+//[f, g] = t * [f, g] / 2^62, only len limbs are used
+static void update_fg_62_var(int len, i64* f, i64* g, i64* t)
+{
+	i64 u = t[0], v = t[1], q = t[2], r = t[3];
+	TAcc128 cf, cg;
+	acc_mul(cf, u, f[0]);
+	acc_add_mul(cf, v, g[0]);
+	acc_mul(cg, q, f[0]);
+	acc_add_mul(cg, r, g[0]);
+	acc_shr62(cf);
+	acc_shr62(cg);
+	for (int i = 1; i < len; i++)
 	{
-		Neg();
-		modp.Neg();	
+		acc_add_mul(cf, u, f[i]);
+		acc_add_mul(cf, v, g[i]);
+		acc_add_mul(cg, q, f[i]);
+		acc_add_mul(cg, r, g[i]);
+		f[i - 1] = cf.lo & M62;
+		g[i - 1] = cg.lo & M62;
+		acc_shr62(cf);
+		acc_shr62(cg);
 	}
+	f[len - 1] = (i64)cf.lo;
+	g[len - 1] = (i64)cg.lo;
+}
 
-	if (modp.data[0] == 1) 
+//d in (-2P, P) to [0, P), negated if sign is negative
+static void normalize_62(i64* d, i64 sign)
+{
+	i64 cond_add = d[4] >> 63;
+	d[0] += P62_0 & cond_add;
+	d[4] += P62_4 & cond_add;
+	i64 cond_neg = sign >> 63;
+	for (int i = 0; i < 5; i++)
+		d[i] = (d[i] ^ cond_neg) - cond_neg;
+	for (int i = 0; i < 4; i++)
 	{
-		if (data[4] >> 63)
-			Add(g_P);
-		if (data[4] >> 63)
-			Add(g_P);
-		if (!IsLessThanU(g_P))
-			Sub(g_P);
-		if (!IsLessThanU(g_P))
-			Sub(g_P);
+		d[i + 1] += d[i] >> 62;
+		d[i] &= M62;
+	}
+	cond_add = d[4] >> 63;
+	d[0] += P62_0 & cond_add;
+	d[4] += P62_4 & cond_add;
+	for (int i = 0; i < 4; i++)
+	{
+		d[i + 1] += d[i] >> 62;
+		d[i] &= M62;
 	}
-	else
-		SetZero(); //error
 }
 
-// x = a^ { (p + 1) / 4 } mod p
-void EcInt::SqrtModP()
+//returns zero for zero
+void EcInt::InvModP()
 {
-	EcInt one, res;
-	one.Set(1);
-	EcInt exp = g_P;
-	exp.Add(one);
-	exp.ShiftRight(2);
-	res.Set(1);
-	EcInt cur = *this;
-	while (!exp.IsZero())
-	{
-		if (exp.data[0] & 1)
-			res.MulModP(cur);
-		EcInt tmp = cur;
-		tmp.MulModP(cur);
-		cur = tmp;
-		exp.ShiftRight(1);
+	data[4] = 0;
+	if (!IsLessThanU(g_P))
+		Sub(g_P);
+	if (IsZero())
+		return;
+	i64 d[5] = { 0, 0, 0, 0, 0 };
+	i64 e[5] = { 1, 0, 0, 0, 0 };
+	i64 f[5] = { P62_0, 0, 0, 0, P62_4 };
+	i64 g[5];
+	g[0] = data[0] & M62;
+	g[1] = ((data[0] >> 62) | (data[1] << 2)) & M62;
+	g[2] = ((data[1] >> 60) | (data[2] << 4)) & M62;
+	g[3] = ((data[2] >> 58) | (data[3] << 6)) & M62;
+	g[4] = data[3] >> 56;
+	i64 t[4];
+	i64 eta = -1;
+	int len = 5;
+	while (1)
+	{
+		eta = divsteps_62_var(eta, f[0], g[0], t);
+		update_de_62(d, e, t);
+		update_fg_62_var(len, f, g, t);
+		if (!g[0])
+		{
+			i64 cond = 0;
+			for (int j = 1; j < len; j++)
+				cond |= g[j];
+			if (!cond)
+				break;
+		}
+		//shorten f and g when their top limbs are only sign bits
+		i64 fn = f[len - 1];
+		i64 gn = g[len - 1];
+		i64 cond = ((i64)len - 2) >> 63;
+		cond |= fn ^ (fn >> 63);
+		cond |= gn ^ (gn >> 63);
+		if (!cond)
+		{
+			f[len - 2] |= (u64)fn << 62;
+			g[len - 2] |= (u64)gn << 62;
+			len--;
+		}
 	}
-	*this = res;
+	//f is 1 or -1 now
+	normalize_62(d, f[len - 1]);
+	data[0] = (u64)d[0] | ((u64)d[1] << 62);
+	data[1] = ((u64)d[1] >> 2) | ((u64)d[2] << 60);
+	data[2] = ((u64)d[2] >> 4) | ((u64)d[3] << 58);
+	data[3] = ((u64)d[3] >> 6) | ((u64)d[4] << 56);
+	data[4] = 0;
+}
+
+//a = a^(2^n), result is not fully reduced until the last SqrModP
+static void SqrModP_N(EcInt& a, int n)
+{
+	for (int i = 1; i < n; i++)
+		::SqrModP(a.data, a.data);
+	a.SqrModP();
+}
+
+// x = a^ { (p + 1) / 4 } mod p, fixed addition chain: 253 squarings and 13 multiplications
+// xN = a^(2^N - 1)
+void EcInt::SqrtModP()
+{
+	EcInt x2, x3, x6, x9, x11, x22, x44, x88, x176, x220, x223, t;
+	x2 = *this;
+	x2.SqrModP();
+	x2.MulModP(*this);
+	x3 = x2;
+	x3.SqrModP();
+	x3.MulModP(*this);
+	x6 = x3;
+	SqrModP_N(x6, 3);
+	x6.MulModP(x3);
+	x9 = x6;
+	SqrModP_N(x9, 3);
+	x9.MulModP(x3);
+	x11 = x9;
+	SqrModP_N(x11, 2);
+	x11.MulModP(x2);
+	x22 = x11;
+	SqrModP_N(x22, 11);
+	x22.MulModP(x11);
+	x44 = x22;
+	SqrModP_N(x44, 22);
+	x44.MulModP(x22);
+	x88 = x44;
+	SqrModP_N(x88, 44);
+	x88.MulModP(x44);
+	x176 = x88;
+	SqrModP_N(x176, 88);
+	x176.MulModP(x88);
+	x220 = x176;
+	SqrModP_N(x220, 44);
+	x220.MulModP(x44);
+	x223 = x220;
+	SqrModP_N(x223, 3);
+	x223.MulModP(x3);
+	//(p + 1) / 4 = (2^223 - 1) * 2^31 + (2^22 - 1) * 2^8 + (2^2 - 1) * 2^2
+	t = x223;
+	SqrModP_N(t, 23);
+	t.MulModP(x22);
+	SqrModP_N(t, 6);
+	t.MulModP(x2);
+	SqrModP_N(t, 2);
+	*this = t;
 }
 
 std::mt19937_64 rng;
@@ -746,3 +1265,153 @@ void EcInt::RndMax(EcInt& max)
 
 
 
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define EC_BENCH_CNT		1024
+#define EC_BENCH_TIME_MS	300
+
+struct TEcBenchData
+{
+	EcInt k[EC_BENCH_CNT];
+	EcInt x[EC_BENCH_CNT];
+	EcPoint p[EC_BENCH_CNT];
+	u64 sink;
+};
+
+typedef void (*TEcBenchFunc)(TEcBenchData* bd, int i);
+
+static void eb_inv(TEcBenchData* bd, int i) { EcInt t = bd->x[i]; t.InvModP(); bd->sink ^= t.data[0]; }
+static void eb_inv30(TEcBenchData* bd, int i) { EcInt t = bd->x[i]; ::InvModP((u32*)t.data); bd->sink ^= t.data[0]; }
+static void eb_mul(TEcBenchData* bd, int i) { EcInt t = bd->x[i]; t.MulModP(bd->x[i ^ 1]); bd->sink ^= t.data[0]; }
+static void eb_sqrt(TEcBenchData* bd, int i) { EcInt t = bd->x[i]; t.SqrtModP(); bd->sink ^= t.data[0]; }
+static void eb_add(TEcBenchData* bd, int i) { EcPoint t = Ec::AddPoints(bd->p[i], bd->p[i ^ 1]); bd->sink ^= t.x.data[0]; }
+static void eb_dbl(TEcBenchData* bd, int i) { EcPoint t = Ec::DoublePoint(bd->p[i]); bd->sink ^= t.x.data[0]; }
+static void eb_mulg(TEcBenchData* bd, int i) { EcPoint t = Ec::MultiplyG(bd->k[i]); bd->sink ^= t.x.data[0]; }
+static void eb_mulp(TEcBenchData* bd, int i) { EcPoint t = Ec::MultiplyPoint(bd->p[i], bd->k[i ^ 1]); bd->sink ^= t.x.data[0]; }
+
+//reference product mod P: schoolbook 512 bits and folding of high part by 2^256 = 0x1000003D1, independent from GPU code
+static void RefMulModP(EcInt& res, EcInt& a, EcInt& b)
+{
+	u64 w[8];
+	memset(w, 0, sizeof(w));
+	for (int i = 0; i < 4; i++)
+	{
+		u64 c = 0;
+		for (int j = 0; j < 4; j++)
+		{
+			u64 hi, lo = _umul128(a.data[i], b.data[j], &hi);
+			hi += _addcarry_u64(0, lo, c, &lo);
+			hi += _addcarry_u64(0, w[i + j], lo, &w[i + j]);
+			c = hi;
+		}
+		w[i + 4] = c;
+	}
+	u64 h[4] = { w[4], w[5], w[6], w[7] };
+	while (h[0] | h[1] | h[2] | h[3])
+	{
+		u64 t[4], c = 0;
+		for (int i = 0; i < 4; i++)
+		{
+			u64 hi, lo = _umul128(h[i], 0x1000003D1ull, &hi);
+			hi += _addcarry_u64(0, lo, c, &lo);
+			t[i] = lo;
+			c = hi;
+		}
+		u8 cf = 0;
+		for (int i = 0; i < 4; i++)
+			cf = _addcarry_u64(cf, w[i], t[i], &w[i]);
+		h[0] = c + cf;
+		h[1] = h[2] = h[3] = 0;
+	}
+	memcpy(res.data, w, 32);
+	res.data[4] = 0;
+	if (!res.IsLessThanU(g_P))
+		res.Sub(g_P);
+}
+
+//checks MulModP, SqrModP and SqrtModP against reference on 2^i and P-2^i operands, where final carries of reduction happen
+//returns number of wrong results
+static int EcSelfCheck(int* total)
+{
+	EcInt* v = new EcInt[512];
+	for (int i = 0; i < 256; i++)
+	{
+		v[2 * i].SetZero();
+		v[2 * i].data[i / 64] = 1ull << (i % 64);
+		v[2 * i + 1] = g_P;
+		v[2 * i + 1].Sub(v[2 * i]);
+	}
+	int bad = 0;
+	*total = 0;
+	for (int i = 0; i < 512; i++)
+	{
+		EcInt ref, t;
+		for (int j = 0; j < 512; j++)
+		{
+			RefMulModP(ref, v[i], v[j]);
+			t = v[i];
+			t.MulModP(v[j]);
+			bad += !t.IsEqual(ref);
+		}
+		RefMulModP(ref, v[i], v[i]);
+		t = v[i];
+		t.SqrModP();
+		bad += !t.IsEqual(ref);
+		//P = 3 mod 4, so square of result is v or -v
+		t = v[i];
+		t.SqrtModP();
+		RefMulModP(ref, t, t);
+		t = v[i];
+		t.NegModP();
+		bad += !ref.IsEqual(v[i]) && !ref.IsEqual(t);
+		*total += 512 + 2;
+	}
+	delete[] v;
+	return bad;
+}
+
+//returns ns per call
+static double EcBenchRun(TEcBenchData* bd, TEcBenchFunc func)
+{
+	u64 cnt = 0;
+	u64 t0 = GetTickCount64();
+	u64 t;
+	do
+	{
+		for (int i = 0; i < EC_BENCH_CNT; i++)
+			func(bd, i);
+		cnt += EC_BENCH_CNT;
+		t = GetTickCount64() - t0;
+	} while (t < EC_BENCH_TIME_MS);
+	return (double)t * 1000000.0 / cnt;
+}
+
+//single-thread timings of host EC primitives, results are checked first
+void RunEcBench()
+{
+	int total;
+	int bad = EcSelfCheck(&total);
+	printf("Self-check: %d of %d results wrong%s\r\n", bad, total, bad ? ", HOST ARITHMETIC IS BROKEN" : "");
+	TEcBenchData* bd = new TEcBenchData();
+	for (int i = 0; i < EC_BENCH_CNT; i++)
+	{
+		bd->k[i].RndMax(g_N);
+		bd->x[i].RndMax(g_P);
+	}
+	Ec::MultiplyGBatch(bd->k, bd->p, EC_BENCH_CNT);
+	for (int i = 0; i < EC_BENCH_CNT; i++)
+		bd->k[i].RndMax(g_N);
+	bd->sink = 0;
+	double inv = EcBenchRun(bd, eb_inv);
+	double inv30 = EcBenchRun(bd, eb_inv30);
+	printf("InvModP:               %10.1f ns\r\n", inv);
+	printf("InvModP, GPU divsteps: %10.1f ns (x%.2f)\r\n", inv30, inv30 / inv);
+	printf("MulModP:               %10.1f ns\r\n", EcBenchRun(bd, eb_mul));
+	printf("SqrtModP:              %10.1f ns\r\n", EcBenchRun(bd, eb_sqrt));
+	printf("AddPoints:             %10.1f ns\r\n", EcBenchRun(bd, eb_add));
+	printf("DoublePoint:           %10.1f ns\r\n", EcBenchRun(bd, eb_dbl));
+	printf("MultiplyG:             %10.1f ns\r\n", EcBenchRun(bd, eb_mulg));
+	printf("MultiplyPoint:         %10.1f ns\r\n", EcBenchRun(bd, eb_mulp));
+	delete bd;
+}
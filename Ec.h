@@ -40,6 +40,7 @@ public:
 	void NegModP();
 	void NegModN();
 	void MulModP(EcInt& val);
+	void SqrModP();
 	void InvModP();
 	void SqrtModP();
 
@@ -60,12 +61,32 @@ public:
 	EcInt y;
 };
 
+//Jacobian coordinates: affine x = x / z^2, y = y / z^3, z = 0 is infinity
+class EcJPoint
+{
+public:
+	void SetAffine(EcPoint& pnt);
+	bool IsInfinity() { return z.IsZero(); };
+	EcInt x;
+	EcInt y;
+	EcInt z;
+};
+
 class Ec
 {
 public:
 	static EcPoint AddPoints(EcPoint& pnt1, EcPoint& pnt2);
 	static EcPoint DoublePoint(EcPoint& pnt);
+	static EcJPoint DoublePointJ(EcJPoint& pnt);
+	static EcJPoint AddPointsJA(EcJPoint& pnt1, EcPoint& pnt2);
+	static EcPoint ToAffine(EcJPoint& pnt);
+	static void ToAffineBatch(EcJPoint* pnts, EcPoint* res, int cnt);
+	static void SplitScalar(EcInt& k, EcInt& k1, bool& neg1, EcInt& k2, bool& neg2);
+	static EcJPoint MultiplyGJ(EcInt& k);
+	static EcJPoint MultiplyPointJ(EcPoint& pnt, EcInt& k);
+	static EcPoint MultiplyPoint(EcPoint& pnt, EcInt& k);
 	static EcPoint MultiplyG(EcInt& k);
+	static void MultiplyGBatch(EcInt* k, EcPoint* res, int cnt);
 #ifdef DEBUG_MODE
 	static EcPoint MultiplyG_Fast(EcInt& k);
 #endif
@@ -75,4 +96,6 @@ public:
 
 void InitEc();
 void DeInitEc();
+int ParsePubKeys(char** strs, int cnt, EcPoint* res, int thr_cnt);
+void RunEcBench();
 void SetRndSeed(u64 seed);
\ No newline at end of file
@@ -0,0 +1,424 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#include <math.h>
+#include <stddef.h>
+#include "GpuEmu.h"
+#include "CpuKang.h"
+#include "Jumps.h"
+#include "utils.h"
+#include "RCGpuUtils.h"
+
+//CUDA names used by kernels, every GPU thread is a CPU thread with its own threadIdx/blockIdx
+#define GPU_EMU
+#define __global__
+#define __device__
+#define __constant__
+#define __forceinline__			inline
+#define __launch_bounds__(...)
+#define __align__(n)			alignas(n)
+#define LDS						EmuLds
+
+struct alignas(16) int4
+{
+	int x, y, z, w;
+};
+
+struct TEmuDim
+{
+	u32 x;
+};
+
+//threads of one block, LDS is shared by them
+struct TEmuBlock
+{
+	volatile u32 SyncCnt; //number of __syncthreads calls made by all threads
+	u32 ThrCnt;
+	u64* Lds;
+};
+
+static thread_local TEmuDim threadIdx;
+static thread_local TEmuDim blockIdx;
+static thread_local TEmuDim gridDim;
+static thread_local TEmuBlock* EmuBlock;
+static thread_local u64* EmuLds;
+static thread_local u32 EmuSyncInd;
+
+#ifdef _WIN32
+static inline u32 atomicAdd(u32* ptr, u32 val) { return (u32)InterlockedExchangeAdd((volatile LONG*)ptr, (LONG)val); }
+static inline u32 atomicAnd(u32* ptr, u32 val) { return (u32)InterlockedAnd((volatile LONG*)ptr, (LONG)val); }
+static inline u64 atomicAnd(u64* ptr, u64 val) { return (u64)InterlockedAnd64((volatile LONG64*)ptr, (LONG64)val); }
+static inline int __clzll(u64 x) { unsigned long ind; return _BitScanReverse64(&ind, x) ? 63 - (int)ind : 64; }
+#else
+static inline u32 atomicAdd(u32* ptr, u32 val) { return __sync_fetch_and_add(ptr, val); }
+static inline u32 atomicAnd(u32* ptr, u32 val) { return __sync_fetch_and_and(ptr, val); }
+static inline u64 atomicAnd(u64* ptr, u64 val) { return __sync_fetch_and_and(ptr, val); }
+static inline int __clzll(u64 x) { return x ? __builtin_clzll(x) : 64; }
+#endif
+
+#ifndef min //Windows.h has it
+static inline u32 min(u32 a, u32 b) { return (a < b) ? a : b; }
+#endif
+
+//kernels call it once after loading tables to LDS, so simple spinning is ok
+static void __syncthreads()
+{
+	EmuSyncInd++;
+	atomicAdd((u32*)&EmuBlock->SyncCnt, 1);
+	while (EmuBlock->SyncCnt < EmuSyncInd * EmuBlock->ThrCnt)
+		Sleep(1);
+}
+
+namespace EmuNew
+{
+#include "RCGpuCore.cu"
+}
+
+namespace EmuOld
+{
+#define OLD_GPU
+#include "RCGpuCore.cu"
+#undef OLD_GPU
+}
+
+typedef void (*TEmuKernelFunc)(const TKparams Kparams);
+
+//[0] - new GPU kernels, [1] - old GPU kernels
+struct TEmuKernelSet
+{
+	u32 BlockSize;
+	u32 GroupCnt;
+	u32 JmpCnt;
+	u32 MdLen;
+	u32 StepCnt;
+	TEmuKernelFunc KernelA[2];
+	TEmuKernelFunc KernelB[2];
+	TEmuKernelFunc KernelC[2];
+	TEmuKernelFunc KernelGen[2];
+};
+
+#define EMU_KERNEL_SET(bs, gc, jc, md, sc) { bs, gc, jc, md, sc, \
+	{ EmuNew::KernelA<bs, gc, jc, md, sc>, EmuOld::KernelA<bs, gc, jc, md, sc> }, \
+	{ EmuNew::KernelB<bs, gc, jc, md, sc>, EmuOld::KernelB<bs, gc, jc, md, sc> }, \
+	{ EmuNew::KernelC<bs, gc, jc>, EmuOld::KernelC<bs, gc, jc> }, \
+	{ EmuNew::KernelGen<bs, gc>, EmuOld::KernelGen<bs, gc> } },
+
+static TEmuKernelSet EmuKernelSets[] = { WALK_CFG_LIST(EMU_KERNEL_SET) };
+
+static TEmuKernelSet* FindEmuKernelSet(const TKparams& Kparams)
+{
+	for (int i = 0; i < (int)(sizeof(EmuKernelSets) / sizeof(EmuKernelSets[0])); i++)
+	{
+		TEmuKernelSet* ks = &EmuKernelSets[i];
+		if ((ks->BlockSize == Kparams.BlockSize) && (ks->GroupCnt == Kparams.GroupCnt) && (ks->JmpCnt == Kparams.JmpCnt) && (ks->MdLen == Kparams.MdLen) && (ks->StepCnt == Kparams.StepCnt))
+			return ks;
+	}
+	return NULL;
+}
+
+struct TEmuThread
+{
+	TEmuKernelFunc func;
+	const TKparams* Kparams;
+	TEmuBlock* block;
+	u32 thr_ind;
+	u32 block_ind;
+};
+
+#ifdef _WIN32
+u32 __stdcall emu_thr_proc(void* data)
+#else
+void* emu_thr_proc(void* data)
+#endif
+{
+	TEmuThread* thr = (TEmuThread*)data;
+	threadIdx.x = thr->thr_ind;
+	blockIdx.x = thr->block_ind;
+	gridDim.x = thr->Kparams->BlockCnt;
+	EmuBlock = thr->block;
+	EmuLds = thr->block->Lds;
+	EmuSyncInd = 0;
+	thr->func(*thr->Kparams);
+	return 0;
+}
+
+//same as <<<BlockCnt, BlockSize, lds_size>>>, returns when all threads are finished
+static void EmuLaunch(TEmuKernelFunc func, const TKparams& Kparams, u32 lds_size)
+{
+	int thr_cnt = Kparams.BlockCnt * Kparams.BlockSize;
+	TEmuBlock* blocks = new TEmuBlock[Kparams.BlockCnt];
+	for (u32 i = 0; i < Kparams.BlockCnt; i++)
+	{
+		blocks[i].SyncCnt = 0;
+		blocks[i].ThrCnt = Kparams.BlockSize;
+		blocks[i].Lds = (u64*)malloc(lds_size ? lds_size : 16);
+	}
+	TEmuThread* thrs = new TEmuThread[thr_cnt];
+	for (int i = 0; i < thr_cnt; i++)
+	{
+		thrs[i].func = func;
+		thrs[i].Kparams = &Kparams;
+		thrs[i].block = &blocks[i / Kparams.BlockSize];
+		thrs[i].thr_ind = i % Kparams.BlockSize;
+		thrs[i].block_ind = i / Kparams.BlockSize;
+	}
+#ifdef _WIN32
+	HANDLE* handles = (HANDLE*)malloc(thr_cnt * sizeof(HANDLE));
+	u32 ThreadID;
+	for (int i = 0; i < thr_cnt; i++)
+		handles[i] = (HANDLE)_beginthreadex(NULL, 0, emu_thr_proc, (void*)&thrs[i], 0, &ThreadID);
+	//WaitForMultipleObjects is limited by 64 handles
+	for (int i = 0; i < thr_cnt; i++)
+	{
+		WaitForSingleObject(handles[i], INFINITE);
+		CloseHandle(handles[i]);
+	}
+#else
+	pthread_t* handles = (pthread_t*)malloc(thr_cnt * sizeof(pthread_t));
+	for (int i = 0; i < thr_cnt; i++)
+		pthread_create(&handles[i], NULL, emu_thr_proc, (void*)&thrs[i]);
+	for (int i = 0; i < thr_cnt; i++)
+		pthread_join(handles[i], NULL);
+#endif
+	free(handles);
+	delete[] thrs;
+	for (u32 i = 0; i < Kparams.BlockCnt; i++)
+		free(blocks[i].Lds);
+	delete[] blocks;
+}
+
+bool EmuSetGpuParams(TKparams Kparams, u64* _jmp2_table)
+{
+	if (!FindEmuKernelSet(Kparams))
+		return false;
+	memcpy(EmuNew::jmp2_table, _jmp2_table, Kparams.JmpCnt * 64);
+	memcpy(EmuOld::jmp2_table, _jmp2_table, Kparams.JmpCnt * 64);
+	return true;
+}
+
+void EmuKernelGen(TKparams Kparams, bool old_gpu)
+{
+	TEmuKernelSet* ks = FindEmuKernelSet(Kparams);
+	EmuLaunch(ks->KernelGen[old_gpu], Kparams, 0);
+}
+
+void EmuKernelABC(TKparams Kparams, bool old_gpu)
+{
+	TEmuKernelSet* ks = FindEmuKernelSet(Kparams);
+	EmuLaunch(ks->KernelA[old_gpu], Kparams, Kparams.KernelA_LDS_Size);
+	EmuLaunch(ks->KernelB[old_gpu], Kparams, Kparams.KernelB_LDS_Size);
+	EmuLaunch(ks->KernelC[old_gpu], Kparams, Kparams.KernelC_LDS_Size);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//DPs come from KernelB threads in any order
+static int CmpDP(const void* a, const void* b)
+{
+	u64 ka = ((u64)((TDPRec*)a)->kang << 32) | ((TDPRec*)a)->step;
+	u64 kb = ((u64)((TDPRec*)b)->kang << 32) | ((TDPRec*)b)->step;
+	return (ka < kb) ? -1 : ((ka > kb) ? 1 : 0);
+}
+
+//buffers have same sizes as in RCGpuKang::Prepare, single block
+static bool AllocEmuBuffers(TKparams& Kparams, bool old_gpu)
+{
+	u32 KangCnt = Kparams.KangCnt;
+	if (!old_gpu)
+		Kparams.L2 = (u64*)calloc(1, (size_t)KangCnt * (3 * 32));
+	Kparams.DPs_out = (u32*)calloc(1, MAX_DP_CNT * sizeof(TDPRec) + 16);
+	Kparams.Kangs = (u64*)calloc(1, (size_t)KangCnt * 96);
+	Kparams.Jumps1 = (u64*)calloc(1, Kparams.JmpCnt * 96);
+	Kparams.Jumps2 = (u64*)calloc(1, Kparams.JmpCnt * 96);
+	Kparams.Jumps3 = (u64*)calloc(1, Kparams.JmpCnt * 96);
+	Kparams.JumpsList = (u64*)calloc(1, 2 * (size_t)KangCnt * Kparams.StepCnt);
+	Kparams.DPTable = (u32*)calloc(1, (size_t)KangCnt * (16 * DPTABLE_MAX_CNT + sizeof(u32)));
+	Kparams.L1S2 = (u32*)calloc(1, Kparams.BlockCnt * Kparams.BlockSize * sizeof(u64));
+	Kparams.LastPnts = (u64*)calloc(1, (size_t)KangCnt * Kparams.MdLen * (2 * 32));
+	Kparams.LoopTable = (u64*)calloc(1, (size_t)KangCnt * Kparams.MdLen * sizeof(u64));
+	Kparams.dbg_buf = (u32*)calloc(1, 1024);
+	Kparams.LoopedKangs = (u32*)calloc(1, sizeof(u32) * KangCnt + 8);
+	return (old_gpu || Kparams.L2) && Kparams.DPs_out && Kparams.Kangs && Kparams.Jumps1 && Kparams.Jumps2 && Kparams.Jumps3 && Kparams.JumpsList &&
+		Kparams.DPTable && Kparams.L1S2 && Kparams.LastPnts && Kparams.LoopTable && Kparams.dbg_buf && Kparams.LoopedKangs;
+}
+
+static void FreeEmuBuffers(TKparams& Kparams)
+{
+	free(Kparams.LoopedKangs);
+	free(Kparams.dbg_buf);
+	free(Kparams.LoopTable);
+	free(Kparams.LastPnts);
+	free(Kparams.L1S2);
+	free(Kparams.DPTable);
+	free(Kparams.JumpsList);
+	free(Kparams.Jumps3);
+	free(Kparams.Jumps2);
+	free(Kparams.Jumps1);
+	free(Kparams.Kangs);
+	free(Kparams.DPs_out);
+	free(Kparams.L2);
+}
+
+//x, y, d(32 bytes) for every jump
+static void SetEmuJumps(u64* buf, EcJMP* jumps, int cnt)
+{
+	for (int i = 0; i < cnt; i++)
+	{
+		memcpy(buf + i * 12, jumps[i].p.x.data, 32);
+		memcpy(buf + i * 12 + 4, jumps[i].p.y.data, 32);
+		memcpy(buf + i * 12 + 8, jumps[i].dist.data, 32);
+	}
+}
+
+//returns number of kangs that differ
+static int CmpEmuKangs(u64* kangs, u64* ref, int cnt)
+{
+	int res = 0;
+	for (int i = 0; i < cnt; i++)
+		if (memcmp(kangs + 12 * i, ref + 12 * i, 96))
+		{
+			if (!res)
+				printf("Emulation check: first different kang %d\r\n", i);
+			res++;
+		}
+	return res;
+}
+
+//only JmpCnt, MdLen and StepCnt matter for CPU walk, but all kernels parameters are checked because they define memory layouts
+bool RunEmuCheck(TWalkCfg* cfg, bool old_gpu, int Range, int call_cnt)
+{
+	TKparams Kparams;
+	memset(&Kparams, 0, sizeof(Kparams));
+	Kparams.BlockCnt = 1;
+	Kparams.BlockSize = cfg->BlockSize;
+	Kparams.GroupCnt = cfg->GroupCnt;
+	Kparams.JmpCnt = cfg->JmpCnt;
+	Kparams.MdLen = cfg->MdLen;
+	Kparams.StepCnt = cfg->StepCnt;
+	Kparams.KangCnt = Kparams.BlockSize * Kparams.GroupCnt * Kparams.BlockCnt;
+	//about 1 DP per 4 kangs per call
+	Kparams.DPBits = (int)log2((double)cfg->StepCnt) + 2;
+	Kparams.DPThr = 1ull << (64 - Kparams.DPBits);
+	Kparams.KernelA_LDS_Size = 64 * cfg->JmpCnt + 16 * Kparams.BlockSize;
+	Kparams.KernelB_LDS_Size = 64 * cfg->JmpCnt;
+	Kparams.KernelC_LDS_Size = 96 * cfg->JmpCnt;
+	Kparams.IsGenMode = false;
+	if (!FindEmuKernelSet(Kparams) || (!old_gpu && (cfg->GroupCnt > 32)))
+	{
+		printf("Emulation check: config %d:%d:%d:%d:%d is not supported for %s kernels\r\n", cfg->BlockSize, cfg->GroupCnt, cfg->JmpCnt, cfg->MdLen, cfg->StepCnt, old_gpu ? "old GPU" : "new GPU");
+		return false;
+	}
+	int KangCnt = Kparams.KangCnt;
+	printf("Emulation check: %s kernels, config %d:%d:%d:%d:%d, range %d, %d kangs, DP %d, %d kernel calls\r\n", old_gpu ? "old GPU" : "new GPU",
+		cfg->BlockSize, cfg->GroupCnt, cfg->JmpCnt, cfg->MdLen, cfg->StepCnt, Range, KangCnt, Kparams.DPBits, call_cnt);
+
+	TJmpStrategy st;
+	SetDefaultJmpStrategy(&st);
+	EcJMP* jumps = new EcJMP[3 * cfg->JmpCnt];
+	EcJMP* jumps1 = jumps;
+	EcJMP* jumps2 = jumps + cfg->JmpCnt;
+	EcJMP* jumps3 = jumps + 2 * cfg->JmpCnt;
+	GenerateJumps(&st, Range, cfg->JmpCnt, jumps1, jumps2, jumps3);
+
+	Ec ec;
+	EcInt key;
+	key.RndBits(Range);
+	EcPoint pnt = ec.MultiplyG(key);
+	double herd_parts[3] = { 1.0 / 3, 1.0 / 3, 1.0 / 3 };
+	RCCpuKang* ref = new RCCpuKang();
+	u64* ref_kangs = (u64*)malloc((size_t)KangCnt * 96);
+	TDPRec* ref_dps = (TDPRec*)malloc((size_t)MAX_DP_CNT * sizeof(TDPRec));
+	bool ok = AllocEmuBuffers(Kparams, old_gpu) && ref_kangs && ref_dps &&
+		ref->Prepare(pnt, Range, Kparams.DPBits, Kparams.DPThr, jumps1, jumps2, jumps3, KangCnt, herd_parts, cfg);
+	if (!ok)
+		printf("Emulation check: init failed\r\n");
+	if (ok)
+	{
+		SetEmuJumps(Kparams.Jumps1, jumps1, cfg->JmpCnt);
+		SetEmuJumps(Kparams.Jumps2, jumps2, cfg->JmpCnt);
+		SetEmuJumps(Kparams.Jumps3, jumps3, cfg->JmpCnt);
+		u64* jmp2_table = (u64*)malloc(cfg->JmpCnt * 64);
+		for (u32 i = 0; i < cfg->JmpCnt; i++)
+		{
+			memcpy(jmp2_table + i * 8, jumps2[i].p.x.data, 32);
+			memcpy(jmp2_table + i * 8 + 4, jumps2[i].p.y.data, 32);
+		}
+		EmuSetGpuParams(Kparams, jmp2_table);
+		free(jmp2_table);
+
+		//start points by KernelGen from same distances as CPU walk, wilds get PntA or PntB as in RCGpuKang::Start
+		ref->SaveKangs(ref_kangs);
+		EcInt HalfRange;
+		HalfRange.Set(1);
+		HalfRange.ShiftLeft(Range - 1);
+		EcPoint PntA = ec.MultiplyG(HalfRange);
+		PntA.y.NegModP();
+		PntA = ec.AddPoints(pnt, PntA);
+		EcPoint PntB = PntA;
+		PntB.y.NegModP();
+		memcpy(Kparams.Kangs, ref_kangs, (size_t)KangCnt * 96);
+		for (int i = 0; i < KangCnt; i++)
+		{
+			u64* kang = Kparams.Kangs + 12 * i;
+			if (kang[11] == TAME)
+				memset(kang, 0, 64);
+			else
+				((kang[11] == WILD1) ? PntA : PntB).SaveToBuffer64((u8*)kang);
+		}
+		u64 tm = GetTickCount64();
+		EmuKernelGen(Kparams, old_gpu);
+		int bad = CmpEmuKangs(Kparams.Kangs, ref_kangs, KangCnt);
+		printf("KernelGen: %d wrong start points, time %llums\r\n", bad, GetTickCount64() - tm);
+		ok = !bad;
+	}
+
+	u64 loops = 0;
+	for (int call = 0; ok && (call < call_cnt); call++)
+	{
+		memset(Kparams.DPs_out, 0, 4);
+		memset(Kparams.DPTable, 0, KangCnt * sizeof(u32));
+		memset(Kparams.LoopedKangs, 0, 8);
+		u64 tm = GetTickCount64();
+		EmuKernelABC(Kparams, old_gpu);
+		u64 tm_emu = GetTickCount64() - tm;
+		tm = GetTickCount64();
+		int ref_cnt = ref->Step(cfg->StepCnt, ref_dps, MAX_DP_CNT);
+		u64 tm_ref = GetTickCount64() - tm;
+
+		ref->SaveKangs(ref_kangs);
+		int bad = CmpEmuKangs(Kparams.Kangs, ref_kangs, KangCnt);
+		int cnt = (int)Kparams.DPs_out[0];
+		TDPRec* dps = (TDPRec*)(Kparams.DPs_out + 4);
+		int bad_dps = 0;
+		if (cnt != ref_cnt)
+			bad_dps = abs(cnt - ref_cnt);
+		else
+		{
+			qsort(dps, cnt, sizeof(TDPRec), CmpDP);
+			qsort(ref_dps, ref_cnt, sizeof(TDPRec), CmpDP);
+			//x, DP level, distance, type, jump index, kang index; seed and jumps are set on host side
+			for (int i = 0; i < cnt; i++)
+				if (memcmp(dps + i, ref_dps + i, offsetof(TDPRec, seed)))
+					bad_dps++;
+		}
+		u64 ref_loops = 0;
+		for (int i = 3; i <= MAX_MD_LEN; i++)
+			ref_loops += ref->LoopStats[i];
+		u32 looped = Kparams.LoopedKangs[0];
+		printf("Call %d: %d wrong kangs, DPs %d/%d (%d wrong), looped kangs %d/%llu, time %llums (CPU walk %llums)\r\n", call, bad, cnt, ref_cnt, bad_dps,
+			looped, ref_loops - loops, tm_emu, tm_ref);
+		ok = !bad && !bad_dps && (looped == ref_loops - loops);
+		loops = ref_loops;
+	}
+	printf("Emulation check: %s\r\n", ok ? "passed" : "FAILED");
+
+	free(ref_dps);
+	free(ref_kangs);
+	delete ref;
+	FreeEmuBuffers(Kparams);
+	delete[] jumps;
+	return ok;
+}
@@ -0,0 +1,18 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#pragma once
+
+#include "defs.h"
+
+//CPU emulation of kernels: RCGpuCore.cu is compiled by host compiler and kernels work on the same buffers as on GPU
+//every GPU thread is a CPU thread, so it's very slow, it's used to check kernels and memory layouts without GPU
+bool EmuSetGpuParams(TKparams Kparams, u64* _jmp2_table);
+void EmuKernelGen(TKparams Kparams, bool old_gpu);
+void EmuKernelABC(TKparams Kparams, bool old_gpu);
+
+//runs emulated kernels and CPU walk (RCCpuKang) from the same start points and compares all kangs and DPs after every kernel call
+bool RunEmuCheck(TWalkCfg* cfg, bool old_gpu, int Range, int call_cnt);
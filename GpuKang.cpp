@@ -9,27 +9,81 @@
 #include "cuda.h"
 
 #include "GpuKang.h"
+#include "Solver.h"
+#include "ThreadPool.h"
 
 cudaError_t cuSetGpuParams(TKparams Kparams, u64* _jmp2_table);
 void CallGpuKernelGen(TKparams Kparams);
 void CallGpuKernelABC(TKparams Kparams);
-void AddPointsToList(u32* data, int cnt, u64 ops_cnt);
-extern bool gGenMode; //tames generation mode
+
+void SetDefaultWalkCfg(TWalkCfg* cfg, bool old_gpu)
+{
+	cfg->BlockSize = old_gpu ? 512 : 256;
+	cfg->GroupCnt = old_gpu ? 64 : 24;
+	cfg->JmpCnt = DEF_JMP_CNT;
+	cfg->MdLen = DEF_MD_LEN;
+	cfg->StepCnt = DEF_STEP_CNT;
+}
+
+#define WALK_CFG_CHECK(bs, gc, jc, md, sc) if ((cfg->BlockSize == bs) && (cfg->GroupCnt == gc) && (cfg->JmpCnt == jc) && (cfg->MdLen == md) && (cfg->StepCnt == sc)) return true;
+
+//checks if kernels are prebuilt for this configuration
+bool IsWalkCfgSupported(TWalkCfg* cfg)
+{
+	WALK_CFG_LIST(WALK_CFG_CHECK)
+	return false;
+}
+
+#define WALK_CFG_PRINT(bs, gc, jc, md, sc) printf("  %d:%d:%d:%d:%d\r\n", bs, gc, jc, md, sc);
+
+void PrintWalkCfgs()
+{
+	printf("Supported configurations (BlockSize:GroupCnt:JmpCnt:MdLen:StepCnt):\r\n");
+	WALK_CFG_LIST(WALK_CFG_PRINT)
+}
+
+static u64 SplitMix64(u64& state)
+{
+	u64 z = (state += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+//start distance of kang, same distribution as random distances, so kang walk can be replayed from seed id only
+void GetSeedDistance(EcInt& d, u64 run_seed, u32 seed, int Range)
+{
+	u64 state = run_seed ^ ((u64)seed << 32) ^ seed;
+	int nbits = ((seed >> SEED_TYPE_SHIFT) == TAME) ? Range - 4 : Range - 1;
+	d.SetZero();
+	for (int i = 0; i < (nbits + 63) / 64; i++)
+		d.data[i] = SplitMix64(state);
+	d.data[nbits / 64] &= (1ull << (nbits % 64)) - 1;
+	if ((seed >> SEED_TYPE_SHIFT) != TAME)
+		d.data[0] &= 0xFFFFFFFFFFFFFFFE; //must be even
+}
+
+//new KernelA keeps L1S2 flags of all kangs of thread in u32
+bool RCGpuKang::SetWalkCfg(TWalkCfg* cfg)
+{
+	if (!IsWalkCfgSupported(cfg) || (!IsOldGpu && (cfg->GroupCnt > 32)))
+		return false;
+	Cfg = *cfg;
+	return true;
+}
 
 int RCGpuKang::CalcKangCnt()
 {
-	Kparams.BlockCnt = mpCnt;
-	Kparams.BlockSize = IsOldGpu ? 512 : 256;
-	Kparams.GroupCnt = IsOldGpu ? 64 : 24;
-	return Kparams.BlockSize* Kparams.GroupCnt* Kparams.BlockCnt;
+	return Cfg.BlockSize * Cfg.GroupCnt * mpCnt;
 }
 
 //executes in main thread
-bool RCGpuKang::Prepare(EcPoint _PntToSolve, int _Range, int _DP, EcJMP* _EcJumps1, EcJMP* _EcJumps2, EcJMP* _EcJumps3)
+bool RCGpuKang::Prepare(EcPoint _PntToSolve, int _Range, int _DPBits, u64 _DPThr, EcJMP* _EcJumps1, EcJMP* _EcJumps2, EcJMP* _EcJumps3)
 {
 	PntToSolve = _PntToSolve;
 	Range = _Range;
-	DP = _DP;
+	DPBits = _DPBits;
+	DPThr = _DPThr;
 	EcJumps1 = _EcJumps1;
 	EcJumps2 = _EcJumps2;
 	EcJumps3 = _EcJumps3;
@@ -39,6 +93,27 @@ bool RCGpuKang::Prepare(EcPoint _PntToSolve, int _Range, int _DP, EcJMP* _EcJump
 	memset(dbg, 0, sizeof(dbg));
 	memset(SpeedStats, 0, sizeof(SpeedStats));
 	cur_stats_ind = 0;
+	//Release is safe after failed Prepare
+	memset(&Kparams, 0, sizeof(Kparams));
+	DPs_out = NULL;
+	RndPnts = NULL;
+	AuditX = NULL;
+	AuditCurX = NULL;
+	AuditLooped = NULL;
+	KangSeeds = NULL;
+	KangStartCall = NULL;
+	KangLastDPCall = NULL;
+	CallIndex = 0;
+	AuditCall = -1;
+	AuditTime = GetTickCount64();
+	ReseededKangs = 0;
+	IntegrityTime = GetTickCount64();
+	CorruptedKangs = 0;
+	MergedKangs = 0;
+	MaxKangJumps = 0;
+	csMerged.Enter();
+	MergedReqs.clear();
+	csMerged.Leave();
 
 	cudaError_t err;
 	err = cudaSetDevice(CudaIndex);
@@ -46,15 +121,19 @@ bool RCGpuKang::Prepare(EcPoint _PntToSolve, int _Range, int _DP, EcJMP* _EcJump
 		return false;
 
 	Kparams.BlockCnt = mpCnt;
-	Kparams.BlockSize = IsOldGpu ? 512 : 256;
-	Kparams.GroupCnt = IsOldGpu ? 64 : 24;
+	Kparams.BlockSize = Cfg.BlockSize;
+	Kparams.GroupCnt = Cfg.GroupCnt;
+	Kparams.JmpCnt = Cfg.JmpCnt;
+	Kparams.MdLen = Cfg.MdLen;
+	Kparams.StepCnt = Cfg.StepCnt;
 	KangCnt = Kparams.BlockSize * Kparams.GroupCnt * Kparams.BlockCnt;
 	Kparams.KangCnt = KangCnt;
-	Kparams.DP = DP;
-	Kparams.KernelA_LDS_Size = 64 * JMP_CNT + 16 * Kparams.BlockSize;
-	Kparams.KernelB_LDS_Size = 64 * JMP_CNT;
-	Kparams.KernelC_LDS_Size = 96 * JMP_CNT;
-	Kparams.IsGenMode = gGenMode;
+	Kparams.DPBits = DPBits;
+	Kparams.DPThr = DPThr;
+	Kparams.KernelA_LDS_Size = 64 * Cfg.JmpCnt + 16 * Kparams.BlockSize;
+	Kparams.KernelB_LDS_Size = 64 * Cfg.JmpCnt;
+	Kparams.KernelC_LDS_Size = 96 * Cfg.JmpCnt;
+	Kparams.IsGenMode = Solver->GenMode;
 
 //allocate gpu mem
 	u64 size;
@@ -87,7 +166,7 @@ bool RCGpuKang::Prepare(EcPoint _PntToSolve, int _Range, int _DP, EcJMP* _EcJump
 			return false;
 		}
 	}
-	size = MAX_DP_CNT * GPU_DP_SIZE + 16;
+	size = MAX_DP_CNT * sizeof(TDPRec) + 16;
 	total_mem += size;
 	err = cudaMalloc((void**)&Kparams.DPs_out, size);
 	if (err != cudaSuccess)
@@ -105,31 +184,31 @@ bool RCGpuKang::Prepare(EcPoint _PntToSolve, int _Range, int _DP, EcJMP* _EcJump
 		return false;
 	}
 
-	total_mem += JMP_CNT * 96;
-	err = cudaMalloc((void**)&Kparams.Jumps1, JMP_CNT * 96);
+	total_mem += Cfg.JmpCnt * 96;
+	err = cudaMalloc((void**)&Kparams.Jumps1, Cfg.JmpCnt * 96);
 	if (err != cudaSuccess)
 	{
 		printf("GPU %d Allocate Jumps1 memory failed: %s\n", CudaIndex, cudaGetErrorString(err));
 		return false;
 	}
 
-	total_mem += JMP_CNT * 96;
-	err = cudaMalloc((void**)&Kparams.Jumps2, JMP_CNT * 96);
+	total_mem += Cfg.JmpCnt * 96;
+	err = cudaMalloc((void**)&Kparams.Jumps2, Cfg.JmpCnt * 96);
 	if (err != cudaSuccess)
 	{
 		printf("GPU %d Allocate Jumps1 memory failed: %s\n", CudaIndex, cudaGetErrorString(err));
 		return false;
 	}
 
-	total_mem += JMP_CNT * 96;
-	err = cudaMalloc((void**)&Kparams.Jumps3, JMP_CNT * 96);
+	total_mem += Cfg.JmpCnt * 96;
+	err = cudaMalloc((void**)&Kparams.Jumps3, Cfg.JmpCnt * 96);
 	if (err != cudaSuccess)
 	{
 		printf("GPU %d Allocate Jumps3 memory failed: %s\n", CudaIndex, cudaGetErrorString(err));
 		return false;
 	}
 
-	size = 2 * (u64)KangCnt * STEP_CNT;
+	size = 2 * (u64)KangCnt * Cfg.StepCnt;
 	total_mem += size;
 	err = cudaMalloc((void**)&Kparams.JumpsList, size);
 	if (err != cudaSuccess)
@@ -156,7 +235,7 @@ bool RCGpuKang::Prepare(EcPoint _PntToSolve, int _Range, int _DP, EcJMP* _EcJump
 		return false;
 	}
 
-	size = (u64)KangCnt * MD_LEN * (2 * 32);
+	size = (u64)KangCnt * Cfg.MdLen * (2 * 32);
 	total_mem += size;
 	err = cudaMalloc((void**)&Kparams.LastPnts, size);
 	if (err != cudaSuccess)
@@ -165,7 +244,7 @@ bool RCGpuKang::Prepare(EcPoint _PntToSolve, int _Range, int _DP, EcJMP* _EcJump
 		return false;
 	}
 
-	size = (u64)KangCnt * MD_LEN * sizeof(u64);
+	size = (u64)KangCnt * Cfg.MdLen * sizeof(u64);
 	total_mem += size;
 	err = cudaMalloc((void**)&Kparams.LoopTable, size);
 	if (err != cudaSuccess)
@@ -191,17 +270,23 @@ bool RCGpuKang::Prepare(EcPoint _PntToSolve, int _Range, int _DP, EcJMP* _EcJump
 		return false;
 	}
 
-	DPs_out = (u32*)malloc(MAX_DP_CNT * GPU_DP_SIZE);
+	DPs_out = (TDPRec*)malloc(MAX_DP_CNT * sizeof(TDPRec));
+	AuditX = (u64*)malloc(KangCnt * sizeof(u64));
+	AuditCurX = (u64*)malloc(KangCnt * sizeof(u64));
+	AuditLooped = (u8*)malloc(KangCnt);
+	KangSeeds = (u32*)malloc(KangCnt * sizeof(u32));
+	KangStartCall = (u32*)malloc(KangCnt * sizeof(u32));
+	KangLastDPCall = (u32*)malloc(KangCnt * sizeof(u32));
 
 //jmp1
-	u64* buf = (u64*)malloc(JMP_CNT * 96);
-	for (int i = 0; i < JMP_CNT; i++)
+	u64* buf = (u64*)malloc(Cfg.JmpCnt * 96);
+	for (u32 i = 0; i < Cfg.JmpCnt; i++)
 	{
 		memcpy(buf + i * 12, EcJumps1[i].p.x.data, 32);
 		memcpy(buf + i * 12 + 4, EcJumps1[i].p.y.data, 32);
 		memcpy(buf + i * 12 + 8, EcJumps1[i].dist.data, 32);
 	}
-	err = cudaMemcpy(Kparams.Jumps1, buf, JMP_CNT * 96, cudaMemcpyHostToDevice);
+	err = cudaMemcpy(Kparams.Jumps1, buf, Cfg.JmpCnt * 96, cudaMemcpyHostToDevice);
 	if (err != cudaSuccess)
 	{
 		printf("GPU %d, cudaMemcpy Jumps1 failed: %s\n", CudaIndex, cudaGetErrorString(err));
@@ -209,9 +294,9 @@ bool RCGpuKang::Prepare(EcPoint _PntToSolve, int _Range, int _DP, EcJMP* _EcJump
 	}
 	free(buf);
 //jmp2
-	buf = (u64*)malloc(JMP_CNT * 96);
-	u64* jmp2_table = (u64*)malloc(JMP_CNT * 64);
-	for (int i = 0; i < JMP_CNT; i++)
+	buf = (u64*)malloc(Cfg.JmpCnt * 96);
+	u64* jmp2_table = (u64*)malloc(Cfg.JmpCnt * 64);
+	for (u32 i = 0; i < Cfg.JmpCnt; i++)
 	{
 		memcpy(buf + i * 12, EcJumps2[i].p.x.data, 32);
 		memcpy(jmp2_table + i * 8, EcJumps2[i].p.x.data, 32);
@@ -219,7 +304,7 @@ bool RCGpuKang::Prepare(EcPoint _PntToSolve, int _Range, int _DP, EcJMP* _EcJump
 		memcpy(jmp2_table + i * 8 + 4, EcJumps2[i].p.y.data, 32);
 		memcpy(buf + i * 12 + 8, EcJumps2[i].dist.data, 32);
 	}
-	err = cudaMemcpy(Kparams.Jumps2, buf, JMP_CNT * 96, cudaMemcpyHostToDevice);
+	err = cudaMemcpy(Kparams.Jumps2, buf, Cfg.JmpCnt * 96, cudaMemcpyHostToDevice);
 	if (err != cudaSuccess)
 	{
 		printf("GPU %d, cudaMemcpy Jumps2 failed: %s\n", CudaIndex, cudaGetErrorString(err));
@@ -236,14 +321,14 @@ bool RCGpuKang::Prepare(EcPoint _PntToSolve, int _Range, int _DP, EcJMP* _EcJump
 	}
 	free(jmp2_table);
 //jmp3
-	buf = (u64*)malloc(JMP_CNT * 96);
-	for (int i = 0; i < JMP_CNT; i++)
+	buf = (u64*)malloc(Cfg.JmpCnt * 96);
+	for (u32 i = 0; i < Cfg.JmpCnt; i++)
 	{
 		memcpy(buf + i * 12, EcJumps3[i].p.x.data, 32);
 		memcpy(buf + i * 12 + 4, EcJumps3[i].p.y.data, 32);
 		memcpy(buf + i * 12 + 8, EcJumps3[i].dist.data, 32);
 	}
-	err = cudaMemcpy(Kparams.Jumps3, buf, JMP_CNT * 96, cudaMemcpyHostToDevice);
+	err = cudaMemcpy(Kparams.Jumps3, buf, Cfg.JmpCnt * 96, cudaMemcpyHostToDevice);
 	if (err != cudaSuccess)
 	{
 		printf("GPU %d, cudaMemcpy Jumps3 failed: %s\n", CudaIndex, cudaGetErrorString(err));
@@ -251,7 +336,7 @@ bool RCGpuKang::Prepare(EcPoint _PntToSolve, int _Range, int _DP, EcJMP* _EcJump
 	}
 	free(buf);
 
-	printf("GPU %d: allocated %llu MB, %d kangaroos. OldGpuMode: %s\r\n", CudaIndex, total_mem / (1024 * 1024), KangCnt, IsOldGpu ? "Yes" : "No");
+	printf("GPU %d: allocated %llu MB, %d kangaroos. OldGpuMode: %s, config %d:%d:%d:%d:%d\r\n", CudaIndex, total_mem / (1024 * 1024), KangCnt, IsOldGpu ? "Yes" : "No", Cfg.BlockSize, Cfg.GroupCnt, Cfg.JmpCnt, Cfg.MdLen, Cfg.StepCnt);
 	return true;
 }
 
@@ -259,6 +344,12 @@ void RCGpuKang::Release()
 {
 	free(RndPnts);
 	free(DPs_out);
+	free(AuditX);
+	free(AuditCurX);
+	free(AuditLooped);
+	free(KangSeeds);
+	free(KangStartCall);
+	free(KangLastDPCall);
 	cudaFree(Kparams.LoopedKangs);
 	cudaFree(Kparams.dbg_buf);
 	cudaFree(Kparams.LoopTable);
@@ -280,22 +371,174 @@ void RCGpuKang::Stop()
 	StopFlag = true;
 }
 
+//new value is used from next kernel call
+void RCGpuKang::SetDPThr(u64 _DPThr)
+{
+	DPThr = _DPThr;
+}
+
+int RCGpuKang::GetKangType(int kang_ind)
+{
+	int tame_cnt = (int)(KangCnt * HerdParts[TAME]);
+	int wild1_cnt = (int)(KangCnt * HerdParts[WILD1]);
+	if (kang_ind < tame_cnt)
+		return TAME;
+	return (kang_ind < tame_cnt + wild1_cnt) ? WILD1 : WILD2;
+}
+
 void RCGpuKang::GenerateRndDistances()
 {
+	u32 seed_id = Solver->AllocSeedIds(KangCnt);
 	for (int i = 0; i < KangCnt; i++)
 	{
 		EcInt d;
-		if (i < KangCnt / 3)
-			d.RndBits(Range - 4); //TAME kangs
-		else
+		RndPnts[i].type = GetKangType(i);
+		KangSeeds[i] = ((seed_id + i) & SEED_ID_MASK) | ((u32)RndPnts[i].type << SEED_TYPE_SHIFT);
+		KangStartCall[i] = 0;
+		KangLastDPCall[i] = 0;
+		GetSeedDistance(d, Solver->RunSeed, KangSeeds[i], Range);
+		memcpy(RndPnts[i].priv, d.data, 24);
+	}
+}
+
+void FreeKangCheckpoint(TKangCheckpoint* chk)
+{
+	free(chk->Kangs);
+	free(chk->Seeds);
+	free(chk->StartCall);
+	free(chk->L1S2);
+	free(chk->LoopTable);
+	bool exact = chk->Exact;
+	memset(chk, 0, sizeof(TKangCheckpoint));
+	chk->Exact = exact;
+}
+
+//saves herd to Checkpoint after last kernel call, so resumed kangs continue from the same points
+bool RCGpuKang::SaveCheckpoint()
+{
+	u64 t0 = GetTickCount64();
+	TKangCheckpoint* chk = Checkpoint;
+	FreeKangCheckpoint(chk);
+	if (cudaMemcpy(RndPnts, Kparams.Kangs, (u64)KangCnt * 96, cudaMemcpyDeviceToHost) != cudaSuccess)
+		return false;
+	chk->Kangs = (u8*)malloc((u64)KangCnt * KANG_CHK_REC_SIZE);
+	chk->Seeds = (u32*)malloc(KangCnt * sizeof(u32));
+	chk->StartCall = (u32*)malloc(KangCnt * sizeof(u32));
+	for (int i = 0; i < KangCnt; i++)
+	{
+		u8* p = chk->Kangs + (u64)i * KANG_CHK_REC_SIZE;
+		memcpy(p, RndPnts[i].x, 32);
+		memcpy(p + 32, RndPnts[i].priv, 24);
+		p[56] = (u8)((RndPnts[i].y[0] & 1) | (RndPnts[i].type << 1));
+	}
+	memcpy(chk->Seeds, KangSeeds, KangCnt * sizeof(u32));
+	memcpy(chk->StartCall, KangStartCall, KangCnt * sizeof(u32));
+	chk->CallIndex = CallIndex;
+	if (chk->Exact)
+	{
+		u64 size = mpCnt * Kparams.BlockSize * 8;
+		chk->L1S2 = (u8*)malloc(size);
+		chk->LoopTable = (u64*)malloc((u64)KangCnt * Cfg.MdLen * sizeof(u64));
+		if ((cudaMemcpy(chk->L1S2, Kparams.L1S2, size, cudaMemcpyDeviceToHost) != cudaSuccess) ||
+			(cudaMemcpy(chk->LoopTable, Kparams.LoopTable, (u64)KangCnt * Cfg.MdLen * sizeof(u64), cudaMemcpyDeviceToHost) != cudaSuccess))
 		{
-			d.RndBits(Range - 1);
-			d.data[0] &= 0xFFFFFFFFFFFFFFFE; //must be even
+			FreeKangCheckpoint(chk);
+			return false;
+		}
+	}
+	chk->KangCnt = KangCnt;
+	printf("GPU %d, herd saved in %d ms, %.1f MB\r\n", CudaIndex, (int)(GetTickCount64() - t0), (double)KangCnt * KANG_CHK_REC_SIZE / (1024 * 1024));
+	return true;
+}
+
+#define CHK_DECODE_BATCH	4096
+
+struct TChkDecodeTask
+{
+	u8* recs;
+	TPointPriv* pnts;
+	int cnt;
+	int next;
+	CriticalSection cs;
+};
+
+static void chk_decode_task_proc(void* data)
+{
+	TChkDecodeTask* task = (TChkDecodeTask*)data;
+	while (1)
+	{
+		task->cs.Enter();
+		int first = task->next;
+		task->next += CHK_DECODE_BATCH;
+		task->cs.Leave();
+		if (first >= task->cnt)
+			break;
+		int last = (first + CHK_DECODE_BATCH < task->cnt) ? first + CHK_DECODE_BATCH : task->cnt;
+		for (int i = first; i < last; i++)
+		{
+			u8* p = task->recs + (u64)i * KANG_CHK_REC_SIZE;
+			EcInt x;
+			x.SetZero();
+			memcpy(x.data, p, 32);
+			EcInt y = Ec::CalcY(x, (p[56] & 1) == 0);
+			memcpy(task->pnts[i].x, x.data, 32);
+			memcpy(task->pnts[i].y, y.data, 32);
+			memcpy(task->pnts[i].priv, p + 32, 24);
+			task->pnts[i].type = p[56] >> 1;
 		}
-		memcpy(RndPnts[i].priv, d.data, 24);
 	}
 }
 
+//resumes herd from Checkpoint, y of kangs is recovered on thread pool
+bool RCGpuKang::LoadCheckpoint()
+{
+	u64 t0 = GetTickCount64();
+	TKangCheckpoint* chk = Checkpoint;
+	TChkDecodeTask task;
+	task.recs = chk->Kangs;
+	task.pnts = RndPnts;
+	task.cnt = KangCnt;
+	task.next = 0;
+	int thr_cnt = GetThreadPool()->GetWorkerCnt();
+	if (thr_cnt > (KangCnt + CHK_DECODE_BATCH - 1) / CHK_DECODE_BATCH)
+		thr_cnt = (KangCnt + CHK_DECODE_BATCH - 1) / CHK_DECODE_BATCH;
+	if (thr_cnt <= 1)
+		chk_decode_task_proc(&task);
+	else
+		GetThreadPool()->Run(chk_decode_task_proc, &task, thr_cnt, TASK_PRI_HIGH);
+	memcpy(KangSeeds, chk->Seeds, KangCnt * sizeof(u32));
+	memcpy(KangStartCall, chk->StartCall, KangCnt * sizeof(u32));
+	CallIndex = chk->CallIndex;
+	//checkpoint has no DP history, so bound starts again from now
+	for (int i = 0; i < KangCnt; i++)
+		KangLastDPCall[i] = CallIndex;
+
+	cudaError_t err = cudaMemcpy(Kparams.Kangs, RndPnts, (u64)KangCnt * 96, cudaMemcpyHostToDevice);
+	if (err != cudaSuccess)
+	{
+		printf("GPU %d, cudaMemcpy failed: %s\r\n", CudaIndex, cudaGetErrorString(err));
+		return false;
+	}
+	u64 size = mpCnt * Kparams.BlockSize * 8;
+	if (chk->L1S2)
+	{
+		err = cudaMemcpy(Kparams.L1S2, chk->L1S2, size, cudaMemcpyHostToDevice);
+		if (err == cudaSuccess)
+			err = cudaMemcpy(Kparams.LoopTable, chk->LoopTable, (u64)KangCnt * Cfg.MdLen * sizeof(u64), cudaMemcpyHostToDevice);
+	}
+	else
+	{
+		err = cudaMemset(Kparams.L1S2, 0, size);
+		if (err == cudaSuccess)
+			err = cudaMemset(Kparams.LoopTable, 0, (u64)KangCnt * Cfg.MdLen * sizeof(u64));
+	}
+	if (err != cudaSuccess)
+		return false;
+	cudaMemset(Kparams.dbg_buf, 0, 1024);
+	printf("GPU %d, herd resumed in %d ms\r\n", CudaIndex, (int)(GetTickCount64() - t0));
+	return true;
+}
+
 bool RCGpuKang::Start()
 {
 	if (Failed)
@@ -317,6 +560,8 @@ bool RCGpuKang::Start()
 	PntB.y.NegModP();
 
 	RndPnts = (TPointPriv*)malloc(KangCnt * 96);
+	if (Checkpoint && (Checkpoint->KangCnt == KangCnt))
+		return LoadCheckpoint();
 	GenerateRndDistances();
 /* 
 	//we can calc start points on CPU
@@ -330,18 +575,13 @@ bool RCGpuKang::Start()
 		memcpy(RndPnts[i].x, p.x.data, 32);
 		memcpy(RndPnts[i].y, p.y.data, 32);
 	}
-	for (int i = KangCnt / 3; i < 2 * KangCnt / 3; i++)
-	{
-		EcPoint p;
-		p.LoadFromBuffer64((u8*)RndPnts[i].x);
-		p = ec.AddPoints(p, PntA);
-		p.SaveToBuffer64((u8*)RndPnts[i].x);
-	}
-	for (int i = 2 * KangCnt / 3; i < KangCnt; i++)
+	for (int i = 0; i < KangCnt; i++)
 	{
+		if (RndPnts[i].type == TAME)
+			continue;
 		EcPoint p;
 		p.LoadFromBuffer64((u8*)RndPnts[i].x);
-		p = ec.AddPoints(p, PntB);
+		p = ec.AddPoints(p, (RndPnts[i].type == WILD1) ? PntA : PntB);
 		p.SaveToBuffer64((u8*)RndPnts[i].x);
 	}
 	//copy to gpu
@@ -358,10 +598,10 @@ bool RCGpuKang::Start()
 	PntB.SaveToBuffer64(buf_PntB);
 	for (int i = 0; i < KangCnt; i++)
 	{
-		if (i < KangCnt / 3)
+		if (RndPnts[i].type == TAME)
 			memset(RndPnts[i].x, 0, 64);
 		else
-			if (i < 2 * KangCnt / 3)
+			if (RndPnts[i].type == WILD1)
 				memcpy(RndPnts[i].x, buf_PntA, 64);
 			else
 				memcpy(RndPnts[i].x, buf_PntB, 64);
@@ -379,7 +619,7 @@ bool RCGpuKang::Start()
 	if (err != cudaSuccess)
 		return false;
 	cudaMemset(Kparams.dbg_buf, 0, 1024);
-	cudaMemset(Kparams.LoopTable, 0, KangCnt * MD_LEN * sizeof(u64));
+	cudaMemset(Kparams.LoopTable, 0, KangCnt * Cfg.MdLen * sizeof(u64));
 	return true;
 }
 
@@ -391,38 +631,223 @@ int RCGpuKang::Dbg_CheckKangs()
 	cudaError_t err = cudaMemcpy(kangs, Kparams.Kangs, kang_size, cudaMemcpyDeviceToHost);
 	int res = 0;
 	for (int i = 0; i < KangCnt; i++)
+		if (!IsKangValid(&kangs[i * 12], true))
+			res++;
+	free(kangs);
+	return res;
+}
+#endif
+
+//checks that kang point is dist * G (+ PntA or PntB for wilds), fast version requires GTable
+bool RCGpuKang::IsKangValid(u64* kang, bool fast)
+{
+	EcPoint Pnt, p;
+	Pnt.LoadFromBuffer64((u8*)kang);
+	EcInt dist;
+	dist.Set(0);
+	memcpy(dist.data, kang + 8, 24);
+	bool neg = false;
+	if (dist.data[2] >> 63)
+	{
+		neg = true;
+		memset(((u8*)dist.data) + 24, 0xFF, 16);
+		dist.Neg();
+	}
+#ifdef DEBUG_MODE
+	if (fast)
 	{
-		EcPoint Pnt, p;
-		Pnt.LoadFromBuffer64((u8*)&kangs[i * 12 + 0]);
-		EcInt dist;
-		dist.Set(0);
-		memcpy(dist.data, &kangs[i * 12 + 8], 24);
-		bool neg = false;
-		if (dist.data[2] >> 63)
-		{
-			neg = true;
-			memset(((u8*)dist.data) + 24, 0xFF, 16);
-			dist.Neg();
-		}
 		p = ec.MultiplyG_Fast(dist);
 		if (neg)
 			p.y.NegModP();
-		if (i < KangCnt / 3)
-			p = p;
+		if (!Solver->GenMode && (kang[11] == WILD1))
+			p = ec.AddPoints(PntA, p);
 		else
-			if (i < 2 * KangCnt / 3)
-				p = ec.AddPoints(PntA, p);
-			else
+			if (!Solver->GenMode && (kang[11] == WILD2))
 				p = ec.AddPoints(PntB, p);
-		if (!p.IsEqual(Pnt))
-			res++;
+		return p.IsEqual(Pnt);
 	}
-	free(kangs);
-	return res;
-}
+#else
+	(void)fast; //GTable is built in debug mode only, so release builds always use slow version
 #endif
+	//Jacobian, single inversion
+	EcJPoint jp = ec.MultiplyGJ(dist);
+	if (neg)
+		jp.y.NegModP();
+	if (!Solver->GenMode && (kang[11] == WILD1))
+		jp = ec.AddPointsJA(jp, PntA);
+	else
+		if (!Solver->GenMode && (kang[11] == WILD2))
+			jp = ec.AddPointsJA(jp, PntB);
+	p = ec.ToAffine(jp);
+	return p.IsEqual(Pnt);
+}
+
+//hardware errors (mostly on overclocked cards) can corrupt kangs, they make wrong DPs and waste time
+//so we check random kangs periodically and reseed corrupted ones
+void RCGpuKang::IntegrityCheck()
+{
+	if (GetTickCount64() - IntegrityTime < INTEGRITY_CHECK_PERIOD_MS)
+		return;
+	IntegrityTime = GetTickCount64();
+	int cnt = 0;
+	for (int i = 0; i < INTEGRITY_CHECK_CNT; i++)
+	{
+		EcInt t;
+		t.RndBits(32);
+		int ind = (int)(t.data[0] % KangCnt);
+		u64 kang[12];
+		if (cudaMemcpy(kang, Kparams.Kangs + ind * 12, 96, cudaMemcpyDeviceToHost) != cudaSuccess)
+			return;
+		if (IsKangValid(kang, false))
+			continue;
+		ReseedKang(ind, kang);
+		cnt++;
+	}
+	if (!cnt)
+		return;
+	CorruptedKangs += cnt;
+	printf("GPU %d, integrity check: %d of %d checked kangs are corrupted and reseeded, %llu total. Check GPU clocks and temperature!\r\n", CudaIndex, cnt, INTEGRITY_CHECK_CNT, CorruptedKangs);
+}
+
+//kang starts with cleared L1S2 flag, so its walk can be replayed on CPU
+void RCGpuKang::ClearL1S2(int kang_ind)
+{
+	if (IsOldGpu)
+	{
+		u64* ptr = (u64*)Kparams.L1S2 + kang_ind / Kparams.GroupCnt;
+		u64 val;
+		if (cudaMemcpy(&val, ptr, 8, cudaMemcpyDeviceToHost) != cudaSuccess)
+			return;
+		val &= ~(1ull << (kang_ind % Kparams.GroupCnt));
+		cudaMemcpy(ptr, &val, 8, cudaMemcpyHostToDevice);
+	}
+	else
+	{
+		u32* ptr = Kparams.L1S2 + kang_ind / Kparams.GroupCnt;
+		u32 val;
+		if (cudaMemcpy(&val, ptr, 4, cudaMemcpyDeviceToHost) != cudaSuccess)
+			return;
+		val &= ~(1u << (kang_ind % Kparams.GroupCnt));
+		cudaMemcpy(ptr, &val, 4, cudaMemcpyHostToDevice);
+	}
+}
+
+//new start point for kang from new seed id, type is not changed, kang starts at next kernel call
+void RCGpuKang::ReseedKang(int kang_ind, u64* kang)
+{
+	EcInt d;
+	KangSeeds[kang_ind] = (Solver->AllocSeedIds(1) & SEED_ID_MASK) | ((u32)kang[11] << SEED_TYPE_SHIFT);
+	KangStartCall[kang_ind] = CallIndex;
+	KangLastDPCall[kang_ind] = CallIndex;
+	GetSeedDistance(d, Solver->RunSeed, KangSeeds[kang_ind], Range);
+	EcJPoint jp = ec.MultiplyGJ(d);
+	if (!Solver->GenMode && (kang[11] == WILD1))
+		jp = ec.AddPointsJA(jp, PntA);
+	else
+		if (!Solver->GenMode && (kang[11] == WILD2))
+			jp = ec.AddPointsJA(jp, PntB);
+	EcPoint p = ec.ToAffine(jp);
+	p.SaveToBuffer64((u8*)kang);
+	memcpy(kang + 8, d.data, 24);
+	cudaMemcpy(Kparams.Kangs + kang_ind * 12, kang, 11 * 8, cudaMemcpyHostToDevice);
+	ClearL1S2(kang_ind);
+}
 
-extern u32 gTotalErrors;
+//called by host for DP of kang that hit DP of same-type kang, kang is reseeded by GPU thread after current kernel call
+//seed is from DP, so requests from DPs made before kang was reseeded are ignored
+void RCGpuKang::RequestReseed(u32 kang_ind, u32 seed)
+{
+	csMerged.Enter();
+	MergedReqs.push_back(((u64)seed << 32) | kang_ind);
+	csMerged.Leave();
+}
+
+//merged kangs walk the same path forever, every DP is duplicate, so one of them gets new start point
+void RCGpuKang::ReseedMerged()
+{
+	std::vector <u64> reqs;
+	csMerged.Enter();
+	reqs.swap(MergedReqs);
+	csMerged.Leave();
+	for (size_t i = 0; i < reqs.size(); i++)
+	{
+		u32 kang_ind = (u32)reqs[i];
+		u32 seed = (u32)(reqs[i] >> 32);
+		if ((kang_ind >= (u32)KangCnt) || (KangSeeds[kang_ind] != seed))
+			continue;
+		u64 kang[12];
+		if (cudaMemcpy(kang, Kparams.Kangs + kang_ind * 12, 96, cudaMemcpyDeviceToHost) != cudaSuccess)
+			return;
+		ReseedKang(kang_ind, kang);
+		MergedKangs++;
+	}
+}
+
+//KernelB doesn't detect loops bigger than MdLen (L1S12 and bigger for MdLen=10), such kangs are useless forever.
+//After every kernel call kang in a loop of size L repeats position with period L / gcd(L, StepCnt), L and StepCnt are even,
+//so if x[0] of kang repeats during HERD_AUDIT_CALLS calls, kang is looped. Loops up to 2 * HERD_AUDIT_CALLS are detected.
+//Also kang makes no DP in n jumps with chance exp(-n / 2^DP), so kang without DP for more than HERD_NO_DP_K * 2^DP jumps
+//is in a loop without DP that x[0] sampling missed (or is broken otherwise) and is treated as looped too.
+//Looped kangs get new start points.
+void RCGpuKang::HerdAudit()
+{
+	if (AuditCall < 0)
+	{
+		if (GetTickCount64() - AuditTime < HERD_AUDIT_PERIOD_MS)
+			return;
+		AuditCall = 0;
+		memset(AuditLooped, 0, KangCnt);
+	}
+	u64* dst = AuditCall ? AuditCurX : AuditX;
+	if (cudaMemcpy2D(dst, 8, Kparams.Kangs, 96, 8, KangCnt, cudaMemcpyDeviceToHost) != cudaSuccess)
+	{
+		AuditCall = -1;
+		AuditTime = GetTickCount64();
+		return;
+	}
+	if (AuditCall)
+		for (int i = 0; i < KangCnt; i++)
+			if (AuditCurX[i] == AuditX[i])
+				AuditLooped[i] = 1;
+	AuditCall++;
+	if (AuditCall <= HERD_AUDIT_CALLS)
+		return;
+
+	//2^DP is 2^64 / DPThr for fractional DP, current DPThr is used, it only grows so bound is never too small for old DPs
+	double no_dp_calls = HERD_NO_DP_K * pow(2.0, 64) / (double)DPThr / Cfg.StepCnt;
+	int no_dp_cnt = 0;
+	for (int i = 0; i < KangCnt; i++)
+		if (!AuditLooped[i] && ((double)(u32)(CallIndex - KangLastDPCall[i]) > no_dp_calls))
+		{
+			AuditLooped[i] = 1;
+			no_dp_cnt++;
+		}
+	//compact DPs keep limited number of jumps from kang start, limit is much bigger than jumps between audits
+	int long_cnt = 0;
+	if (MaxKangJumps)
+		for (int i = 0; i < KangCnt; i++)
+			if (!AuditLooped[i] && ((u64)(u32)(CallIndex - KangStartCall[i]) * Cfg.StepCnt > MaxKangJumps))
+			{
+				AuditLooped[i] = 1;
+				long_cnt++;
+			}
+
+	int cnt = 0;
+	for (int i = 0; i < KangCnt; i++)
+		if (AuditLooped[i])
+		{
+			u64 kang[12];
+			cudaMemcpy(kang, Kparams.Kangs + i * 12, 96, cudaMemcpyDeviceToHost);
+			ReseedKang(i, kang);
+			cnt++;
+		}
+	ReseededKangs += cnt;
+	printf("GPU %d, herd audit: %d looped kangs reseeded (%d without DP for %d * 2^DP jumps), %llu total\r\n", CudaIndex, cnt - long_cnt, no_dp_cnt, HERD_NO_DP_K, ReseededKangs);
+	if (long_cnt)
+		printf("GPU %d, herd audit: %d kangs reseeded because they made 2^%.0f jumps from start\r\n", CudaIndex, long_cnt, log2((double)MaxKangJumps));
+	AuditCall = -1;
+	AuditTime = GetTickCount64();
+}
 
 //executes in separate thread
 void RCGpuKang::Execute()
@@ -431,7 +856,8 @@ void RCGpuKang::Execute()
 
 	if (!Start())
 	{
-		gTotalErrors++;
+		Failed = true;
+		Solver->TotalErrors++;
 		return;
 	}
 #ifdef DEBUG_MODE
@@ -444,13 +870,15 @@ void RCGpuKang::Execute()
 		cudaMemset(Kparams.DPs_out, 0, 4);
 		cudaMemset(Kparams.DPTable, 0, KangCnt * sizeof(u32));
 		cudaMemset(Kparams.LoopedKangs, 0, 8);
+		Kparams.DPThr = DPThr;
 		CallGpuKernelABC(Kparams);
 		int cnt;
 		err = cudaMemcpy(&cnt, Kparams.DPs_out, 4, cudaMemcpyDeviceToHost);
 		if (err != cudaSuccess)
 		{
 			printf("GPU %d, CallGpuKernel failed: %s\r\n", CudaIndex, cudaGetErrorString(err));
-			gTotalErrors++;
+			Failed = true;
+			Solver->TotalErrors++;
 			break;
 		}
 		
@@ -459,18 +887,30 @@ void RCGpuKang::Execute()
 			cnt = MAX_DP_CNT;
 			printf("GPU %d, gpu DP buffer overflow, some points lost, increase DP value!\r\n", CudaIndex);
 		}
-		u64 pnt_cnt = (u64)KangCnt * STEP_CNT;
+		u64 pnt_cnt = (u64)KangCnt * Cfg.StepCnt;
 
 		if (cnt)
 		{
-			err = cudaMemcpy(DPs_out, Kparams.DPs_out + 4, cnt * GPU_DP_SIZE, cudaMemcpyDeviceToHost);
+			err = cudaMemcpy(DPs_out, Kparams.DPs_out + 4, cnt * sizeof(TDPRec), cudaMemcpyDeviceToHost);
 			if (err != cudaSuccess)
 			{
-				gTotalErrors++;
+				printf("GPU %d, DPs copy failed: %s\r\n", CudaIndex, cudaGetErrorString(err));
+				Failed = true;
+				Solver->TotalErrors++;
 				break;
 			}
-			AddPointsToList(DPs_out, cnt, (u64)KangCnt * STEP_CNT);
+			//seed id of kang and jumps from its start, compact DPs keep only them and recover distance by replay of kang walk
+			for (int i = 0; i < cnt; i++)
+			{
+				TDPRec* dp = DPs_out + i;
+				dp->seed = KangSeeds[dp->kang];
+				dp->backend = CudaIndex;
+				dp->jumps = (u64)(CallIndex - KangStartCall[dp->kang]) * Cfg.StepCnt + dp->step + 1;
+				KangLastDPCall[dp->kang] = CallIndex;
+			}
+			Solver->AddPointsToList(DPs_out, cnt, (u64)KangCnt * Cfg.StepCnt);
 		}
+		CallIndex++;
 
 		//dbg
 		cudaMemcpy(dbg, Kparams.dbg_buf, 1024, cudaMemcpyDeviceToHost);
@@ -489,6 +929,10 @@ void RCGpuKang::Execute()
 		SpeedStats[cur_stats_ind] = cur_speed;
 		cur_stats_ind = (cur_stats_ind + 1) % STATS_WND_SIZE;
 
+		HerdAudit();
+		IntegrityCheck();
+		ReseedMerged();
+
 #ifdef DEBUG_MODE
 		if ((iter % 300) == 0)
 		{
@@ -496,7 +940,7 @@ void RCGpuKang::Execute()
 			if (corr_cnt)
 			{
 				printf("DBG: GPU %d, KANGS CORRUPTED: %d\r\n", CudaIndex, corr_cnt);
-				gTotalErrors++;
+				Solver->TotalErrors++;
 			}
 			else
 				printf("DBG: GPU %d, ALL KANGS OK!\r\n", CudaIndex);
@@ -505,9 +949,46 @@ void RCGpuKang::Execute()
 #endif
 	}
 
+	if (Checkpoint && !Failed && !SaveCheckpoint())
+		printf("GPU %d, herd saving failed, it will be restarted\r\n", CudaIndex);
 	Release();
 }
 
+//short timed run of current config for autotuner, DPs are not collected
+//returns speed in MKeys/s, 0 if failed
+int RCGpuKang::Benchmark(EcPoint _PntToSolve, int _Range, int _DPBits, u64 _DPThr, EcJMP* _EcJumps1, EcJMP* _EcJumps2, EcJMP* _EcJumps3, int time_ms)
+{
+	if (!Prepare(_PntToSolve, _Range, _DPBits, _DPThr, _EcJumps1, _EcJumps2, _EcJumps3) || !Start())
+	{
+		Release();
+		return 0;
+	}
+	//first call is warm-up
+	CallGpuKernelABC(Kparams);
+	cudaError_t err = cudaDeviceSynchronize();
+	u64 pnt_cnt = 0;
+	u64 t1 = GetTickCount64();
+	while ((err == cudaSuccess) && (GetTickCount64() - t1 < (u64)time_ms))
+	{
+		cudaMemset(Kparams.DPs_out, 0, 4);
+		cudaMemset(Kparams.DPTable, 0, KangCnt * sizeof(u32));
+		cudaMemset(Kparams.LoopedKangs, 0, 8);
+		CallGpuKernelABC(Kparams);
+		err = cudaDeviceSynchronize();
+		pnt_cnt += (u64)KangCnt * Cfg.StepCnt;
+	}
+	u64 tm = GetTickCount64() - t1;
+	Release();
+	if (err != cudaSuccess)
+	{
+		printf("GPU %d, benchmark failed: %s\r\n", CudaIndex, cudaGetErrorString(err));
+		return 0;
+	}
+	if (!tm)
+		tm = 1;
+	return (int)(pnt_cnt / (tm * 1000));
+}
+
 int RCGpuKang::GetStatsSpeed()
 {
 	int res = SpeedStats[0];
@@ -10,6 +10,15 @@
 
 #define STATS_WND_SIZE	16
 
+//herd is checked for looped kangs once per period, check takes HERD_AUDIT_CALLS kernel calls
+#define HERD_AUDIT_PERIOD_MS	(60 * 60 * 1000)
+#define HERD_AUDIT_CALLS		32
+//kang without DP for more than HERD_NO_DP_K * 2^DP jumps is stuck, chance of it for normal kang is exp(-HERD_NO_DP_K)
+#define HERD_NO_DP_K			40
+//random kangs are checked for corruption once per period
+#define INTEGRITY_CHECK_PERIOD_MS	(5 * 60 * 1000)
+#define INTEGRITY_CHECK_CNT			256
+
 struct EcJMP
 {
 	EcPoint p;
@@ -21,19 +30,48 @@ struct TPointPriv
 {
 	u64 x[4];
 	u64 y[4];
-	u64 priv[4];
+	u64 priv[3];
+	u64 type; //kang type, kernels use it instead of kang index
+};
+
+//herd of preempted target in host RAM, kang is stored as x, distance and y parity with type (KANG_CHK_REC_SIZE bytes),
+//y is recovered by sqrt on resume. L1S2 and loop table are kept only for exact resume (compact DPs replay walks from start)
+#define KANG_CHK_REC_SIZE	57
+
+struct TKangCheckpoint
+{
+	int KangCnt; //0 - empty
+	bool Exact;
+	u8* Kangs;
+	u32* Seeds;
+	u32* StartCall;
+	u32 CallIndex;
+	u8* L1S2;
+	u64* LoopTable;
 };
 
+void FreeKangCheckpoint(TKangCheckpoint* chk);
+
+//seed id of kang: id in low 30 bits, start kang type in high 2 bits
+#define SEED_ID_MASK		0x3FFFFFFF
+#define SEED_TYPE_SHIFT		30
+
+void SetDefaultWalkCfg(TWalkCfg* cfg, bool old_gpu);
+void GetSeedDistance(EcInt& d, u64 run_seed, u32 seed, int Range);
+bool IsWalkCfgSupported(TWalkCfg* cfg);
+void PrintWalkCfgs();
+
 class RCGpuKang
 {
 private:
 	bool StopFlag;
 	EcPoint PntToSolve;
 	int Range; //in bits
-	int DP; //in bits
+	int DPBits; //integer part of DP
+	volatile u64 DPThr; //current DP threshold, can be changed during work
 	Ec ec;
 
-	u32* DPs_out;
+	TDPRec* DPs_out;
 	TKparams Kparams;
 
 	EcInt HalfRange;
@@ -50,7 +88,29 @@ private:
 	int cur_stats_ind;
 	int SpeedStats[STATS_WND_SIZE];
 
+	int AuditCall; //-1 if audit is not active
+	u64 AuditTime;
+	u64* AuditX; //x[0] of every kang at the start of audit
+	u64* AuditCurX;
+	u8* AuditLooped;
+	u64 IntegrityTime;
+	u32* KangSeeds; //seed id of every kang
+	u32* KangStartCall; //kernel call when kang was started from its seed
+	u32* KangLastDPCall; //kernel call of last DP of kang, or of its start if there was no DP yet
+	u32 CallIndex;
+	CriticalSection csMerged;
+	std::vector <u64> MergedReqs; //kang index and seed id (high 32 bits) of kangs that follow same-type kangs
+
+	int GetKangType(int kang_ind);
 	void GenerateRndDistances();
+	void HerdAudit();
+	void ReseedKang(int kang_ind, u64* kang);
+	void ClearL1S2(int kang_ind);
+	bool IsKangValid(u64* kang, bool fast);
+	void IntegrityCheck();
+	void ReseedMerged();
+	bool SaveCheckpoint();
+	bool LoadCheckpoint();
 	bool Start();
 	void Release();
 #ifdef DEBUG_MODE
@@ -62,12 +122,25 @@ public:
 	int mpCnt;
 	int KangCnt;
 	bool Failed;
+	volatile bool Running; //solving thread works, it exits only on error or Stop
 	bool IsOldGpu;
+	double HerdParts[3]; //parts of TAME, WILD1 and WILD2 kangs in herd
+	u64 ReseededKangs; //looped kangs found by herd audit
+	u64 CorruptedKangs; //corrupted kangs found by integrity check
+	u64 MergedKangs; //kangs merged with same-type kangs, reseeded by host requests
+	u64 MaxKangJumps; //herd audit reseeds kangs that made more jumps from their start, 0 - no limit
+	TWalkCfg Cfg;
+	class RCSolver* Solver; //owner, gets DPs and allocates seed ids
+	TKangCheckpoint* Checkpoint; //if set, Start resumes herd from it if it's not empty and Execute saves herd to it when stopped
 
+	bool SetWalkCfg(TWalkCfg* cfg);
 	int CalcKangCnt();
-	bool Prepare(EcPoint _PntToSolve, int _Range, int _DP, EcJMP* _EcJumps1, EcJMP* _EcJumps2, EcJMP* _EcJumps3);
+	bool Prepare(EcPoint _PntToSolve, int _Range, int _DPBits, u64 _DPThr, EcJMP* _EcJumps1, EcJMP* _EcJumps2, EcJMP* _EcJumps3);
+	void SetDPThr(u64 _DPThr);
 	void Stop();
+	void RequestReseed(u32 kang_ind, u32 seed);
 	void Execute();
+	int Benchmark(EcPoint _PntToSolve, int _Range, int _DPBits, u64 _DPThr, EcJMP* _EcJumps1, EcJMP* _EcJumps2, EcJMP* _EcJumps3, int time_ms);
 
 	u32 dbg[256];
 
@@ -0,0 +1,320 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#include <math.h>
+#include "Jumps.h"
+
+const char* JmpDistrNames[JMP_DISTR_CNT] = { "uniform", "loguniform", "pow2" };
+
+//log2(mean / m) for every distribution, see JMP_DISTR_xxx
+const double JmpDistrMeanOfs[JMP_DISTR_CNT] = { 0.5849625007211562, 2.4356569685534160, 5.0387475562173110 };
+
+void SetDefaultJmpStrategy(TJmpStrategy* st)
+{
+	st->distr = JMP_DISTR_UNIFORM;
+	st->mean = JMP_DEF_MEAN;
+}
+
+bool IsDefaultJmpStrategy(TJmpStrategy* st)
+{
+	return (st->distr == JMP_DISTR_UNIFORM) && (fabs(st->mean - JMP_DEF_MEAN) < 0.0001);
+}
+
+void GetJmpStrategyStr(TJmpStrategy* st, char* str)
+{
+	sprintf(str, "%s, mean 2^(R/2%+.3f)", JmpDistrNames[st->distr], st->mean);
+}
+
+//res = 2^bits, bits can be fractional
+static void SetPow2(EcInt& res, double bits)
+{
+	int ib = (int)floor(bits);
+	double frac = bits - ib;
+	if (frac < 1e-9)
+		frac = 0;
+	if (frac > 1 - 1e-9)
+	{
+		ib++;
+		frac = 0;
+	}
+	res.Set((u64)(pow(2.0, frac) * 4294967296.0));
+	if (ib >= 32)
+		res.ShiftLeft(ib - 32);
+	else
+		res.ShiftRight(32 - ib);
+}
+
+//m = 2^min_bits
+static void FillJumps(EcJMP* jumps, int cnt, int distr, double min_bits)
+{
+	Ec ec;
+	EcInt m, t;
+	SetPow2(m, min_bits);
+	for (int i = 0; i < cnt; i++)
+	{
+		switch (distr)
+		{
+		case JMP_DISTR_LOGUNIFORM:
+			t.RndBits(16);
+			SetPow2(jumps[i].dist, min_bits + 4.0 * t.data[0] / 65536.0);
+			t.RndBits((int)min_bits - 8);
+			jumps[i].dist.Add(t);
+			break;
+		case JMP_DISTR_POW2:
+			t.RndBits(3);
+			SetPow2(jumps[i].dist, min_bits + (int)t.data[0]);
+			t.RndBits((int)min_bits + (int)t.data[0] - 4);
+			jumps[i].dist.Add(t);
+			break;
+		default:
+			jumps[i].dist = m;
+			t.RndMax(m);
+			jumps[i].dist.Add(t);
+			break;
+		}
+		jumps[i].dist.data[0] &= 0xFFFFFFFFFFFFFFFE; //must be even
+	}
+	EcInt* dists = new EcInt[cnt];
+	EcPoint* pnts = new EcPoint[cnt];
+	for (int i = 0; i < cnt; i++)
+		dists[i] = jumps[i].dist;
+	ec.MultiplyGBatch(dists, pnts, cnt);
+	for (int i = 0; i < cnt; i++)
+		jumps[i].p = pnts[i];
+	delete[] pnts;
+	delete[] dists;
+}
+
+//default strategy with default jmp_cnt gives same tables as before for same rnd seed, so old tames are compatible
+//all jmp_cnt main jumps are different: walks select jump by x % jmp_cnt and L1S2 test compares jump indexes, repeated jumps would hide L1S2 loops
+void GenerateJumps(TJmpStrategy* st, int Range, int jmp_cnt, EcJMP* jumps1, EcJMP* jumps2, EcJMP* jumps3)
+{
+	FillJumps(jumps1, jmp_cnt, st->distr, Range / 2 + st->mean - JmpDistrMeanOfs[st->distr]);
+	FillJumps(jumps2, jmp_cnt, JMP_DISTR_UNIFORM, Range - 10); //large jumps for L1S2 loops. Must be almost RANGE_BITS
+	FillJumps(jumps3, jmp_cnt, JMP_DISTR_UNIFORM, Range - 10 - 2); //large jumps for loops >2
+}
+
+bool IsSameJmpTablesKey(TJmpTablesKey* k1, TJmpTablesKey* k2)
+{
+	return (k1->range == k2->range) && (k1->jmp_cnt == k2->jmp_cnt) && (k1->seed == k2->seed) &&
+		(k1->st.distr == k2->st.distr) && (k1->st.mean == k2->st.mean) && (k1->gen_ver == k2->gen_ver);
+}
+
+//jump record in cache file: x, y, dist, 32 bytes each
+#define JMP_CACHE_REC_SIZE	96
+//cache file header: magic and format version, files of other formats are not used and are rewritten on save
+#define JMP_CACHE_MAGIC		0x4A434352 //"RCCJ"
+#define JMP_CACHE_VERSION	1
+
+static void SaveJump(EcJMP* jmp, u8* buf)
+{
+	jmp->p.SaveToBuffer64(buf);
+	memcpy(buf + 64, jmp->dist.data, 32);
+}
+
+static void LoadJump(EcJMP* jmp, u8* buf)
+{
+	jmp->p.LoadFromBuffer64(buf);
+	jmp->dist.SetZero();
+	memcpy(jmp->dist.data, buf + 64, 32);
+}
+
+static u32 CalcFnvHash(u32 hash, u8* buf, u32 size)
+{
+	for (u32 i = 0; i < size; i++)
+		hash = (hash ^ buf[i]) * 16777619u;
+	return hash;
+}
+
+//FNV-1a of all tables, stored in cache file and tames header
+u32 CalcJumpsHash(int jmp_cnt, EcJMP* jumps1, EcJMP* jumps2, EcJMP* jumps3)
+{
+	u32 hash = 2166136261u;
+	u8 buf[JMP_CACHE_REC_SIZE];
+	EcJMP* tables[3] = { jumps1, jumps2, jumps3 };
+	for (int t = 0; t < 3; t++)
+		for (int i = 0; i < jmp_cnt; i++)
+		{
+			SaveJump(&tables[t][i], buf);
+			hash = CalcFnvHash(hash, buf, JMP_CACHE_REC_SIZE);
+		}
+	return hash;
+}
+
+//opens cache file and checks its header, returns NULL if there is no file or it has other format
+static FILE* OpenJumpsCache(const char* fn)
+{
+	FILE* fp = fopen(fn, "rb");
+	if (!fp)
+		return NULL;
+	u32 hdr[2];
+	if ((fread(hdr, sizeof(hdr), 1, fp) != 1) || (hdr[0] != JMP_CACHE_MAGIC) || (hdr[1] != JMP_CACHE_VERSION))
+	{
+		fclose(fp);
+		return NULL;
+	}
+	return fp;
+}
+
+//reads next record, data is in buf (3 * MAX_JMP_CNT jumps), returns false at the end of file or if file is broken
+//valid is false if data doesn't match stored hash
+static bool ReadJumpsCacheRec(FILE* fp, TJmpTablesKey* key, u8* buf, bool* valid)
+{
+	u32 hash;
+	if ((fread(key, sizeof(*key), 1, fp) != 1) || (fread(&hash, 4, 1, fp) != 1))
+		return false;
+	if ((key->jmp_cnt < 1) || (key->jmp_cnt > MAX_JMP_CNT))
+		return false;
+	u32 size = 3 * key->jmp_cnt * JMP_CACHE_REC_SIZE;
+	if (fread(buf, 1, size, fp) != size)
+		return false;
+	*valid = (CalcFnvHash(2166136261u, buf, size) == hash);
+	return true;
+}
+
+static bool WriteJumpsCacheRec(FILE* fp, TJmpTablesKey* key, u8* buf)
+{
+	u32 size = 3 * key->jmp_cnt * JMP_CACHE_REC_SIZE;
+	u32 hash = CalcFnvHash(2166136261u, buf, size);
+	return (fwrite(key, sizeof(*key), 1, fp) == 1) && (fwrite(&hash, 4, 1, fp) == 1) && (fwrite(buf, 1, size, fp) == size);
+}
+
+//cache file is a header and a list of records: key, hash, tables. Records with wrong hash are skipped
+bool LoadJumpsCache(const char* fn, TJmpTablesKey* key, EcJMP* jumps1, EcJMP* jumps2, EcJMP* jumps3)
+{
+	FILE* fp = OpenJumpsCache(fn);
+	if (!fp)
+		return false;
+	bool res = false;
+	TJmpTablesKey rec_key;
+	bool valid;
+	u8* buf = (u8*)malloc(3 * MAX_JMP_CNT * JMP_CACHE_REC_SIZE);
+	while (ReadJumpsCacheRec(fp, &rec_key, buf, &valid))
+	{
+		if (!valid || !IsSameJmpTablesKey(&rec_key, key))
+			continue;
+		EcJMP* tables[3] = { jumps1, jumps2, jumps3 };
+		for (int t = 0; t < 3; t++)
+			for (int i = 0; i < key->jmp_cnt; i++)
+				LoadJump(&tables[t][i], buf + (t * key->jmp_cnt + i) * JMP_CACHE_REC_SIZE);
+		res = true;
+		break;
+	}
+	free(buf);
+	fclose(fp);
+	return res;
+}
+
+//rewrites cache file: valid records with other keys and new tables, so broken records and files of other formats don't stay forever
+bool SaveJumpsCache(const char* fn, TJmpTablesKey* key, EcJMP* jumps1, EcJMP* jumps2, EcJMP* jumps3)
+{
+	std::vector <u8> old_recs;
+	u8* buf = (u8*)malloc(3 * MAX_JMP_CNT * JMP_CACHE_REC_SIZE);
+	FILE* fp = OpenJumpsCache(fn);
+	if (fp)
+	{
+		TJmpTablesKey rec_key;
+		bool valid;
+		while (ReadJumpsCacheRec(fp, &rec_key, buf, &valid))
+			if (valid && !IsSameJmpTablesKey(&rec_key, key))
+			{
+				u32 size = 3 * rec_key.jmp_cnt * JMP_CACHE_REC_SIZE;
+				old_recs.insert(old_recs.end(), (u8*)&rec_key, (u8*)&rec_key + sizeof(rec_key));
+				old_recs.insert(old_recs.end(), buf, buf + size);
+			}
+		fclose(fp);
+	}
+	fp = fopen(fn, "wb");
+	if (!fp)
+	{
+		free(buf);
+		return false;
+	}
+	u32 hdr[2] = { JMP_CACHE_MAGIC, JMP_CACHE_VERSION };
+	bool res = (fwrite(hdr, sizeof(hdr), 1, fp) == 1);
+	for (size_t pos = 0; res && (pos < old_recs.size()); )
+	{
+		TJmpTablesKey* rec_key = (TJmpTablesKey*)&old_recs[pos];
+		res = WriteJumpsCacheRec(fp, rec_key, &old_recs[pos + sizeof(*rec_key)]);
+		pos += sizeof(*rec_key) + 3 * rec_key->jmp_cnt * JMP_CACHE_REC_SIZE;
+	}
+	EcJMP* tables[3] = { jumps1, jumps2, jumps3 };
+	for (int t = 0; t < 3; t++)
+		for (int i = 0; i < key->jmp_cnt; i++)
+			SaveJump(&tables[t][i], buf + (t * key->jmp_cnt + i) * JMP_CACHE_REC_SIZE);
+	res = res && WriteJumpsCacheRec(fp, key, buf);
+	free(buf);
+	fclose(fp);
+	return res;
+}
+
+bool TJmpProfile::LoadFromFile(char* fn)
+{
+	FILE* fp = fopen(fn, "r");
+	if (!fp)
+		return false;
+	recs.clear();
+	char line[256], name[64];
+	while (fgets(line, sizeof(line), fp))
+	{
+		if (line[0] == '#')
+			continue;
+		TJmpProfileRec rec;
+		char tail[2];
+		//old format has 6 fields with number of different jumps, its K was measured with repeated jumps, so skip it
+		if (sscanf(line, "%d %d %63s %lf %lf %1s", &rec.range, &rec.herd_bits, name, &rec.st.mean, &rec.k, tail) != 5)
+			continue;
+		rec.st.distr = -1;
+		for (int i = 0; i < JMP_DISTR_CNT; i++)
+			if (strcmp(name, JmpDistrNames[i]) == 0)
+				rec.st.distr = i;
+		if (rec.st.distr < 0)
+			continue;
+		recs.push_back(rec);
+	}
+	fclose(fp);
+	return true;
+}
+
+bool TJmpProfile::SaveToFile(char* fn)
+{
+	FILE* fp = fopen(fn, "w");
+	if (!fp)
+		return false;
+	fprintf(fp, "# RCKangaroo jumps profile: range herd_bits distribution mean K\n");
+	for (int i = 0; i < (int)recs.size(); i++)
+		fprintf(fp, "%d %d %s %.4f %.4f\n", recs[i].range, recs[i].herd_bits, JmpDistrNames[recs[i].st.distr], recs[i].st.mean, recs[i].k);
+	fclose(fp);
+	return true;
+}
+
+void TJmpProfile::Set(TJmpProfileRec& rec)
+{
+	for (int i = 0; i < (int)recs.size(); i++)
+		if ((recs[i].range == rec.range) && (recs[i].herd_bits == rec.herd_bits))
+		{
+			recs[i] = rec;
+			return;
+		}
+	recs.push_back(rec);
+}
+
+//if there is no exact match, returns record with closest path of single kang (Range/2 - herd_bits)
+TJmpProfileRec* TJmpProfile::Find(int range, int herd_bits)
+{
+	TJmpProfileRec* res = NULL;
+	int best_diff = 0;
+	for (int i = 0; i < (int)recs.size(); i++)
+	{
+		int diff = 1024 * abs((recs[i].range / 2 - recs[i].herd_bits) - (range / 2 - herd_bits)) + abs(recs[i].range - range);
+		if (!res || (diff < best_diff))
+		{
+			res = &recs[i];
+			best_diff = diff;
+		}
+	}
+	return res;
+}
@@ -0,0 +1,68 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#pragma once
+
+#include <vector>
+#include "GpuKang.h"
+
+//distributions of main jumps
+#define JMP_DISTR_UNIFORM		0  //uniform in [m, 2m)
+#define JMP_DISTR_LOGUNIFORM	1  //log-uniform in [m, 16m)
+#define JMP_DISTR_POW2			2  //powers of 2 in [m, 128m] with some random low bits
+#define JMP_DISTR_CNT			3
+
+//default main jumps are in [2^(Range/2+3), 2^(Range/2+4)), log2 of mean is Range/2 + 3 + log2(1.5)
+#define JMP_DEF_MEAN			3.5849625007211562
+
+struct TJmpStrategy
+{
+	int distr;
+	double mean; //log2 of mean of main jumps minus Range/2
+};
+
+void SetDefaultJmpStrategy(TJmpStrategy* st);
+bool IsDefaultJmpStrategy(TJmpStrategy* st);
+void GetJmpStrategyStr(TJmpStrategy* st, char* str);
+void GenerateJumps(TJmpStrategy* st, int Range, int jmp_cnt, EcJMP* jumps1, EcJMP* jumps2, EcJMP* jumps3);
+
+//increase it when GenerateJumps makes different tables for same key, so cached tables of old generator are not used
+#define JMP_GEN_VERSION		2
+
+//jump tables depend on these values only, so they can be cached
+struct TJmpTablesKey
+{
+	int range;
+	int jmp_cnt;
+	u64 seed;
+	TJmpStrategy st;
+	int gen_ver; //JMP_GEN_VERSION
+};
+
+bool IsSameJmpTablesKey(TJmpTablesKey* k1, TJmpTablesKey* k2);
+u32 CalcJumpsHash(int jmp_cnt, EcJMP* jumps1, EcJMP* jumps2, EcJMP* jumps3);
+bool LoadJumpsCache(const char* fn, TJmpTablesKey* key, EcJMP* jumps1, EcJMP* jumps2, EcJMP* jumps3);
+bool SaveJumpsCache(const char* fn, TJmpTablesKey* key, EcJMP* jumps1, EcJMP* jumps2, EcJMP* jumps3);
+
+struct TJmpProfileRec
+{
+	int range;
+	int herd_bits; //log2 of number of kangs
+	TJmpStrategy st;
+	double k; //measured K
+};
+
+//keeps best jump strategy for every (range, herd size), text file
+class TJmpProfile
+{
+public:
+	std::vector <TJmpProfileRec> recs;
+
+	bool LoadFromFile(char* fn);
+	bool SaveToFile(char* fn);
+	void Set(TJmpProfileRec& rec);
+	TJmpProfileRec* Find(int range, int herd_bits);
+};
@@ -8,7 +8,10 @@
 #include "RCGpuUtils.h"
 
 //imp2 table points for KernelA
-__device__ __constant__ u64 jmp2_table[8 * JMP_CNT];
+__device__ __constant__ u64 jmp2_table[8 * MAX_JMP_CNT];
+
+//kernels are templates, BLOCK_SIZE, PNT_GROUP_CNT, JMP_CNT, MD_LEN, STEP_CNT are template parameters, see WALK_CFG_LIST
+#define JMP_MASK	(JMP_CNT-1)
 
 
 #define BLOCK_CNT	gridDim.x
@@ -20,14 +23,18 @@ __device__ __constant__ u64 jmp2_table[8 * JMP_CNT];
 #define SAVE_VAL_256(ptr, src, group) { *((int4*)&(ptr)[BLOCK_SIZE * 4 * BLOCK_CNT * (group)]) = *((int4*)&(src)[0]); *((int4*)&(ptr)[2 * BLOCK_SIZE + BLOCK_SIZE * 4 * BLOCK_CNT * (group)]) = *((int4*)&(src)[2]); }
 
 
+//GpuEmu.cpp compiles kernels for CPU and provides its own LDS and launch code
+#ifndef GPU_EMU
 extern __shared__ u64 LDS[]; 
+#endif
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #ifndef OLD_GPU
 
 //this kernel performs main jumps
-extern "C" __launch_bounds__(BLOCK_SIZE, 1)
+template <int BLOCK_SIZE, int PNT_GROUP_CNT, int JMP_CNT, int MD_LEN, int STEP_CNT>
+__launch_bounds__(BLOCK_SIZE, 1)
 __global__ void KernelA(const TKparams Kparams)
 {
 	u64* L2x = Kparams.L2 + 2 * THREAD_X + 4 * BLOCK_SIZE * BLOCK_X;
@@ -56,7 +63,7 @@ __global__ void KernelA(const TKparams Kparams)
     __syncthreads(); 
 
 	__align__(16) u64 x[4], y[4], tmp[4], tmp2[4];
-	u64 dp_mask64 = ~((1ull << (64 - Kparams.DP)) - 1);
+	u64 dp_thr = Kparams.DPThr;
 	u16 jmp_ind;
 
 	//copy kangs from global to L2
@@ -158,13 +165,15 @@ __global__ void KernelA(const TKparams Kparams)
 				jmp_ind |= JMP2_FLAG;
 			}
 			
-			if ((x[3] & dp_mask64) == 0)
+			if (x[3] < dp_thr)
 			{
 				u32 kang_ind = (THREAD_X + BLOCK_X * BLOCK_SIZE) * PNT_GROUP_CNT + group;
 				u32 ind = atomicAdd(Kparams.DPTable + kang_ind, 1);
 				ind = min(ind, DPTABLE_MAX_CNT - 1);
 				int4* dst = (int4*)(Kparams.DPTable + Kparams.KangCnt + (kang_ind * DPTABLE_MAX_CNT + ind) * 4);
-				dst[0] = ((int4*)x)[0];
+				int4 rx = ((int4*)x)[0];
+				rx.w = (u32)((x[3] << Kparams.DPBits) >> 32); //only 12 bytes of X are used in DB, store DP level instead of the rest
+				dst[0] = rx;
 				jmp_ind |= DP_FLAG;
 			}
 
@@ -210,7 +219,8 @@ __global__ void KernelA(const TKparams Kparams)
 
 //this kernel performs main jumps for old cards
 //not good but works
-extern "C" __launch_bounds__(BLOCK_SIZE, 1)
+template <int BLOCK_SIZE, int PNT_GROUP_CNT, int JMP_CNT, int MD_LEN, int STEP_CNT>
+__launch_bounds__(BLOCK_SIZE, 1)
 __global__ void KernelA(const TKparams Kparams)
 {
 	__align__(16) u64 Lx[4 * PNT_GROUP_CNT];
@@ -241,7 +251,7 @@ __global__ void KernelA(const TKparams Kparams)
 
 	__align__(16) u64 inverse[5];
 	__align__(16) u64 x[4], y[4], tmp[4], tmp2[4];
-	u64 dp_mask64 = ~((1ull << (64 - Kparams.DP)) - 1);
+	u64 dp_thr = Kparams.DPThr;
 	u16 jmp_ind;
 
 	//copy kangs from global to local
@@ -396,13 +406,15 @@ __global__ void KernelA(const TKparams Kparams)
 				jmp_ind |= JMP2_FLAG;
 			}
 
-			if ((x[3] & dp_mask64) == 0)
+			if (x[3] < dp_thr)
 			{
 				u32 kang_ind = (THREAD_X + BLOCK_X * BLOCK_SIZE) * PNT_GROUP_CNT + group;
 				u32 ind = atomicAdd(Kparams.DPTable + kang_ind, 1);
 				ind = min(ind, DPTABLE_MAX_CNT - 1);
 				int4* dst = (int4*)(Kparams.DPTable + Kparams.KangCnt + (kang_ind * DPTABLE_MAX_CNT + ind) * 4);
-				dst[0] = ((int4*)x)[0];
+				int4 rx = ((int4*)x)[0];
+				rx.w = (u32)((x[3] << Kparams.DPBits) >> 32); //only 12 bytes of X are used in DB, store DP level instead of the rest
+				dst[0] = rx;
 				jmp_ind |= DP_FLAG;
 			}
 
@@ -482,7 +494,7 @@ __global__ void KernelA(const TKparams Kparams)
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-__device__ __forceinline__ void BuildDP(const TKparams& Kparams, int kang_ind, u64* d)
+__device__ __forceinline__ void BuildDP(const TKparams& Kparams, int kang_ind, u64* d, u32 step_ind)
 {
 	int ind = atomicAdd(Kparams.DPTable + kang_ind, 0x10000);
 	ind >>= 16;
@@ -491,13 +503,15 @@ __device__ __forceinline__ void BuildDP(const TKparams& Kparams, int kang_ind, u
 	int4 rx = *(int4*)(Kparams.DPTable + Kparams.KangCnt + (kang_ind * DPTABLE_MAX_CNT + ind) * 4);
 	u32 pos = atomicAdd(Kparams.DPs_out, 1);
 	pos = min(pos, MAX_DP_CNT - 1);
-	u32* DPs = Kparams.DPs_out + 4 + pos * GPU_DP_SIZE / 4;
-	*(int4*)&DPs[0] = rx;
-	*(int4*)&DPs[4] = ((int4*)d)[0];
-	*(u64*)&DPs[8] = d[2];
-	DPs[10] = 3 * kang_ind / Kparams.KangCnt; //kang type
+	TDPRec* dp = (TDPRec*)(Kparams.DPs_out + 4) + pos;
+	*(int4*)dp->x = rx; //x and lvl_bits
+	*(int4*)dp->d = ((int4*)d)[0];
+	dp->d[2] = d[2];
+	*(u32*)&dp->type = (u32)Kparams.Kangs[kang_ind * 12 + 11] | (step_ind << 16); //kang type and jump index, jump index is used to replay kang walk
+	dp->kang = kang_ind;
 }
 
+template <int JMP_CNT, int MD_LEN, int STEP_CNT>
 __device__ __forceinline__ bool ProcessJumpDistance(u32 step_ind, u32 d_cur, u64* d, u32 kang_ind, u64* jmp1_d, u64* jmp2_d, const TKparams& Kparams, u64* table, u32* cur_ind, u8 iter)
 {
 	u64* jmp_d = (d_cur & JMP2_FLAG) ? jmp2_d : jmp1_d;
@@ -511,31 +525,21 @@ __device__ __forceinline__ bool ProcessJumpDistance(u32 step_ind, u32 d_cur, u64
 	else
 		Add192to192(d, jmp);
 
-	//check in table
-	int found_ind = iter + MD_LEN - 4;
-	while (1)
-	{
-		if (table[found_ind % MD_LEN] == d[0])
-			break;
-		found_ind -= 2;
-		if (table[found_ind % MD_LEN] == d[0])
-			break;
-		found_ind -= 2;
-		if (table[found_ind % MD_LEN] == d[0])
-			break;
+	//check in table, loops have even size: 4, 6, ... MD_LEN
+	int found_ind = -1;
+	#pragma unroll
+	for (int ofs = 4; ofs < MD_LEN; ofs += 2)
+		if ((found_ind < 0) && (table[(iter + MD_LEN - ofs) % MD_LEN] == d[0]))
+			found_ind = (iter + MD_LEN - ofs) % MD_LEN;
+	if ((found_ind < 0) && (table[iter] == d[0]))
 		found_ind = iter;
-		if (table[found_ind] == d[0])
-			break;
-		found_ind = -1;
-		break;
-	}
 	table[iter] = d[0];
 	*cur_ind = (iter + 1) % MD_LEN;
 
 	if (found_ind < 0)
 	{		
 		if (d_cur & DP_FLAG)
-			BuildDP(Kparams, kang_ind, d);
+			BuildDP(Kparams, kang_ind, d, step_ind);
 		return false;
 	}
 
@@ -556,9 +560,9 @@ __device__ __forceinline__ bool ProcessJumpDistance(u32 step_ind, u32 d_cur, u64
 	u16 cur_dA = cur_dAB & 0xFFFF; \
 	u16 cur_dB = cur_dAB >> 16; \
 	if (!LoopedA) \
-		LoopedA = ProcessJumpDistance(step_ind, cur_dA, dA, kang_ind, jmp1_d, jmp2_d, Kparams, RegsA, &cur_indA, iter); \
+		LoopedA = ProcessJumpDistance<JMP_CNT, MD_LEN, STEP_CNT>(step_ind, cur_dA, dA, kang_ind, jmp1_d, jmp2_d, Kparams, RegsA, &cur_indA, iter); \
 	if (!LoopedB) \
-		LoopedB = ProcessJumpDistance(step_ind, cur_dB, dB, kang_ind + 1, jmp1_d, jmp2_d, Kparams, RegsB, &cur_indB, iter); \
+		LoopedB = ProcessJumpDistance<JMP_CNT, MD_LEN, STEP_CNT>(step_ind, cur_dB, dB, kang_ind + 1, jmp1_d, jmp2_d, Kparams, RegsB, &cur_indB, iter); \
 	jlist += BLOCK_SIZE * PNT_GROUP_CNT / 2; \
 	step_ind++; \
 }
@@ -571,7 +575,8 @@ __device__ __forceinline__ bool ProcessJumpDistance(u32 step_ind, u32 d_cur, u64
 // Since we lose kangs gradually, for a year we lose 0.19/2 = 0.1% of speed, so you should catch L1S12 only if you are going to solve same point for decades.
 // Or you can check all kangs for L1S12 on CPU once a day and restart looped kangs.
 // Level2 loops are very rare and they have even size too so they will be handled by the same code. We don't know what loop level we catch so we use JmpTable3 for escaping.
-extern "C" __launch_bounds__(BLOCK_SIZE, 1)
+template <int BLOCK_SIZE, int PNT_GROUP_CNT, int JMP_CNT, int MD_LEN, int STEP_CNT>
+__launch_bounds__(BLOCK_SIZE, 1)
 __global__ void KernelB(const TKparams Kparams)
 {
 	u64* jmp1_d = LDS; //16KB, 192bit jumps
@@ -602,8 +607,8 @@ __global__ void KernelB(const TKparams Kparams)
 		#pragma unroll
 		for (int i = 0; i < MD_LEN; i++)
 		{
-			RegsA[i] = Kparams.LoopTable[MD_LEN * BLOCK_SIZE * PNT_GROUP_CNT * BLOCK_X + 2 * MD_LEN * BLOCK_SIZE * gr_ind2 + i * BLOCK_SIZE + BLOCK_X];
-			RegsB[i] = Kparams.LoopTable[MD_LEN * BLOCK_SIZE * PNT_GROUP_CNT * BLOCK_X + 2 * MD_LEN * BLOCK_SIZE * gr_ind2 + (i + MD_LEN) * BLOCK_SIZE + BLOCK_X];
+			RegsA[i] = Kparams.LoopTable[MD_LEN * BLOCK_SIZE * PNT_GROUP_CNT * BLOCK_X + 2 * MD_LEN * BLOCK_SIZE * gr_ind2 + i * BLOCK_SIZE + THREAD_X];
+			RegsB[i] = Kparams.LoopTable[MD_LEN * BLOCK_SIZE * PNT_GROUP_CNT * BLOCK_X + 2 * MD_LEN * BLOCK_SIZE * gr_ind2 + (i + MD_LEN) * BLOCK_SIZE + THREAD_X];
 		}
 		u32 cur_indA = 0;
 		u32 cur_indB = 0;
@@ -633,16 +638,9 @@ __global__ void KernelB(const TKparams Kparams)
 		u32 step_ind = 0;
 		while (step_ind < STEP_CNT)
 		{
-			DO_ITER(0);
-			DO_ITER(1);
-			DO_ITER(2);
-			DO_ITER(3);
-			DO_ITER(4);
-			DO_ITER(5);
-			DO_ITER(6);
-			DO_ITER(7);
-			DO_ITER(8);
-			DO_ITER(9);
+			#pragma unroll
+			for (int iter = 0; iter < MD_LEN; iter++)
+				DO_ITER(iter);
 		}
 
 		Kparams.Kangs[kang_ind * 12 + 8] = dA[0];
@@ -657,15 +655,16 @@ __global__ void KernelB(const TKparams Kparams)
 		for (int i = 0; i < MD_LEN; i++)
 		{
 			int ind = (i + MD_LEN - cur_indA) % MD_LEN;
-			Kparams.LoopTable[MD_LEN * BLOCK_SIZE * PNT_GROUP_CNT * BLOCK_X + 2 * MD_LEN * BLOCK_SIZE * gr_ind2 + ind * BLOCK_SIZE + BLOCK_X] = RegsA[i];
+			Kparams.LoopTable[MD_LEN * BLOCK_SIZE * PNT_GROUP_CNT * BLOCK_X + 2 * MD_LEN * BLOCK_SIZE * gr_ind2 + ind * BLOCK_SIZE + THREAD_X] = RegsA[i];
 			ind = (i + MD_LEN - cur_indB) % MD_LEN;
-			Kparams.LoopTable[MD_LEN * BLOCK_SIZE * PNT_GROUP_CNT * BLOCK_X + 2 * MD_LEN * BLOCK_SIZE * gr_ind2 + (ind + MD_LEN) * BLOCK_SIZE + BLOCK_X] = RegsB[i];
+			Kparams.LoopTable[MD_LEN * BLOCK_SIZE * PNT_GROUP_CNT * BLOCK_X + 2 * MD_LEN * BLOCK_SIZE * gr_ind2 + (ind + MD_LEN) * BLOCK_SIZE + THREAD_X] = RegsB[i];
 		}
 	}
 }
 
 //this kernel performes single jump3 for looped kangs
-extern "C" __launch_bounds__(BLOCK_SIZE, 1)
+template <int BLOCK_SIZE, int PNT_GROUP_CNT, int JMP_CNT>
+__launch_bounds__(BLOCK_SIZE, 1)
 __global__ void KernelC(const TKparams Kparams)
 {
 	u64* jmp3_table = LDS; //48KB
@@ -775,50 +774,73 @@ __global__ void KernelC(const TKparams Kparams)
 #define GY_2	0x5DA4FBFC0E1108A8ull
 #define GY_3	0x483ADA7726A3C465ull
 
-__device__ __forceinline__ void AddPoints(u64* res_x, u64* res_y, u64* pnt1x, u64* pnt1y, u64* pnt2x, u64* pnt2y)
+//Jacobian doubling, x = x / z^2, y = y / z^3, in place
+// https://hyperelliptic.org/EFD/g1p/auto-shortw-jacobian-0.html#doubling-dbl-2009-l
+__device__ __forceinline__ void DoublePointJ(u64* x, u64* y, u64* z)
 {
-	__align__(16) u64 tmp[4], tmp2[4], lambda[4], lambda2[4];
-	__align__(16) u64 inverse[5];
-	SubModP(inverse, pnt2x, pnt1x);
-	InvModP((u32*)inverse);
-	SubModP(tmp, pnt2y, pnt1y);
-	MulModP(lambda, tmp, inverse);
-	MulModP(lambda2, lambda, lambda);
-	SubModP(tmp, lambda2, pnt1x);
-	SubModP(res_x, tmp, pnt2x);
-	SubModP(tmp, pnt2x, res_x);
-	MulModP(tmp2, tmp, lambda);
-	SubModP(res_y, tmp2, pnt2y);
+	__align__(16) u64 a[4], b[4], c[4], d[4], e[4];
+	MulModP(a, x, x);
+	MulModP(b, y, y);
+	MulModP(c, b, b);
+	AddModP(d, x, b);
+	MulModP(d, d, d);
+	SubModP(d, d, a);
+	SubModP(d, d, c);
+	AddModP(d, d, d);
+	AddModP(e, a, a);
+	AddModP(e, e, a);
+	MulModP(z, y, z);
+	AddModP(z, z, z);
+	MulModP(x, e, e);
+	SubModP(x, x, d);
+	SubModP(x, x, d);
+	AddModP(c, c, c);
+	AddModP(c, c, c);
+	AddModP(c, c, c);
+	SubModP(y, d, x);
+	MulModP(y, y, e);
+	SubModP(y, y, c);
 }
 
-__device__ __forceinline__ void DoublePoint(u64* res_x, u64* res_y, u64* pntx, u64* pnty)
+//Jacobian point plus affine point, in place
+//no checks for equal points, kangs start points never have them
+// https://hyperelliptic.org/EFD/g1p/auto-shortw-jacobian-0.html#addition-madd-2004-hmv
+__device__ __forceinline__ void AddPointsJA(u64* x, u64* y, u64* z, u64* pntx, u64* pnty)
 {
-	__align__(16) u64 tmp[4], tmp2[4], lambda[4], lambda2[4];
-	__align__(16) u64 inverse[5];
-	AddModP(inverse, pnty, pnty);
-	InvModP((u32*)inverse);
-	MulModP(tmp2, pntx, pntx);
-	AddModP(tmp, tmp2, tmp2);
-	AddModP(tmp, tmp, tmp2);
-	MulModP(lambda, tmp, inverse);
-	MulModP(lambda2, lambda, lambda);
-	SubModP(tmp, lambda2, pntx);
-	SubModP(res_x, tmp, pntx);
-	SubModP(tmp, pntx, res_x);
-	MulModP(tmp2, tmp, lambda);
-	SubModP(res_y, tmp2, pnty);
+	__align__(16) u64 t1[4], t2[4], t3[4], t4[4];
+	MulModP(t1, z, z);
+	MulModP(t2, t1, z);
+	MulModP(t1, t1, pntx);
+	MulModP(t2, t2, pnty);
+	SubModP(t1, t1, x);
+	SubModP(t2, t2, y);
+	MulModP(z, z, t1);
+	MulModP(t4, t1, t1);
+	MulModP(t3, t4, t1);
+	MulModP(t4, t4, x);
+	MulModP(x, t2, t2);
+	SubModP(x, x, t4);
+	SubModP(x, x, t4);
+	SubModP(x, x, t3);
+	SubModP(t4, t4, x);
+	MulModP(t4, t4, t2);
+	MulModP(t3, t3, y);
+	SubModP(y, t4, t3);
 }
 
 //this kernel calculates start points of kangs
-extern "C" __launch_bounds__(BLOCK_SIZE, 1)
+//left-to-right in Jacobian coordinates with mixed additions of G, so only one inversion per kang
+template <int BLOCK_SIZE, int PNT_GROUP_CNT>
+__launch_bounds__(BLOCK_SIZE, 1)
 __global__ void KernelGen(const TKparams Kparams)
 {
 	for (u32 group = 0; group < PNT_GROUP_CNT; group++)
 	{
 		__align__(16) u64 x0[4], y0[4], d[3];
-		__align__(16) u64 x[4], y[4];
-		__align__(16) u64 tx[4], ty[4];
-		__align__(16) u64 t2x[4], t2y[4];
+		__align__(16) u64 x[4], y[4], z[4];
+		__align__(16) u64 gx[4], gy[4];
+		__align__(16) u64 inverse[5];
+		__align__(16) u64 tmp[4];
 
 		u32 kang_ind = PNT_GROUP_CNT * (THREAD_X + BLOCK_X * BLOCK_SIZE) + group;
 		x0[0] = Kparams.Kangs[kang_ind * 12 + 0];
@@ -833,46 +855,36 @@ __global__ void KernelGen(const TKparams Kparams)
 		d[1] = Kparams.Kangs[kang_ind * 12 + 9];
 		d[2] = Kparams.Kangs[kang_ind * 12 + 10];
 		
-		tx[0] = GX_0; tx[1] = GX_1; tx[2] = GX_2; tx[3] = GX_3;
-		ty[0] = GY_0; ty[1] = GY_1; ty[2] = GY_2; ty[3] = GY_3;
+		gx[0] = GX_0; gx[1] = GX_1; gx[2] = GX_2; gx[3] = GX_3;
+		gy[0] = GY_0; gy[1] = GY_1; gy[2] = GY_2; gy[3] = GY_3;
 
-		bool first = true;
 		int n = 2;
 		while ((n >= 0) && !d[n]) 
 			n--;
 		if (n < 0)
 			continue; //error
 		int index = __clzll(d[n]);
-		for (int i = 0; i <= 64 * n + (63 - index); i++)
+		Copy_u64_x4(x, gx);
+		Copy_u64_x4(y, gy);
+		z[0] = 1; z[1] = 0; z[2] = 0; z[3] = 0;
+		for (int i = 64 * n + (63 - index) - 1; i >= 0; i--)
 		{
-			u8 v = (d[i / 64] >> (i % 64)) & 1;
-			if (v)
-			{
-				if (first)
-				{
-					first = false;
-					Copy_u64_x4(x, tx);
-					Copy_u64_x4(y, ty);
-				}
-				else
-				{
-					AddPoints(t2x, t2y, x, y, tx, ty);
-					Copy_u64_x4(x, t2x);
-					Copy_u64_x4(y, t2y);
-				}
-			}
-			DoublePoint(t2x, t2y, tx, ty);
-			Copy_u64_x4(tx, t2x);
-			Copy_u64_x4(ty, t2y);
+			DoublePointJ(x, y, z);
+			if ((d[i / 64] >> (i % 64)) & 1)
+				AddPointsJA(x, y, z, gx, gy);
 		}
 
 		if (!Kparams.IsGenMode)
-			if (kang_ind >= Kparams.KangCnt / 3)
-			{
-				AddPoints(t2x, t2y, x, y, x0, y0);
-				Copy_u64_x4(x, t2x);
-				Copy_u64_x4(y, t2y);
-			}
+			if (Kparams.Kangs[kang_ind * 12 + 11] != TAME)
+				AddPointsJA(x, y, z, x0, y0);
+
+		//to affine
+		Copy_u64_x4(inverse, z);
+		InvModP((u32*)inverse);
+		MulModP(tmp, inverse, inverse);
+		MulModP(x, x, tmp);
+		MulModP(tmp, tmp, inverse);
+		MulModP(y, y, tmp);
 
 		Kparams.Kangs[kang_ind * 12 + 0] = x[0];
 		Kparams.Kangs[kang_ind * 12 + 1] = x[1];
@@ -887,31 +899,70 @@ __global__ void KernelGen(const TKparams Kparams)
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+#ifndef GPU_EMU
+
+typedef void (*TKernelFunc)(const TKparams Kparams);
+
+struct TKernelSet
+{
+	u32 BlockSize;
+	u32 GroupCnt;
+	u32 JmpCnt;
+	u32 MdLen;
+	u32 StepCnt;
+	TKernelFunc KernelA;
+	TKernelFunc KernelB;
+	TKernelFunc KernelC;
+	TKernelFunc KernelGen;
+};
+
+#define KERNEL_SET(bs, gc, jc, md, sc) { bs, gc, jc, md, sc, KernelA<bs, gc, jc, md, sc>, KernelB<bs, gc, jc, md, sc>, KernelC<bs, gc, jc>, KernelGen<bs, gc> },
+
+TKernelSet KernelSets[] = { WALK_CFG_LIST(KERNEL_SET) };
+
+TKernelSet* FindKernelSet(const TKparams& Kparams)
+{
+	for (int i = 0; i < (int)(sizeof(KernelSets) / sizeof(KernelSets[0])); i++)
+	{
+		TKernelSet* ks = &KernelSets[i];
+		if ((ks->BlockSize == Kparams.BlockSize) && (ks->GroupCnt == Kparams.GroupCnt) && (ks->JmpCnt == Kparams.JmpCnt) && (ks->MdLen == Kparams.MdLen) && (ks->StepCnt == Kparams.StepCnt))
+			return ks;
+	}
+	return NULL;
+}
+
 void CallGpuKernelABC(TKparams Kparams)
 {
-	KernelA <<< Kparams.BlockCnt, Kparams.BlockSize, Kparams.KernelA_LDS_Size >>> (Kparams);
-	KernelB <<< Kparams.BlockCnt, Kparams.BlockSize, Kparams.KernelB_LDS_Size >>> (Kparams);
-	KernelC <<< Kparams.BlockCnt, Kparams.BlockSize, Kparams.KernelC_LDS_Size >>> (Kparams);
+	TKernelSet* ks = FindKernelSet(Kparams);
+	ks->KernelA <<< Kparams.BlockCnt, Kparams.BlockSize, Kparams.KernelA_LDS_Size >>> (Kparams);
+	ks->KernelB <<< Kparams.BlockCnt, Kparams.BlockSize, Kparams.KernelB_LDS_Size >>> (Kparams);
+	ks->KernelC <<< Kparams.BlockCnt, Kparams.BlockSize, Kparams.KernelC_LDS_Size >>> (Kparams);
 }
 
 void CallGpuKernelGen(TKparams Kparams)
 {
-	KernelGen << < Kparams.BlockCnt, Kparams.BlockSize, 0 >> > (Kparams);
+	TKernelSet* ks = FindKernelSet(Kparams);
+	ks->KernelGen << < Kparams.BlockCnt, Kparams.BlockSize, 0 >> > (Kparams);
 }
 
 cudaError_t cuSetGpuParams(TKparams Kparams, u64* _jmp2_table)
 {
-	cudaError_t err = cudaFuncSetAttribute(KernelA, cudaFuncAttributeMaxDynamicSharedMemorySize, Kparams.KernelA_LDS_Size);
+	TKernelSet* ks = FindKernelSet(Kparams);
+	if (!ks)
+		return cudaErrorInvalidConfiguration;
+	cudaError_t err = cudaFuncSetAttribute((const void*)ks->KernelA, cudaFuncAttributeMaxDynamicSharedMemorySize, Kparams.KernelA_LDS_Size);
 	if (err != cudaSuccess)
 		return err;
-	err = cudaFuncSetAttribute(KernelB, cudaFuncAttributeMaxDynamicSharedMemorySize, Kparams.KernelB_LDS_Size);
+	err = cudaFuncSetAttribute((const void*)ks->KernelB, cudaFuncAttributeMaxDynamicSharedMemorySize, Kparams.KernelB_LDS_Size);
 	if (err != cudaSuccess)
 		return err;
-	err = cudaFuncSetAttribute(KernelC, cudaFuncAttributeMaxDynamicSharedMemorySize, Kparams.KernelC_LDS_Size);
+	err = cudaFuncSetAttribute((const void*)ks->KernelC, cudaFuncAttributeMaxDynamicSharedMemorySize, Kparams.KernelC_LDS_Size);
 	if (err != cudaSuccess)
 		return err;
-	err = cudaMemcpyToSymbol(jmp2_table, _jmp2_table, JMP_CNT * 64);
+	err = cudaMemcpyToSymbol(jmp2_table, _jmp2_table, Kparams.JmpCnt * 64);
 	if (err != cudaSuccess)
 		return err;
 	return cudaSuccess;
 }
+
+#endif //GPU_EMU
@@ -4,6 +4,26 @@
 // https://github.com/RetiredC
 
 
+#pragma once
+
+//field arithmetic mod P, same code for kernels and host
+//on GPU carry chains are PTX asm, on CPU they are emulated by intrinsics with local carry flag "_cf",
+//so every function that uses carry macros must start with CARRY_DECL
+//code reads u64 words by u32 pointers and back, so host compilers must not use strict aliasing (-fno-strict-aliasing for gcc/clang, MSVC never uses it)
+
+#include <stdlib.h>
+#include "defs.h"
+
+#ifdef __CUDACC__
+	#define FIELD_FUNC		__host__ __device__ __forceinline__
+#else
+	#define FIELD_FUNC		static inline
+#endif
+
+#ifdef __CUDA_ARCH__
+
+#define CARRY_DECL
+
 //PTX asm
 //"volatile" is important
 #define add_64(res, a, b)				asm volatile ("add.u64 %0, %1, %2;" : "=l"(res) : "l"(a), "l"(b)  );
@@ -51,20 +71,90 @@
 #define mul_wide_32(res, a, b)			asm volatile ("mul.wide.u32 %0, %1, %2;" : "=l"(res) : "r"(a), "r"(b));
 #define mad_wide_32(res,a,b,c)			asm volatile ("mad.wide.u32 %0, %1, %2, %3;" : "=l"(res) : "r"(a), "r"(b), "l"(c) );
 
+#define ffs_32(x)						__ffs(x)
+#define fshr_32(lo, hi, sh)				__funnelshift_r((lo), (hi), (sh))
+
 #define st_cs_v4_b32(addr,val)			asm volatile("st.cs.global.v4.b32 [%0], {%1, %2, %3, %4};\n":: "l"(addr), "r"((val).x), "r"((val).y), "r"((val).z), "r"((val).w));
 
+#else
+
+#ifdef _WIN32
+	#include <intrin.h>
+	static inline u64 host_mulhi_64(u64 a, u64 b) { return __umulh(a, b); }
+	static inline int host_ffs_32(u32 x) { unsigned long ind; return _BitScanForward(&ind, x) ? (int)ind + 1 : 0; }
+#else
+	#include <x86intrin.h>
+	static inline u64 host_mulhi_64(u64 a, u64 b) { return (u64)(((unsigned __int128)a * b) >> 64); }
+	static inline int host_ffs_32(u32 x) { return __builtin_ffs((int)x); }
+#endif
+
+//CPU versions, CC.CF flag of PTX is "_cf" variable, 32 and 64-bit ops share it like on GPU
+#define CARRY_DECL						u8 _cf = 0;
+
+#define add_64(res, a, b)				(res) = (u64)(a) + (u64)(b);
+#define add_cc_64(res, a, b)			_cf = _addcarry_u64(0, (a), (b), &(res));
+#define addc_64(res, a, b)				_addcarry_u64(_cf, (a), (b), &(res));
+#define addc_cc_64(res, a, b)			_cf = _addcarry_u64(_cf, (a), (b), &(res));
+
+#define add_32(res, a, b)				(res) = (u32)(a) + (u32)(b);
+#define add_cc_32(res, a, b)			_cf = _addcarry_u32(0, (a), (b), &(res));
+#define addc_32(res, a, b)				_addcarry_u32(_cf, (a), (b), &(res));
+#define addc_cc_32(res, a, b)			_cf = _addcarry_u32(_cf, (a), (b), &(res));
+
+#define sub_64(res, a, b)				(res) = (u64)(a) - (u64)(b);
+#define sub_cc_64(res, a, b)			_cf = _subborrow_u64(0, (a), (b), &(res));
+#define subc_cc_64(res, a, b)			_cf = _subborrow_u64(_cf, (a), (b), &(res));
+#define subc_64(res, a, b)				_subborrow_u64(_cf, (a), (b), &(res));
+
+#define sub_32(res, a, b)				(res) = (u32)(a) - (u32)(b);
+#define sub_cc_32(res, a, b)			_cf = _subborrow_u32(0, (a), (b), &(res));
+#define subc_cc_32(res, a, b)			_cf = _subborrow_u32(_cf, (a), (b), &(res));
+#define subc_32(res, a, b)				_subborrow_u32(_cf, (a), (b), &(res));
+
+#define mul_lo_64(res, a, b)			(res) = (u64)(a) * (u64)(b);
+#define mul_hi_64(res, a, b)			(res) = host_mulhi_64((a), (b));
+#define mad_lo_64(res, a, b, c)			(res) = (u64)(a) * (u64)(b) + (u64)(c);
+#define mad_hi_64(res, a, b, c)			(res) = host_mulhi_64((a), (b)) + (u64)(c);
+#define mad_lo_cc_64(res, a, b, c)		_cf = _addcarry_u64(0, (u64)(a) * (u64)(b), (c), &(res));
+#define mad_hi_cc_64(res, a, b, c)		_cf = _addcarry_u64(0, host_mulhi_64((a), (b)), (c), &(res));
+#define madc_lo_64(res, a, b, c)		_addcarry_u64(_cf, (u64)(a) * (u64)(b), (c), &(res));
+#define madc_hi_64(res, a, b, c)		_addcarry_u64(_cf, host_mulhi_64((a), (b)), (c), &(res));
+#define madc_lo_cc_64(res, a, b, c)		_cf = _addcarry_u64(_cf, (u64)(a) * (u64)(b), (c), &(res));
+#define madc_hi_cc_64(res, a, b, c)		_cf = _addcarry_u64(_cf, host_mulhi_64((a), (b)), (c), &(res));
+
+#define mul_lo_32(res, a, b)			(res) = (u32)(a) * (u32)(b);
+#define mul_hi_32(res, a, b)			(res) = (u32)(((u64)(u32)(a) * (u32)(b)) >> 32);
+#define mad_lo_32(res, a, b, c)			(res) = (u32)(a) * (u32)(b) + (u32)(c);
+#define mad_hi_32(res, a, b, c)			(res) = (u32)(((u64)(u32)(a) * (u32)(b)) >> 32) + (u32)(c);
+#define mad_lo_cc_32(res, a, b, c)		_cf = _addcarry_u32(0, (u32)(a) * (u32)(b), (c), &(res));
+#define mad_hi_cc_32(res, a, b, c)		_cf = _addcarry_u32(0, (u32)(((u64)(u32)(a) * (u32)(b)) >> 32), (c), &(res));
+#define madc_lo_32(res, a, b, c)		_addcarry_u32(_cf, (u32)(a) * (u32)(b), (c), &(res));
+#define madc_hi_32(res, a, b, c)		_addcarry_u32(_cf, (u32)(((u64)(u32)(a) * (u32)(b)) >> 32), (c), &(res));
+#define madc_lo_cc_32(res, a, b, c)		_cf = _addcarry_u32(_cf, (u32)(a) * (u32)(b), (c), &(res));
+#define madc_hi_cc_32(res, a, b, c)		_cf = _addcarry_u32(_cf, (u32)(((u64)(u32)(a) * (u32)(b)) >> 32), (c), &(res));
+
+#define mul_wide_32(res, a, b)			(res) = (u64)(u32)(a) * (u32)(b);
+#define mad_wide_32(res,a,b,c)			(res) = (u64)(u32)(a) * (u32)(b) + (u64)(c);
+
+#define ffs_32(x)						host_ffs_32(x)
+#define fshr_32(lo, hi, sh)				(u32)((((u64)(hi) << 32) | (u32)(lo)) >> (sh))
+
+//kernels emulation on CPU, see GpuEmu.cpp
+#define st_cs_v4_b32(addr,val)			*(addr) = (val);
+
+#endif
 
 //P-related constants
 #define P_0			0xFFFFFFFEFFFFFC2Full
 #define P_123		0xFFFFFFFFFFFFFFFFull
 #define P_INV32		0x000003D1
 
-#define Add192to192(res, val) { \
+#define Add192to192(res, val) { CARRY_DECL \
   add_cc_64((res)[0], (res)[0], (val)[0]); \
   addc_cc_64((res)[1], (res)[1], (val)[1]); \
   addc_64((res)[2], (res)[2], (val)[2]); }
 
-#define Sub192from192(res, val) { \
+#define Sub192from192(res, val) { CARRY_DECL \
   sub_cc_64((res)[0], (res)[0], (val)[0]); \
   subc_cc_64((res)[1], (res)[1], (val)[1]); \
   subc_64((res)[2], (res)[2], (val)[2]); }
@@ -79,16 +169,18 @@
   ((u64*)(dst))[2] = ((u64*)(src))[2]; \
   ((u64*)(dst))[3] = ((u64*)(src))[3]; }
 
-__device__ __forceinline__ void NegModP(u64* res)
+FIELD_FUNC void NegModP(u64* res)
 {
+	CARRY_DECL
 	sub_cc_64(res[0], P_0, res[0]);
 	subc_cc_64(res[1], P_123, res[1]);
 	subc_cc_64(res[2], P_123, res[2]);
 	subc_64(res[3], P_123, res[3]);
 }
 
-__device__ __forceinline__ void SubModP(u64* res, u64* val1, u64* val2)
+FIELD_FUNC void SubModP(u64* res, u64* val1, u64* val2)
 {
+	CARRY_DECL
 	sub_cc_64(res[0], val1[0], val2[0]);
     subc_cc_64(res[1], val1[1], val2[1]);
     subc_cc_64(res[2], val1[2], val2[2]);
@@ -104,8 +196,9 @@ __device__ __forceinline__ void SubModP(u64* res, u64* val1, u64* val2)
     }
 }
 
-__device__ __forceinline__ void AddModP(u64* res, u64* val1, u64* val2)
+FIELD_FUNC void AddModP(u64* res, u64* val1, u64* val2)
 {
+	CARRY_DECL
 	u64 tmp[4];
 	u32 carry;
 	add_cc_64(tmp[0], val1[0], val2[0]);
@@ -125,8 +218,9 @@ __device__ __forceinline__ void AddModP(u64* res, u64* val1, u64* val2)
 		Copy_u64_x4(res, tmp);
 }
 
-__device__ __forceinline__ void add_320_to_256(u64* res, u64* val)
+FIELD_FUNC void add_320_to_256(u64* res, u64* val)
 {
+	CARRY_DECL
 	add_cc_64(res[0], res[0], val[0]);
 	addc_cc_64(res[1], res[1], val[1]);
 	addc_cc_64(res[2], res[2], val[2]);
@@ -135,8 +229,22 @@ __device__ __forceinline__ void add_320_to_256(u64* res, u64* val)
 }
 
 //mul 256bit by 0x1000003D1
-__device__ __forceinline__ void mul_256_by_P0inv(u32* res, u32* val)
+FIELD_FUNC void mul_256_by_P0inv(u32* res, u32* val)
 {
+	CARRY_DECL
+#ifndef __CUDA_ARCH__
+	//CPU has fast 64x64 mul, one 64-bit word is enough
+	mul_lo_64(((u64*)res)[0], ((u64*)val)[0], 0x1000003D1ull);
+	mul_hi_64(((u64*)res)[1], ((u64*)val)[0], 0x1000003D1ull);
+	mad_lo_cc_64(((u64*)res)[1], ((u64*)val)[1], 0x1000003D1ull, ((u64*)res)[1]);
+	u64 h;
+	mul_hi_64(h, ((u64*)val)[1], 0x1000003D1ull);
+	madc_lo_cc_64(((u64*)res)[2], ((u64*)val)[2], 0x1000003D1ull, h);
+	mul_hi_64(h, ((u64*)val)[2], 0x1000003D1ull);
+	madc_lo_cc_64(((u64*)res)[3], ((u64*)val)[3], 0x1000003D1ull, h);
+	mul_hi_64(h, ((u64*)val)[3], 0x1000003D1ull);
+	addc_64(((u64*)res)[4], h, 0ull);
+#else
 	u64 tmp64[7];
 	u32* tmp = (u32*)tmp64;
 	mul_wide_32(*(u64*)res, val[0], P_INV32);
@@ -166,11 +274,26 @@ __device__ __forceinline__ void mul_256_by_P0inv(u32* res, u32* val)
 	addc_cc_32(res[7], res[7], val[6]);
 	addc_cc_32(res[8], res[8], val[7]);
 	addc_32(res[9], 0, 0);
+#endif
 }
 
 //mul 256bit by 64bit
-__device__ __forceinline__ void mul_256_by_64(u64* res, u64* val256, u64 val64)
+FIELD_FUNC void mul_256_by_64(u64* res, u64* val256, u64 val64)
 {
+	CARRY_DECL
+#ifndef __CUDA_ARCH__
+	//CPU has fast 64x64 mul, 4 products instead of 16
+	u64 h0, h1, h2, h3;
+	mul_hi_64(h0, val256[0], val64);
+	mul_hi_64(h1, val256[1], val64);
+	mul_hi_64(h2, val256[2], val64);
+	mul_hi_64(h3, val256[3], val64);
+	mul_lo_64(res[0], val256[0], val64);
+	mad_lo_cc_64(res[1], val256[1], val64, h0);
+	madc_lo_cc_64(res[2], val256[2], val64, h1);
+	madc_lo_cc_64(res[3], val256[3], val64, h2);
+	addc_64(res[4], h3, 0ull);
+#else
 	u64 tmp64[7];
 	u32* tmp = (u32*)tmp64;
 	u32* rs = (u32*)res;
@@ -224,10 +347,12 @@ __device__ __forceinline__ void mul_256_by_64(u64* res, u64* val256, u64 val64)
 	addc_cc_32(rs[7], rs[7], k[6]);
 	addc_cc_32(rs[8], rs[8], k[7]);
 	addc_32(rs[9], k[8], 0);
+#endif
 }
 
-__device__ __forceinline__ void MulModP(u64 *res, u64 *val1, u64 *val2)
+FIELD_FUNC void MulModP(u64 *res, u64 *val1, u64 *val2)
 {
+	CARRY_DECL
 	u64 buff[8], tmp[5], tmp2[2], tmp3;
 //calc 512 bits
 	mul_256_by_64(tmp, val1, val2[1]);
@@ -259,11 +384,24 @@ __device__ __forceinline__ void MulModP(u64 *res, u64 *val1, u64 *val2)
 	add_cc_64(res[0], buff[0], tmp2[0]);
 	addc_cc_64(res[1], buff[1], tmp2[1]);
 	addc_cc_64(res[2], buff[2], 0ull);
+#ifdef __CUDA_ARCH__
 	addc_64(res[3], buff[3], 0ull);
+#else
+	//host needs exact result: carry out of res[3] is 2^256 = 0x1000003D1 mod P, low part is small then so it cannot carry again
+	addc_cc_64(res[3], buff[3], 0ull);
+	if (_cf)
+	{
+		add_cc_64(res[0], res[0], 0x1000003D1ull);
+		addc_cc_64(res[1], res[1], 0ull);
+		addc_cc_64(res[2], res[2], 0ull);
+		addc_64(res[3], res[3], 0ull);
+	}
+#endif
 }
 
-__device__ __forceinline__ void add_320_to_256s(u32* res, u64 _v1, u64 _v2, u64 _v3, u64 _v4, u64 _v5, u64 _v6, u64 _v7, u64 _v8)
+FIELD_FUNC void add_320_to_256s(u32* res, u64 _v1, u64 _v2, u64 _v3, u64 _v4, u64 _v5, u64 _v6, u64 _v7, u64 _v8)
 {
+	CARRY_DECL
 	u32* v1 = (u32*)&_v1;
 	u32* v2 = (u32*)&_v2;
 	u32* v3 = (u32*)&_v3;
@@ -294,8 +432,13 @@ __device__ __forceinline__ void add_320_to_256s(u32* res, u64 _v1, u64 _v2, u64
 	addc_32(res[9], 0, 0);
 }
 
-__device__ __forceinline__ void SqrModP(u64* res, u64* val)
+FIELD_FUNC void SqrModP(u64* res, u64* val)
 {
+#ifndef __CUDA_ARCH__
+	//on CPU 64-bit mul is faster than 28 32-bit products
+	MulModP(res, val, val);
+#else
+	CARRY_DECL
 	u64 buff[8], tmp[5], tmp2[2], tmp3, mm;
 	u32* a = (u32*)val;
 	u64 mar[28];
@@ -379,10 +522,12 @@ __device__ __forceinline__ void SqrModP(u64* res, u64* val)
 	addc_cc_64(res[1], buff[1], tmp2[1]);
 	addc_cc_64(res[2], buff[2], 0ull);
 	addc_64(res[3], buff[3], 0ull);
+#endif
 }
 
-__device__ __forceinline__ void add_288(u32* res, u32* val1, u32* val2)
+FIELD_FUNC void add_288(u32* res, u32* val1, u32* val2)
 {
+	CARRY_DECL
 	add_cc_32(res[0], val1[0], val2[0]);
 	addc_cc_32(res[1], val1[1], val2[1]);
 	addc_cc_32(res[2], val1[2], val2[2]);
@@ -394,8 +539,9 @@ __device__ __forceinline__ void add_288(u32* res, u32* val1, u32* val2)
 	addc_32(res[8], val1[8], val2[8]);
 }
 
-__device__ __forceinline__ void neg_288(u32* res)
+FIELD_FUNC void neg_288(u32* res)
 {
+	CARRY_DECL
 	sub_cc_32(res[0], 0, res[0]);
 	subc_cc_32(res[1], 0, res[1]);
 	subc_cc_32(res[2], 0, res[2]);
@@ -407,8 +553,9 @@ __device__ __forceinline__ void neg_288(u32* res)
 	subc_32(res[8], 0, res[8]);
 }
 
-__device__ __forceinline__ void mul_288_by_i32(u32* res, u32* val288, int ival32)
+FIELD_FUNC void mul_288_by_i32(u32* res, u32* val288, int ival32)
 {
+	CARRY_DECL
 	u32 val32 = abs(ival32);
 	u64 tmp64[4];
 	u32* tmp = (u32*)tmp64;
@@ -435,7 +582,7 @@ __device__ __forceinline__ void mul_288_by_i32(u32* res, u32* val288, int ival32
 		neg_288(res);
 }
 
-__device__ __forceinline__ void set_288_i32(u32* res, int val)
+FIELD_FUNC void set_288_i32(u32* res, int val)
 {
 	res[0] = val;
 	res[1] = (val < 0) ? 0xFFFFFFFF : 0;
@@ -449,9 +596,10 @@ __device__ __forceinline__ void set_288_i32(u32* res, int val)
 }
 
 //mul P by 32bit, get 288bit result
-__device__ __forceinline__ void mul_P_by_32(u32* res, u32 val)
+FIELD_FUNC void mul_P_by_32(u32* res, u32 val)
 {
-	__align__(8) u32 tmp[3];
+	CARRY_DECL
+	alignas(8) u32 tmp[3];
 	mul_wide_32(*(u64*)tmp, val, P_INV32);
 	add_cc_32(tmp[1], tmp[1], val);
 	addc_32(tmp[2], 0, 0);
@@ -467,21 +615,22 @@ __device__ __forceinline__ void mul_P_by_32(u32* res, u32 val)
 	subc_32(res[8], val, 0);
 }
 
-__device__ __forceinline__ void shiftR_288_by_30(u32* res)
+FIELD_FUNC void shiftR_288_by_30(u32* res)
 {
-	res[0] = __funnelshift_r(res[0], res[1], 30);
-	res[1] = __funnelshift_r(res[1], res[2], 30);
-	res[2] = __funnelshift_r(res[2], res[3], 30);
-	res[3] = __funnelshift_r(res[3], res[4], 30);
-	res[4] = __funnelshift_r(res[4], res[5], 30);
-	res[5] = __funnelshift_r(res[5], res[6], 30);
-	res[6] = __funnelshift_r(res[6], res[7], 30);
-	res[7] = __funnelshift_r(res[7], res[8], 30);
+	res[0] = fshr_32(res[0], res[1], 30);
+	res[1] = fshr_32(res[1], res[2], 30);
+	res[2] = fshr_32(res[2], res[3], 30);
+	res[3] = fshr_32(res[3], res[4], 30);
+	res[4] = fshr_32(res[4], res[5], 30);
+	res[5] = fshr_32(res[5], res[6], 30);
+	res[6] = fshr_32(res[6], res[7], 30);
+	res[7] = fshr_32(res[7], res[8], 30);
 	res[8] = ((int)res[8]) >> 30;
 }
 
-__device__ __forceinline__ void add_288_P(u32* res)
+FIELD_FUNC void add_288_P(u32* res)
 {
+	CARRY_DECL
 	add_cc_32(res[0], res[0], 0xFFFFFC2F);
 	addc_cc_32(res[1], res[1], 0xFFFFFFFE);
 	addc_cc_32(res[2], res[2], 0xFFFFFFFF);
@@ -493,8 +642,9 @@ __device__ __forceinline__ void add_288_P(u32* res)
 	addc_32(res[8], res[8], 0);
 }
 
-__device__ __forceinline__ void sub_288_P(u32* res)
+FIELD_FUNC void sub_288_P(u32* res)
 {
+	CARRY_DECL
 	sub_cc_32(res[0], res[0], 0xFFFFFC2F);
 	subc_cc_32(res[1], res[1], 0xFFFFFFFE);
 	subc_cc_32(res[2], res[2], 0xFFFFFFFF);
@@ -513,13 +663,13 @@ __device__ __forceinline__ void sub_288_P(u32* res)
 // https://tches.iacr.org/index.php/TCHES/article/download/8298/7648/4494
 //a bit tricky
 //res must be at least 288bits
-__device__ __forceinline__ void InvModP(u32* res)
+FIELD_FUNC void InvModP(u32* res)
 {
 	int matrix[4], _val, _modp, index, cnt, mx, kbnt;
-	__align__(8) u32 modp[9];
-	__align__(8) u32 val[9];
-	__align__(8) u32 a[9];
-	__align__(8) u32 tmp[4][9];
+	alignas(8) u32 modp[9];
+	alignas(8) u32 val[9];
+	alignas(8) u32 a[9];
+	alignas(8) u32 tmp[4][9];
 
 	((u64*)modp)[0] = P_0;
 	((u64*)modp)[1] = P_123;
@@ -535,7 +685,7 @@ __device__ __forceinline__ void InvModP(u32* res)
 	kbnt = -1;
 	_val = (int)res[0];
 	_modp = (int)P_0;
-	index = __ffs(_val | 0x40000000) - 1;
+	index = ffs_32(_val | 0x40000000) - 1;
 	APPLY_DIV_SHIFT();
 	cnt = 30 - index;
 	while (cnt > 0)
@@ -548,7 +698,7 @@ __device__ __forceinline__ void InvModP(u32* res)
 		_val += _modp * mul;
 		matrix[2] += matrix[0] * mul;
 		matrix[3] += matrix[1] * mul;
-		index = __ffs(_val | (1 << cnt)) - 1;
+		index = ffs_32(_val | (1 << cnt)) - 1;
 		APPLY_DIV_SHIFT();
 		cnt -= index;
 	}
@@ -574,7 +724,7 @@ __device__ __forceinline__ void InvModP(u32* res)
 		matrix[1] = matrix[2] = 0;
 		_val = val[0];
 		_modp = modp[0];
-		index = __ffs(_val | 0x40000000) - 1;
+		index = ffs_32(_val | 0x40000000) - 1;
 		APPLY_DIV_SHIFT();
 		cnt = 30 - index;
 		while (cnt > 0)
@@ -587,7 +737,7 @@ __device__ __forceinline__ void InvModP(u32* res)
 			_val += _modp * mul;
 			matrix[2] += matrix[0] * mul;
 			matrix[3] += matrix[1] * mul;
-			index = __ffs(_val | (1 << cnt)) - 1;
+			index = ffs_32(_val | (1 << cnt)) - 1;
 			APPLY_DIV_SHIFT();
 			cnt -= index;
 		}
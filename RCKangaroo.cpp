@@ -6,496 +6,89 @@
 
 #include <iostream>
 #include <vector>
-
-#include "cuda_runtime.h"
-#include "cuda.h"
+#include <string>
 
 #include "defs.h"
 #include "utils.h"
-#include "GpuKang.h"
-
-
-EcJMP EcJumps1[JMP_CNT];
-EcJMP EcJumps2[JMP_CNT];
-EcJMP EcJumps3[JMP_CNT];
-
-RCGpuKang* GpuKangs[MAX_GPU_CNT];
-int GpuCnt;
-volatile long ThrCnt;
-volatile bool gSolved;
-
-EcInt Int_HalfRange;
-EcPoint Pnt_HalfRange;
-EcPoint Pnt_NegHalfRange;
-EcInt Int_TameOffset;
-Ec ec;
+#include "Solver.h"
+#include "Tuner.h"
+#include "Autotune.h"
+#include "GpuEmu.h"
+#include "ThreadPool.h"
 
-CriticalSection csAddPoints;
-u8* pPntList;
-u8* pPntList2;
-volatile int PntIndex;
-TFastBase db;
-EcPoint gPntToSolve;
-EcInt gPrivKey;
 
-volatile u64 TotalOps;
-u32 TotalSolved;
-u32 gTotalErrors;
-u64 PntTotalOps;
-bool IsBench;
-
-u32 gDP;
-u32 gRange;
-EcInt gStart;
+TSolveParams gParams;
 bool gStartSet;
-EcPoint gPubKey;
+std::vector <EcPoint> gPubKeys; //points to solve in main mode
 u8 gGPUs_Mask[MAX_GPU_CNT];
-char gTamesFileName[1024];
-double gMax;
 bool gGenMode; //tames generation mode
-bool gIsOpsLimit;
-
-#pragma pack(push, 1)
-struct DBRec
-{
-	u8 x[12];
-	u8 d[22];
-	u8 type; //0 - tame, 1 - wild1, 2 - wild2
-};
-#pragma pack(pop)
-
-void InitGpus()
-{
-	GpuCnt = 0;
-	int gcnt = 0;
-	cudaGetDeviceCount(&gcnt);
-	if (gcnt > MAX_GPU_CNT)
-		gcnt = MAX_GPU_CNT;
-
-//	gcnt = 1; //dbg
-	if (!gcnt)
-		return;
-
-	int drv, rt;
-	cudaRuntimeGetVersion(&rt);
-	cudaDriverGetVersion(&drv);
-	char drvver[100];
-	sprintf(drvver, "%d.%d/%d.%d", drv / 1000, (drv % 100) / 10, rt / 1000, (rt % 100) / 10);
-
-	printf("CUDA devices: %d, CUDA driver/runtime: %s\r\n", gcnt, drvver);
-	cudaError_t cudaStatus;
-	for (int i = 0; i < gcnt; i++)
-	{
-		cudaStatus = cudaSetDevice(i);
-		if (cudaStatus != cudaSuccess)
-		{
-			printf("cudaSetDevice for gpu %d failed!\r\n", i);
-			continue;
-		}
-
-		if (!gGPUs_Mask[i])
-			continue;
-
-		cudaDeviceProp deviceProp;
-		cudaGetDeviceProperties(&deviceProp, i);
-		printf("GPU %d: %s, %.2f GB, %d CUs, cap %d.%d, PCI %d, L2 size: %d KB\r\n", i, deviceProp.name, ((float)(deviceProp.totalGlobalMem / (1024 * 1024))) / 1024.0f, deviceProp.multiProcessorCount, deviceProp.major, deviceProp.minor, deviceProp.pciBusID, deviceProp.l2CacheSize / 1024);
-		
-		if (deviceProp.major < 6)
-		{
-			printf("GPU %d - not supported, skip\r\n", i);
-			continue;
-		}
-
-		cudaSetDeviceFlags(cudaDeviceScheduleBlockingSync);
-
-		GpuKangs[GpuCnt] = new RCGpuKang();
-		GpuKangs[GpuCnt]->CudaIndex = i;
-		GpuKangs[GpuCnt]->persistingL2CacheMaxSize = deviceProp.persistingL2CacheMaxSize;
-		GpuKangs[GpuCnt]->mpCnt = deviceProp.multiProcessorCount;
-		GpuKangs[GpuCnt]->IsOldGpu = deviceProp.l2CacheSize < 16 * 1024 * 1024;
-		GpuCnt++;
-	}
-	printf("Total GPUs for work: %d\r\n", GpuCnt);
-}
-#ifdef _WIN32
-u32 __stdcall kang_thr_proc(void* data)
-{
-	RCGpuKang* Kang = (RCGpuKang*)data;
-	Kang->Execute();
-	InterlockedDecrement(&ThrCnt);
-	return 0;
-}
-#else
-void* kang_thr_proc(void* data)
-{
-	RCGpuKang* Kang = (RCGpuKang*)data;
-	Kang->Execute();
-	__sync_fetch_and_sub(&ThrCnt, 1);
-	return 0;
-}
-#endif
-void AddPointsToList(u32* data, int pnt_cnt, u64 ops_cnt)
-{
-	csAddPoints.Enter();
-	if (PntIndex + pnt_cnt >= MAX_CNT_LIST)
-	{
-		csAddPoints.Leave();
-		printf("DPs buffer overflow, some points lost, increase DP value!\r\n");
-		return;
-	}
-	memcpy(pPntList + GPU_DP_SIZE * PntIndex, data, pnt_cnt * GPU_DP_SIZE);
-	PntIndex += pnt_cnt;
-	PntTotalOps += ops_cnt;
-	csAddPoints.Leave();
-}
-
-bool Collision_SOTA(EcPoint& pnt, EcInt t, int TameType, EcInt w, int WildType, bool IsNeg)
-{
-	if (IsNeg)
-		t.Neg();
-	if (TameType == TAME)
-	{
-		gPrivKey = t;
-		gPrivKey.Sub(w);
-		EcInt sv = gPrivKey;
-		gPrivKey.Add(Int_HalfRange);
-		EcPoint P = ec.MultiplyG(gPrivKey);
-		if (P.IsEqual(pnt))
-			return true;
-		gPrivKey = sv;
-		gPrivKey.Neg();
-		gPrivKey.Add(Int_HalfRange);
-		P = ec.MultiplyG(gPrivKey);
-		return P.IsEqual(pnt);
-	}
-	else
-	{
-		gPrivKey = t;
-		gPrivKey.Sub(w);
-		if (gPrivKey.data[4] >> 63)
-			gPrivKey.Neg();
-		gPrivKey.ShiftRight(1);
-		EcInt sv = gPrivKey;
-		gPrivKey.Add(Int_HalfRange);
-		EcPoint P = ec.MultiplyG(gPrivKey);
-		if (P.IsEqual(pnt))
-			return true;
-		gPrivKey = sv;
-		gPrivKey.Neg();
-		gPrivKey.Add(Int_HalfRange);
-		P = ec.MultiplyG(gPrivKey);
-		return P.IsEqual(pnt);
-	}
-}
-
-
-void CheckNewPoints()
+char gTuneFileName[1024]; //jumps tuning mode, profile to save
+int gTuneKangs;
+int gTuneSolves;
+int gEmuCalls; //kernels emulation check mode, number of kernel calls
+bool gEcBench; //host EC primitives benchmark mode
+TWalkCfg gWalkCfg; //walk config from command line, zero fields - default for GPU
+bool gAutotune; //autotune mode, saves machine profile
+TMachineProfile gMachineProfile;
+
+//shows the key and saves it to RESULTS.TXT
+void OnKeyFound(int pnt_ind, EcInt& key, void* ctx)
 {
-	csAddPoints.Enter();
-	if (!PntIndex)
+	char s[100];
+	key.GetHexStr(s);
+	printf("\r\nPRIVATE KEY: %s\r\n\r\n", s);
+	FILE* fp = fopen("RESULTS.TXT", "a");
+	if (fp)
 	{
-		csAddPoints.Leave();
-		return;
+		fprintf(fp, "PRIVATE KEY: %s\n", s);
+		fclose(fp);
 	}
-
-	int cnt = PntIndex;
-	memcpy(pPntList2, pPntList, GPU_DP_SIZE * cnt);
-	PntIndex = 0;
-	csAddPoints.Leave();
-
-	for (int i = 0; i < cnt; i++)
+	else //we cannot save the key, show error and wait forever so the key is displayed
 	{
-		DBRec nrec;
-		u8* p = pPntList2 + i * GPU_DP_SIZE;
-		memcpy(nrec.x, p, 12);
-		memcpy(nrec.d, p + 16, 22);
-		nrec.type = gGenMode ? TAME : p[40];
-
-		DBRec* pref = (DBRec*)db.FindOrAddDataBlock((u8*)&nrec);
-		if (gGenMode)
-			continue;
-		if (pref)
-		{
-			//in db we dont store first 3 bytes so restore them
-			DBRec tmp_pref;
-			memcpy(&tmp_pref, &nrec, 3);
-			memcpy(((u8*)&tmp_pref) + 3, pref, sizeof(DBRec) - 3);
-			pref = &tmp_pref;
-
-			if (pref->type == nrec.type)
-			{
-				if (pref->type == TAME)
-					continue;
-
-				//if it's wild, we can find the key from the same type if distances are different
-				if (*(u64*)pref->d == *(u64*)nrec.d)
-					continue;
-				//else
-				//	ToLog("key found by same wild");
-			}
-
-			EcInt w, t;
-			int TameType, WildType;
-			if (pref->type != TAME)
-			{
-				memcpy(w.data, pref->d, sizeof(pref->d));
-				if (pref->d[21] == 0xFF) memset(((u8*)w.data) + 22, 0xFF, 18);
-				memcpy(t.data, nrec.d, sizeof(nrec.d));
-				if (nrec.d[21] == 0xFF) memset(((u8*)t.data) + 22, 0xFF, 18);
-				TameType = nrec.type;
-				WildType = pref->type;
-			}
-			else
-			{
-				memcpy(w.data, nrec.d, sizeof(nrec.d));
-				if (nrec.d[21] == 0xFF) memset(((u8*)w.data) + 22, 0xFF, 18);
-				memcpy(t.data, pref->d, sizeof(pref->d));
-				if (pref->d[21] == 0xFF) memset(((u8*)t.data) + 22, 0xFF, 18);
-				TameType = TAME;
-				WildType = nrec.type;
-			}
-
-			bool res = Collision_SOTA(gPntToSolve, t, TameType, w, WildType, false) || Collision_SOTA(gPntToSolve, t, TameType, w, WildType, true);
-			if (!res)
-			{
-				bool w12 = ((pref->type == WILD1) && (nrec.type == WILD2)) || ((pref->type == WILD2) && (nrec.type == WILD1));
-				if (w12) //in rare cases WILD and WILD2 can collide in mirror, in this case there is no way to find K
-					;// ToLog("W1 and W2 collides in mirror");
-				else
-				{
-					printf("Collision Error\r\n");
-					gTotalErrors++;
-				}
-				continue;
-			}
-			gSolved = true;
-			break;
-		}
-	}
-}
-
-void ShowStats(u64 tm_start, double exp_ops, double dp_val)
-{
-#ifdef DEBUG_MODE
-	for (int i = 0; i <= MD_LEN; i++)
-	{
-		u64 val = 0;
-		for (int j = 0; j < GpuCnt; j++)
-		{
-			val += GpuKangs[j]->dbg[i];
-		}
-		if (val)
-			printf("Loop size %d: %llu\r\n", i, val);
+		printf("WARNING: Cannot save the key to RESULTS.TXT!\r\n");
+		while (1)
+			Sleep(100);
 	}
-#endif
-
-	int speed = GpuKangs[0]->GetStatsSpeed();
-	for (int i = 1; i < GpuCnt; i++)
-		speed += GpuKangs[i]->GetStatsSpeed();
-
-	u64 est_dps_cnt = (u64)(exp_ops / dp_val);
-	u64 exp_sec = 0xFFFFFFFFFFFFFFFFull;
-	if (speed)
-		exp_sec = (u64)((exp_ops / 1000000) / speed); //in sec
-	u64 exp_days = exp_sec / (3600 * 24);
-	int exp_hours = (int)(exp_sec - exp_days * (3600 * 24)) / 3600;
-	int exp_min = (int)(exp_sec - exp_days * (3600 * 24) - exp_hours * 3600) / 60;
-
-	u64 sec = (GetTickCount64() - tm_start) / 1000;
-	u64 days = sec / (3600 * 24);
-	int hours = (int)(sec - days * (3600 * 24)) / 3600;
-	int min = (int)(sec - days * (3600 * 24) - hours * 3600) / 60;
-	 
-	printf("%sSpeed: %d MKeys/s, Err: %d, DPs: %lluK/%lluK, Time: %llud:%02dh:%02dm/%llud:%02dh:%02dm\r\n", gGenMode ? "GEN: " : (IsBench ? "BENCH: " : "MAIN: "), speed, gTotalErrors, db.GetBlockCnt()/1000, est_dps_cnt/1000, days, hours, min, exp_days, exp_hours, exp_min);
 }
 
-bool SolvePoint(EcPoint PntToSolve, int Range, int DP, EcInt* pk_res)
+//text file, one public key per line
+bool LoadPubKeys(char* fn)
 {
-	if ((Range < 32) || (Range > 180))
-	{
-		printf("Unsupported Range value (%d)!\r\n", Range);
-		return false;
-	}
-	if ((DP < 14) || (DP > 60)) 
+	FILE* fp = fopen(fn, "rb");
+	if (!fp)
 	{
-		printf("Unsupported DP value (%d)!\r\n", DP);
+		printf("error: cannot open file %s\r\n", fn);
 		return false;
 	}
-
-	printf("\r\nSolving point: Range %d bits, DP %d, start...\r\n", Range, DP);
-	double ops = 1.15 * pow(2.0, Range / 2.0);
-	double dp_val = (double)(1ull << DP);
-	double ram = (32 + 4 + 4) * ops / dp_val; //+4 for grow allocation and memory fragmentation
-	ram += sizeof(TListRec) * 256 * 256 * 256; //3byte-prefix table
-	ram /= (1024 * 1024 * 1024); //GB
-	printf("SOTA method, estimated ops: 2^%.3f, RAM for DPs: %.3f GB. DP and GPU overheads not included!\r\n", log2(ops), ram);
-	gIsOpsLimit = false;
-	double MaxTotalOps = 0.0;
-	if (gMax > 0)
-	{
-		MaxTotalOps = gMax * ops;
-		double ram_max = (32 + 4 + 4) * MaxTotalOps / dp_val; //+4 for grow allocation and memory fragmentation
-		ram_max += sizeof(TListRec) * 256 * 256 * 256; //3byte-prefix table
-		ram_max /= (1024 * 1024 * 1024); //GB
-		printf("Max allowed number of ops: 2^%.3f, max RAM for DPs: %.3f GB\r\n", log2(MaxTotalOps), ram_max);
-	}
-
-	u64 total_kangs = GpuKangs[0]->CalcKangCnt();
-	for (int i = 1; i < GpuCnt; i++)
-		total_kangs += GpuKangs[i]->CalcKangCnt();
-	double path_single_kang = ops / total_kangs;	
-	double DPs_per_kang = path_single_kang / dp_val;
-	printf("Estimated DPs per kangaroo: %.3f.%s\r\n", DPs_per_kang, (DPs_per_kang < 5) ? " DP overhead is big, use less DP value if possible!" : "");
-
-	if (!gGenMode && gTamesFileName[0])
-	{
-		printf("load tames...\r\n");
-		if (db.LoadFromFile(gTamesFileName))
-		{
-			printf("tames loaded\r\n");
-			if (db.Header[0] != gRange)
-			{
-				printf("loaded tames have different range, they cannot be used, clear\r\n");
-				db.Clear();
-			}
-		}
-		else
-			printf("tames loading failed\r\n");
-	}
-
-	SetRndSeed(0); //use same seed to make tames from file compatible
-	PntTotalOps = 0;
-	PntIndex = 0;
-//prepare jumps
-	EcInt minjump, t;
-	minjump.Set(1);
-	minjump.ShiftLeft(Range / 2 + 3);
-	for (int i = 0; i < JMP_CNT; i++)
-	{
-		EcJumps1[i].dist = minjump;
-		t.RndMax(minjump);
-		EcJumps1[i].dist.Add(t);
-		EcJumps1[i].dist.data[0] &= 0xFFFFFFFFFFFFFFFE; //must be even
-		EcJumps1[i].p = ec.MultiplyG(EcJumps1[i].dist);
-	}
-
-	minjump.Set(1);
-	minjump.ShiftLeft(Range - 10); //large jumps for L1S2 loops. Must be almost RANGE_BITS
-	for (int i = 0; i < JMP_CNT; i++)
+	char line[1024];
+	int line_ind = 0;
+	std::vector <std::string> keys;
+	std::vector <int> line_inds;
+	while (fgets(line, sizeof(line), fp))
 	{
-		EcJumps2[i].dist = minjump;
-		t.RndMax(minjump);
-		EcJumps2[i].dist.Add(t);
-		EcJumps2[i].dist.data[0] &= 0xFFFFFFFFFFFFFFFE; //must be even
-		EcJumps2[i].p = ec.MultiplyG(EcJumps2[i].dist);
-	}
-
-	minjump.Set(1);
-	minjump.ShiftLeft(Range - 10 - 2); //large jumps for loops >2
-	for (int i = 0; i < JMP_CNT; i++)
-	{
-		EcJumps3[i].dist = minjump;
-		t.RndMax(minjump);
-		EcJumps3[i].dist.Add(t);
-		EcJumps3[i].dist.data[0] &= 0xFFFFFFFFFFFFFFFE; //must be even
-		EcJumps3[i].p = ec.MultiplyG(EcJumps3[i].dist);
-	}
-	SetRndSeed(GetTickCount64());
-
-	Int_HalfRange.Set(1);
-	Int_HalfRange.ShiftLeft(Range - 1);
-	Pnt_HalfRange = ec.MultiplyG(Int_HalfRange);
-	Pnt_NegHalfRange = Pnt_HalfRange;
-	Pnt_NegHalfRange.y.NegModP();
-	Int_TameOffset.Set(1);
-	Int_TameOffset.ShiftLeft(Range - 1);
-	EcInt tt;
-	tt.Set(1);
-	tt.ShiftLeft(Range - 5); //half of tame range width
-	Int_TameOffset.Sub(tt);
-	gPntToSolve = PntToSolve;
-
-//prepare GPUs
-	for (int i = 0; i < GpuCnt; i++)
-		if (!GpuKangs[i]->Prepare(PntToSolve, Range, DP, EcJumps1, EcJumps2, EcJumps3))
-		{
-			GpuKangs[i]->Failed = true;
-			printf("GPU %d Prepare failed\r\n", GpuKangs[i]->CudaIndex);
-		}
-
-	u64 tm0 = GetTickCount64();
-	printf("GPUs started...\r\n");
-
-#ifdef _WIN32
-	HANDLE thr_handles[MAX_GPU_CNT];
-#else
-	pthread_t thr_handles[MAX_GPU_CNT];
-#endif
-
-	u32 ThreadID;
-	gSolved = false;
-	ThrCnt = GpuCnt;
-	for (int i = 0; i < GpuCnt; i++)
-	{
-#ifdef _WIN32
-		thr_handles[i] = (HANDLE)_beginthreadex(NULL, 0, kang_thr_proc, (void*)GpuKangs[i], 0, &ThreadID);
-#else
-		pthread_create(&thr_handles[i], NULL, kang_thr_proc, (void*)GpuKangs[i]);
-#endif
-	}
-
-	u64 tm_stats = GetTickCount64();
-	while (!gSolved)
-	{
-		CheckNewPoints();
-		Sleep(10);
-		if (GetTickCount64() - tm_stats > 10 * 1000)
-		{
-			ShowStats(tm0, ops, dp_val);
-			tm_stats = GetTickCount64();
-		}
-
-		if ((MaxTotalOps > 0.0) && (PntTotalOps > MaxTotalOps))
-		{
-			gIsOpsLimit = true;
-			printf("Operations limit reached\r\n");
-			break;
-		}
-	}
-
-	printf("Stopping work ...\r\n");
-	for (int i = 0; i < GpuCnt; i++)
-		GpuKangs[i]->Stop();
-	while (ThrCnt)
-		Sleep(10);
-	for (int i = 0; i < GpuCnt; i++)
-	{
-#ifdef _WIN32
-		CloseHandle(thr_handles[i]);
-#else
-		pthread_join(thr_handles[i], NULL);
-#endif
+		line_ind++;
+		int len = (int)strlen(line);
+		while (len && ((line[len - 1] == '\r') || (line[len - 1] == '\n') || (line[len - 1] == ' ') || (line[len - 1] == '\t')))
+			line[--len] = 0;
+		if (!len)
+			continue;
+		keys.push_back(line);
+		line_inds.push_back(line_ind);
 	}
-
-	if (gIsOpsLimit)
+	fclose(fp);
+	//decompression of compressed keys is the slow part, do it on all CPUs
+	int cnt = (int)keys.size();
+	std::vector <char*> strs(cnt);
+	for (int i = 0; i < cnt; i++)
+		strs[i] = (char*)keys[i].c_str();
+	std::vector <EcPoint> pnts(cnt);
+	int bad = ParsePubKeys(strs.data(), cnt, pnts.data(), 0);
+	if (bad >= 0)
 	{
-		if (gGenMode)
-		{
-			printf("saving tames...\r\n");
-			db.Header[0] = gRange; 
-			if (db.SaveToFile(gTamesFileName))
-				printf("tames saved\r\n");
-			else
-				printf("tames saving failed\r\n");
-		}
-		db.Clear();
+		printf("error: invalid public key in line %d of %s\r\n", line_inds[bad], fn);
 		return false;
 	}
-
-	double K = (double)PntTotalOps / pow(2.0, Range / 2.0);
-	printf("Point solved, K: %.3f (with DP and GPU overheads)\r\n\r\n", K);
-	db.Clear();
-	*pk_res = gPrivKey;
+	gPubKeys.insert(gPubKeys.end(), pnts.begin(), pnts.end());
 	return true;
 }
 
@@ -529,14 +122,14 @@ bool ParseCommandLine(int argc, char* argv[])
 		else
 		if (strcmp(argument, "-dp") == 0)
 		{
-			int val = atoi(argv[ci]);
+			double val = atof(argv[ci]);
 			ci++;
 			if ((val < 14) || (val > 60))
 			{
 				printf("error: invalid value for -dp option\r\n");
 				return false;
 			}
-			gDP = val;
+			gParams.DP = val;
 		}
 		else
 		if (strcmp(argument, "-range") == 0)
@@ -548,12 +141,12 @@ bool ParseCommandLine(int argc, char* argv[])
 				printf("error: invalid value for -range option\r\n");
 				return false;
 			}
-			gRange = val;
+			gParams.Range = val;
 		}
 		else
 		if (strcmp(argument, "-start") == 0)
 		{	
-			if (!gStart.SetHexStr(argv[ci]))
+			if (!gParams.Start.SetHexStr(argv[ci]))
 			{
 				printf("error: invalid value for -start option\r\n");
 				return false;
@@ -564,17 +157,44 @@ bool ParseCommandLine(int argc, char* argv[])
 		else
 		if (strcmp(argument, "-pubkey") == 0)
 		{
-			if (!gPubKey.SetHexStr(argv[ci]))
+			EcPoint pnt;
+			if (!pnt.SetHexStr(argv[ci]))
 			{
 				printf("error: invalid value for -pubkey option\r\n");
 				return false;
 			}
 			ci++;
+			gPubKeys.push_back(pnt);
+		}
+		else
+		if (strcmp(argument, "-pubkeys") == 0)
+		{
+			if (!LoadPubKeys(argv[ci]))
+				return false;
+			ci++;
+		}
+		else
+		if (strcmp(argument, "-engine") == 0)
+		{
+			if (strcmp(argv[ci], "auto") == 0)
+				gParams.Engine = ENGINE_AUTO;
+			else
+			if (strcmp(argv[ci], "kang") == 0)
+				gParams.Engine = ENGINE_KANG;
+			else
+			if (strcmp(argv[ci], "bsgs") == 0)
+				gParams.Engine = ENGINE_BSGS;
+			else
+			{
+				printf("error: invalid value for -engine option\r\n");
+				return false;
+			}
+			ci++;
 		}
 		else
 		if (strcmp(argument, "-tames") == 0)
 		{
-			strcpy(gTamesFileName, argv[ci]);
+			strcpy(gParams.TamesFileName, argv[ci]);
 			ci++;
 		}
 		else
@@ -587,7 +207,149 @@ bool ParseCommandLine(int argc, char* argv[])
 				printf("error: invalid value for -max option\r\n");
 				return false;
 			}
-			gMax = val;
+			gParams.Max = val;
+		}
+		else
+		if (strcmp(argument, "-ram") == 0)
+		{
+			double val = atof(argv[ci]);
+			ci++;
+			if (val < 0.5)
+			{
+				printf("error: invalid value for -ram option\r\n");
+				return false;
+			}
+			gParams.RamLimit = val;
+		}
+		else
+		if (strcmp(argument, "-herd") == 0)
+		{
+			double t = 0, w1 = 0, w2 = 0;
+			if ((sscanf(argv[ci], "%lf:%lf:%lf", &t, &w1, &w2) != 3) || (t < 0) || (w1 < 0) || (w2 < 0) || (t + w1 + w2 <= 0))
+			{
+				printf("error: invalid value for -herd option\r\n");
+				return false;
+			}
+			ci++;
+			gParams.Herd[TAME] = t;
+			gParams.Herd[WILD1] = w1;
+			gParams.Herd[WILD2] = w2;
+		}
+		else
+		if (strcmp(argument, "-jmpprofile") == 0)
+		{
+			strcpy(gParams.JmpProfileName, argv[ci]);
+			ci++;
+		}
+		else
+		if (strcmp(argument, "-tune") == 0)
+		{
+			strcpy(gTuneFileName, argv[ci]);
+			ci++;
+		}
+		else
+		if (strcmp(argument, "-tunekangs") == 0)
+		{
+			int val = atoi(argv[ci]);
+			ci++;
+			if ((val < 16) || (val > 1024 * 1024))
+			{
+				printf("error: invalid value for -tunekangs option\r\n");
+				return false;
+			}
+			gTuneKangs = val;
+		}
+		else
+		if (strcmp(argument, "-tunesolves") == 0)
+		{
+			int val = atoi(argv[ci]);
+			ci++;
+			if (val < 1)
+			{
+				printf("error: invalid value for -tunesolves option\r\n");
+				return false;
+			}
+			gTuneSolves = val;
+		}
+		else
+		if (strcmp(argument, "-emucheck") == 0)
+		{
+			int val = atoi(argv[ci]);
+			ci++;
+			if (val < 1)
+			{
+				printf("error: invalid value for -emucheck option\r\n");
+				return false;
+			}
+			gEmuCalls = val;
+		}
+		else
+		if (strcmp(argument, "-ecbench") == 0)
+		{
+			gEcBench = true;
+		}
+		else
+		if (strcmp(argument, "-cfg") == 0)
+		{
+			u32 v[5];
+			if (sscanf(argv[ci], "%u:%u:%u:%u:%u", &v[0], &v[1], &v[2], &v[3], &v[4]) != 5)
+			{
+				printf("error: invalid value for -cfg option\r\n");
+				PrintWalkCfgs();
+				return false;
+			}
+			ci++;
+			gWalkCfg.BlockSize = v[0];
+			gWalkCfg.GroupCnt = v[1];
+			gWalkCfg.JmpCnt = v[2];
+			gWalkCfg.MdLen = v[3];
+			gWalkCfg.StepCnt = v[4];
+		}
+		else
+		if (strcmp(argument, "-autotune") == 0)
+		{
+			gAutotune = true;
+		}
+		else
+		if (strcmp(argument, "-compact") == 0)
+		{
+			gParams.Compact = true;
+		}
+		else
+		if (strcmp(argument, "-tamesram") == 0)
+		{
+			double val = atof(argv[ci]);
+			ci++;
+			if (val < 0.5)
+			{
+				printf("error: invalid value for -tamesram option\r\n");
+				return false;
+			}
+			gParams.TamesRam = val;
+		}
+		else
+		if (strcmp(argument, "-cpu") == 0)
+		{
+			int val = atoi(argv[ci]);
+			ci++;
+			if ((val < 1) || (val > 1024))
+			{
+				printf("error: invalid value for -cpu option\r\n");
+				return false;
+			}
+			gParams.CpuThreads = val;
+		}
+		else
+		if (strcmp(argument, "-slice") == 0)
+		{
+			int val = atoi(argv[ci]);
+			ci++;
+			if (val < 10)
+			{
+				printf("error: invalid value for -slice option\r\n");
+				return false;
+			}
+			gParams.SliceSec = val;
 		}
 		else
 		{
@@ -595,15 +357,20 @@ bool ParseCommandLine(int argc, char* argv[])
 			return false;
 		}
 	}
-	if (!gPubKey.x.IsZero())
-		if (!gStartSet || !gRange || !gDP)
+	if (gPubKeys.size())
+		if (!gStartSet || !gParams.Range)
 		{
-			printf("error: you must also specify -dp, -range and -start options\r\n");
+			printf("error: you must also specify -range and -start options\r\n");
 			return false;
 		}
-	if (gTamesFileName[0] && !IsFileExist(gTamesFileName))
+	if (gTuneFileName[0] && gParams.Range && (gParams.Range > 64))
 	{
-		if (gMax == 0.0)
+		printf("error: range for jumps tuning must be 64 bits or less\r\n");
+		return false;
+	}
+	if (gParams.TamesFileName[0] && !IsFileExist(gParams.TamesFileName))
+	{
+		if (gParams.Max == 0.0)
 		{
 			printf("error: you must also specify -max option to generate tames\r\n");
 			return false;
@@ -637,128 +404,97 @@ int main(int argc, char* argv[])
 #endif
 
 	InitEc();
-	gDP = 0;
-	gRange = 0;
+	SetDefaultSolveParams(&gParams);
 	gStartSet = false;
-	gTamesFileName[0] = 0;
-	gMax = 0.0;
+	gTuneFileName[0] = 0;
+	gTuneKangs = 1024;
+	gTuneSolves = 32;
+	gEmuCalls = 0;
+	gEcBench = false;
+	memset(&gWalkCfg, 0, sizeof(gWalkCfg));
+	gAutotune = false;
 	gGenMode = false;
-	gIsOpsLimit = false;
 	memset(gGPUs_Mask, 1, sizeof(gGPUs_Mask));
 	if (!ParseCommandLine(argc, argv))
 		return 0;
 
-	InitGpus();
+	if (!gAutotune && gMachineProfile.LoadFromFile(MACHINE_PROFILE_FILE))
+		printf("Machine profile loaded from %s\r\n", MACHINE_PROFILE_FILE);
 
-	if (!GpuCnt)
+	if (gTuneFileName[0])
 	{
-		printf("No supported GPUs detected, exit\r\n");
+		printf("\r\nJUMPS TUNING MODE\r\n\r\n");
+		TWalkCfg cfg;
+		GetWalkCfg(&cfg, false, NULL, &gWalkCfg);
+		if (!IsWalkCfgSupported(&cfg))
+		{
+			printf("error: config %d:%d:%d:%d:%d is not supported\r\n", cfg.BlockSize, cfg.GroupCnt, cfg.JmpCnt, cfg.MdLen, cfg.StepCnt);
+			PrintWalkCfgs();
+			DeInitEc();
+			return 0;
+		}
+		char hw_id[128];
+		GetCpuHwId(hw_id);
+		TMachineProfileRec* rec = gMachineProfile.Find(hw_id);
+		RunJmpTuner(gTuneFileName, gParams.Range ? gParams.Range : 40, gTuneKangs, gTuneSolves, &cfg, rec ? rec->thr_cnt : 0);
+		StopThreadPool();
+		DeInitEc();
 		return 0;
 	}
 
-	pPntList = (u8*)malloc(MAX_CNT_LIST * GPU_DP_SIZE);
-	pPntList2 = (u8*)malloc(MAX_CNT_LIST * GPU_DP_SIZE);
-	TotalOps = 0;
-	TotalSolved = 0;
-	gTotalErrors = 0;
-	IsBench = gPubKey.x.IsZero();
-
-	if (!IsBench && !gGenMode)
+	if (gEcBench)
 	{
-		printf("\r\nMAIN MODE\r\n\r\n");
-		EcPoint PntToSolve, PntOfs;
-		EcInt pk, pk_found;
+		printf("\r\nEC BENCHMARK MODE\r\n\r\n");
+		RunEcBench();
+		DeInitEc();
+		return 0;
+	}
 
-		PntToSolve = gPubKey;
-		if (!gStart.IsZero())
-		{
-			PntOfs = ec.MultiplyG(gStart);
-			PntOfs.y.NegModP();
-			PntToSolve = ec.AddPoints(PntToSolve, PntOfs);
-		}
+	if (gEmuCalls)
+	{
+		printf("\r\nKERNELS EMULATION CHECK MODE\r\n\r\n");
+		TWalkCfg cfg;
+		GetWalkCfg(&cfg, false, NULL, &gWalkCfg);
+		int Range = gParams.Range ? gParams.Range : 40;
+		//new kernels keep L1S2 flags in u32
+		bool ok = (cfg.GroupCnt > 32) || RunEmuCheck(&cfg, false, Range, gEmuCalls);
+		ok = RunEmuCheck(&cfg, true, Range, gEmuCalls) && ok;
+		printf("\r\nKernels emulation check %s\r\n", ok ? "passed" : "FAILED");
+		DeInitEc();
+		return 0;
+	}
 
-		char sx[100], sy[100];
-		gPubKey.x.GetHexStr(sx);
-		gPubKey.y.GetHexStr(sy);
-		printf("Solving public key\r\nX: %s\r\nY: %s\r\n", sx, sy);
-		gStart.GetHexStr(sx);
-		printf("Offset: %s\r\n", sx);
+	int res = 0;
+	RCSolver* solver = new RCSolver();
+	solver->Init(gGPUs_Mask, &gWalkCfg, &gMachineProfile, gAutotune);
 
-		if (!SolvePoint(PntToSolve, gRange, gDP, &pk_found))
-		{
-			if (!gIsOpsLimit)
-				printf("FATAL ERROR: SolvePoint failed\r\n");
-			goto label_end;
-		}
-		pk_found.AddModP(gStart);
-		EcPoint tmp = ec.MultiplyG(pk_found);
-		if (!tmp.IsEqual(gPubKey))
-		{
-			printf("FATAL ERROR: SolvePoint found incorrect key\r\n");
-			goto label_end;
-		}
-		//happy end
-		char s[100];
-		pk_found.GetHexStr(s);
-		printf("\r\nPRIVATE KEY: %s\r\n\r\n", s);
-		FILE* fp = fopen("RESULTS.TXT", "a");
-		if (fp)
-		{
-			fprintf(fp, "PRIVATE KEY: %s\n", s);
-			fclose(fp);
-		}
-		else //we cannot save the key, show error and wait forever so the key is displayed
-		{
-			printf("WARNING: Cannot save the key to RESULTS.TXT!\r\n");
-			while (1)
-				Sleep(100);
-		}
+	if (gAutotune)
+	{
+		printf("\r\nAUTOTUNE MODE\r\n\r\n");
+		RunAutotune(MACHINE_PROFILE_FILE, solver->GpuKangs, solver->GpuCnt, &gWalkCfg);
 	}
 	else
+	//BSGS and CPU walkers work on CPU, so main mode can be used without GPUs
+	if (!solver->GpuCnt && (gPubKeys.empty() || gGenMode || ((gParams.Engine == ENGINE_KANG) && !gParams.CpuThreads)))
+		printf("No supported GPUs detected, exit\r\n");
+	else
+	if (gGenMode)
+		solver->GenerateTames(&gParams, NULL);
+	else
+	if (gPubKeys.empty())
+		solver->Bench(&gParams, NULL, 0);
+	else
 	{
-		if (gGenMode)
-			printf("\r\nTAMES GENERATION MODE\r\n");
-		else
-			printf("\r\nBENCHMARK MODE\r\n");
-		//solve points, show K
-		while (1)
-		{
-			EcInt pk, pk_found;
-			EcPoint PntToSolve;
-
-			if (!gRange)
-				gRange = 78;
-			if (!gDP)
-				gDP = 16;
-
-			//generate random pk
-			pk.RndBits(gRange);
-			PntToSolve = ec.MultiplyG(pk);
-
-			if (!SolvePoint(PntToSolve, gRange, gDP, &pk_found))
-			{
-				if (!gIsOpsLimit)
-					printf("FATAL ERROR: SolvePoint failed\r\n");
-				break;
-			}
-			if (!pk_found.IsEqual(pk))
-			{
-				printf("FATAL ERROR: Found key is wrong!\r\n");
-				break;
-			}
-			TotalOps += PntTotalOps;
-			TotalSolved++;
-			u64 ops_per_pnt = TotalOps / TotalSolved;
-			double K = (double)ops_per_pnt / pow(2.0, gRange / 2.0);
-			printf("Points solved: %d, average K: %.3f (with DP and GPU overheads)\r\n", TotalSolved, K);
-			//if (TotalSolved >= 100) break; //dbg
-		}
+		printf("\r\nMAIN MODE\r\n\r\n");
+		TSolveCallbacks cb;
+		memset(&cb, 0, sizeof(cb));
+		cb.OnKeyFound = OnKeyFound;
+		//exit code 1 if some keys are not found, solver shows the reason for every such key
+		if (solver->Solve(gPubKeys.data(), (int)gPubKeys.size(), &gParams, &cb) != (int)gPubKeys.size())
+			res = 1;
 	}
-label_end:
-	for (int i = 0; i < GpuCnt; i++)
-		delete GpuKangs[i];
+	delete solver;
+	StopThreadPool();
 	DeInitEc();
-	free(pPntList2);
-	free(pPntList);
+	return res;
 }
-
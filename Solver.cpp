@@ -0,0 +1,2121 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#include <algorithm>
+
+#include "cuda_runtime.h"
+#include "cuda.h"
+
+#include "Solver.h"
+#include "CpuKang.h"
+#include "Bsgs.h"
+#include "ThreadPool.h"
+
+#define JUMPS_CACHE_FILE	"JUMPS_CACHE.BIN"
+//offset of jumps hash in tames header, 0 - unknown (old tames)
+#define TAMES_HDR_JMP_HASH	4
+//compact tames: run seed, used seed ids and walk config, they are required to replay kangs of tames
+#define TAMES_HDR_RUN_SEED	16
+#define TAMES_HDR_SEED_CNT	24
+#define TAMES_HDR_MD_LEN	28
+#define TAMES_HDR_STEP_CNT	32
+//pruned tames: ops covered by kept DPs (double), 0 - DPs count * 2^DP
+#define TAMES_HDR_OPS		40
+
+//usefulness of tame DP is stored after DB record during tames generation
+#define TAME_SCORE_LEN		4
+
+//failed GPU is reset and gets new herd after delay, limited number of times per point
+#define GPU_RESTART_DELAY_MS	30000
+#define GPU_MAX_RESTARTS		10
+
+//CPU walkers have no seed ids, this value in cuda index field of their DPs
+#define CPU_WALKER_KANGS		1024
+#define CPU_WALKER_STEP_CNT		64
+
+//max time of one DB pruning step in solving loop
+#define DB_PRUNE_STEP_US		20000
+
+//state of target in Solve, values >= 0 are NOT_FOUND_xxx reasons
+#define TARGET_SOLVED			-1
+#define TARGET_LEFT				-2
+
+//target of time-sliced solving, its herd and wild DPs are kept here while other targets work
+struct TTargetState
+{
+	bool done; //solved or ops limit reached
+	bool started;
+	volatile int weight; //slice length in SliceSec units, 0 - paused
+	u64 ops;
+	double herd_parts[3];
+	TKangCheckpoint chk[MAX_GPU_CNT];
+	std::vector <u8> wild_dps; //DB records with list index
+};
+
+struct TTameKangStat
+{
+	u64 last_steps; //jumps from start at last DP
+	bool following; //last DP was found before, so kang follows path of other kang
+};
+
+#pragma pack(push, 1)
+struct DBRec
+{
+	u8 x[12];
+	u8 d[22];
+	u8 type; //0 - tame, 1 - wild1, 2 - wild2, high bits - DP level
+};
+
+//compact DB record, distance is recovered by replay of kang walk from its seed when collision is found
+struct DBRecCompact
+{
+	u8 x[12];
+	u32 seed; //seed id of kang, see GetSeedDistance
+	u8 steps[5]; //jumps from kang start
+	u16 d_chk; //low bits of distance, to skip DPs of same wild kang without replay
+	u8 type; //same as in DBRec
+};
+#pragma pack(pop)
+
+//steps field of compact record has 40 bits, GPU kangs are reseeded by herd audit at half of it, see MaxKangJumps
+#define COMPACT_MAX_JUMPS	(1ull << 40)
+
+#define DB_TYPE_MASK		0x03
+#define DB_LEVEL_SHIFT		2
+
+//DB record formats, rec_len is stored part of record (first 3 bytes are list index), size includes list index and grow allocation
+struct TDPFormat
+{
+	const char* name;
+	int rec_len;
+	int rec_size;
+	bool compact;
+};
+
+static const TDPFormat DPFormats[] = 
+{
+	{ "full 32-byte", sizeof(DBRec) - 3, 32 + 4 + 4, false },
+	{ "compact 21-byte", sizeof(DBRecCompact) - 3, 21 + 4 + 4, true },
+};
+#define DP_FORMATS_CNT		(int)(sizeof(DPFormats) / sizeof(DPFormats[0]))
+#define DP_FMT_FULL			0
+#define DP_FMT_COMPACT		1
+
+void SetDefaultSolveParams(TSolveParams* params)
+{
+	params->Range = 0;
+	params->DP = 0;
+	params->Start.SetZero();
+	params->Max = 0;
+	params->RamLimit = 0;
+	params->TamesFileName[0] = 0;
+	memset(params->Herd, 0, sizeof(params->Herd));
+	params->JmpProfileName[0] = 0;
+	params->Compact = false;
+	params->TamesRam = 0;
+	params->Engine = ENGINE_AUTO;
+	params->CpuThreads = 0;
+	params->SliceSec = 0;
+}
+
+//seed ids are unique in run, tames from file keep their ids
+u32 RCSolver::AllocSeedIds(u32 cnt)
+{
+	csSeeds.Enter();
+	u32 res = NextSeedId;
+	NextSeedId += cnt;
+	csSeeds.Leave();
+	return res;
+}
+
+//DPMul must be multiple of this value if DPBits > 58
+static int GetDPMulStep(int dp_bits)
+{
+	return (dp_bits > 58) ? (1 << (dp_bits - 58)) : 1;
+}
+
+//fractional DP: point is DP if x[3] < DPThr, DPThr = DPMul * 2^(58 - DPBits), DPMul is 1...64
+//so DP rate is DPMul/64 * 2^-DPBits. 6 bits of x[3] after DPBits zero bits are DP level, it's stored in DB type byte,
+//so we can increase DP during work and remove DPs that don't match new DP value from DB
+void RCSolver::SetDPValue(double dp)
+{
+	DPBits = (int)floor(dp);
+	int step = GetDPMulStep(DPBits);
+	DPMul = (int)(64.0 * pow(2.0, DPBits - dp) + 0.5);
+	DPMul -= DPMul % step;
+	if (DPMul < step)
+		DPMul = step;
+	if (DPMul > 64)
+		DPMul = 64;
+}
+
+double RCSolver::GetDPValue()
+{
+	return DPBits + log2(64.0 / DPMul);
+}
+
+u64 RCSolver::GetDPThr()
+{
+	if (DPBits > 58)
+		return (u64)DPMul >> (DPBits - 58);
+	return (u64)DPMul << (58 - DPBits);
+}
+
+//jump tables are same for same range, strategy and seed, so they are generated once per context and kept in cache file
+void RCSolver::PrepareJumps(TJmpStrategy* st, int Range, int jmp_cnt)
+{
+	TJmpTablesKey key;
+	memset(&key, 0, sizeof(key));
+	key.range = Range;
+	key.jmp_cnt = jmp_cnt;
+	key.seed = 0; //use same seed to make tames from file compatible
+	key.st = *st;
+	key.gen_ver = JMP_GEN_VERSION;
+	if (LastJmpKeyValid && IsSameJmpTablesKey(&key, &LastJmpKey))
+		return;
+	if (LoadJumpsCache(JUMPS_CACHE_FILE, &key, EcJumps1, EcJumps2, EcJumps3))
+		printf("Jumps loaded from cache\r\n");
+	else
+	{
+		SetRndSeed(key.seed);
+		GenerateJumps(st, Range, jmp_cnt, EcJumps1, EcJumps2, EcJumps3);
+		if (!SaveJumpsCache(JUMPS_CACHE_FILE, &key, EcJumps1, EcJumps2, EcJumps3))
+			printf("Cannot save jumps to cache file %s\r\n", JUMPS_CACHE_FILE);
+	}
+	JumpsHash = CalcJumpsHash(jmp_cnt, EcJumps1, EcJumps2, EcJumps3);
+	LastJmpKey = key;
+	LastJmpKeyValid = true;
+}
+
+//default config for GPU (or config from machine profile record) with non-zero fields of user config
+void GetWalkCfg(TWalkCfg* cfg, bool old_gpu, TMachineProfileRec* rec, TWalkCfg* user_cfg)
+{
+	SetDefaultWalkCfg(cfg, old_gpu);
+	if (rec && IsWalkCfgSupported(&rec->cfg))
+		*cfg = rec->cfg;
+	if (user_cfg->BlockSize)
+		cfg->BlockSize = user_cfg->BlockSize;
+	if (user_cfg->GroupCnt)
+		cfg->GroupCnt = user_cfg->GroupCnt;
+	if (user_cfg->JmpCnt)
+		cfg->JmpCnt = user_cfg->JmpCnt;
+	if (user_cfg->MdLen)
+		cfg->MdLen = user_cfg->MdLen;
+	if (user_cfg->StepCnt)
+		cfg->StepCnt = user_cfg->StepCnt;
+}
+
+void RCSolver::InitGpus()
+{
+	GpuCnt = 0;
+	int gcnt = 0;
+	cudaGetDeviceCount(&gcnt);
+	if (gcnt > MAX_GPU_CNT)
+		gcnt = MAX_GPU_CNT;
+
+//	gcnt = 1; //dbg
+	if (!gcnt)
+		return;
+
+	int drv, rt;
+	cudaRuntimeGetVersion(&rt);
+	cudaDriverGetVersion(&drv);
+	char drvver[100];
+	sprintf(drvver, "%d.%d/%d.%d", drv / 1000, (drv % 100) / 10, rt / 1000, (rt % 100) / 10);
+
+	printf("CUDA devices: %d, CUDA driver/runtime: %s\r\n", gcnt, drvver);
+	cudaError_t cudaStatus;
+	for (int i = 0; i < gcnt; i++)
+	{
+		cudaStatus = cudaSetDevice(i);
+		if (cudaStatus != cudaSuccess)
+		{
+			printf("cudaSetDevice for gpu %d failed!\r\n", i);
+			continue;
+		}
+
+		if (!GPUs_Mask[i])
+			continue;
+
+		cudaDeviceProp deviceProp;
+		cudaGetDeviceProperties(&deviceProp, i);
+		printf("GPU %d: %s, %.2f GB, %d CUs, cap %d.%d, PCI %d, L2 size: %d KB\r\n", i, deviceProp.name, ((float)(deviceProp.totalGlobalMem / (1024 * 1024))) / 1024.0f, deviceProp.multiProcessorCount, deviceProp.major, deviceProp.minor, deviceProp.pciBusID, deviceProp.l2CacheSize / 1024);
+		
+		if (deviceProp.major < 6)
+		{
+			printf("GPU %d - not supported, skip\r\n", i);
+			continue;
+		}
+
+		cudaSetDeviceFlags(cudaDeviceScheduleBlockingSync);
+
+		GpuKangs[GpuCnt] = new RCGpuKang();
+		GpuKangs[GpuCnt]->Solver = this;
+		GpuKangs[GpuCnt]->CudaIndex = i;
+		GpuKangs[GpuCnt]->Running = false;
+		GpuKangs[GpuCnt]->Checkpoint = NULL;
+		GpuKangs[GpuCnt]->persistingL2CacheMaxSize = deviceProp.persistingL2CacheMaxSize;
+		GpuKangs[GpuCnt]->mpCnt = deviceProp.multiProcessorCount;
+		GpuKangs[GpuCnt]->IsOldGpu = deviceProp.l2CacheSize < 16 * 1024 * 1024;
+		//autotuner sets configs itself
+		if (!IsAutotune)
+		{
+			char hw_id[128];
+			GetGpuHwId(i, hw_id);
+			TWalkCfg cfg;
+			GetWalkCfg(&cfg, GpuKangs[GpuCnt]->IsOldGpu, MachineProfile.Find(hw_id), &WalkCfg);
+			//all GPUs use same jumps tables
+			if (!GpuKangs[GpuCnt]->SetWalkCfg(&cfg) || (GpuCnt && (cfg.JmpCnt != GpuKangs[0]->Cfg.JmpCnt)))
+			{
+				printf("GPU %d - config %d:%d:%d:%d:%d is not supported, skip\r\n", i, cfg.BlockSize, cfg.GroupCnt, cfg.JmpCnt, cfg.MdLen, cfg.StepCnt);
+				delete GpuKangs[GpuCnt];
+				continue;
+			}
+		}
+		GpuCnt++;
+	}
+	printf("Total GPUs for work: %d\r\n", GpuCnt);
+}
+
+#ifdef _WIN32
+u32 __stdcall kang_thr_proc(void* data)
+{
+	RCGpuKang* Kang = (RCGpuKang*)data;
+	Kang->Execute();
+	Kang->Running = false;
+	InterlockedDecrement(&Kang->Solver->ThrCnt);
+	return 0;
+}
+#else
+void* kang_thr_proc(void* data)
+{
+	RCGpuKang* Kang = (RCGpuKang*)data;
+	Kang->Execute();
+	Kang->Running = false;
+	__sync_fetch_and_sub(&Kang->Solver->ThrCnt, 1);
+	return 0;
+}
+#endif
+
+void RCSolver::AddPointsToList(TDPRec* data, int pnt_cnt, u64 ops_cnt)
+{
+	csAddPoints.Enter();
+	if (PntIndex + pnt_cnt >= MAX_CNT_LIST)
+	{
+		csAddPoints.Leave();
+		printf("DPs buffer overflow, some points lost, increase DP value!\r\n");
+		return;
+	}
+	memcpy(pPntList + PntIndex, data, pnt_cnt * sizeof(TDPRec));
+	PntIndex += pnt_cnt;
+	PntTotalOps += ops_cnt;
+	csAddPoints.Leave();
+}
+
+void RCSolver::StartGpuThread(int ind)
+{
+	GpuKangs[ind]->Running = true;
+	GpuThrActive[ind] = true;
+#ifdef _WIN32
+	InterlockedIncrement(&ThrCnt);
+	u32 ThreadID;
+	GpuThr[ind] = (HANDLE)_beginthreadex(NULL, 0, kang_thr_proc, (void*)GpuKangs[ind], 0, &ThreadID);
+#else
+	__sync_fetch_and_add(&ThrCnt, 1);
+	pthread_create(&GpuThr[ind], NULL, kang_thr_proc, (void*)GpuKangs[ind]);
+#endif
+}
+
+//CPU walkers and replay of compact DPs walk like first GPU, without GPUs they use config from user or default one
+TWalkCfg* RCSolver::GetKangCfg()
+{
+	return GpuCnt ? &GpuKangs[0]->Cfg : &CpuCfg;
+}
+
+int RCSolver::GetActiveGpuCnt()
+{
+	int cnt = 0;
+	for (int i = 0; i < GpuCnt; i++)
+		if (GpuKangs[i]->Running)
+			cnt++;
+	return cnt;
+}
+
+static void cpu_walker_task_proc(void* data)
+{
+	((RCSolver*)data)->CpuWalk();
+}
+
+//CPU walker, same jumps as GPUs with own random herd, runs as long task of thread pool until CpuStopFlag
+//it's much slower than GPU but useful when GPU fails and for machines with many cores
+void RCSolver::CpuWalk()
+{
+	RCCpuKang* kang = new RCCpuKang();
+	u64 dp_thr = CpuDPThr;
+	if (!kang->Prepare(PntToSolve, CurRange, DPBits, dp_thr, EcJumps1, EcJumps2, EcJumps3, CpuWalkerKangs, CurHerdParts, GetKangCfg()))
+	{
+		printf("CPU walker: walk config is not supported on CPU\r\n");
+		delete kang;
+		return;
+	}
+	int max_dps = CpuWalkerKangs * CPU_WALKER_STEP_CNT;
+	TDPRec* dps = (TDPRec*)malloc((size_t)max_dps * sizeof(TDPRec));
+	u64 ops = (u64)CpuWalkerKangs * CPU_WALKER_STEP_CNT;
+	while (!CpuStopFlag && !Solved)
+	{
+		if (dp_thr != CpuDPThr)
+		{
+			dp_thr = CpuDPThr;
+			kang->SetDPThr(dp_thr);
+		}
+		int cnt = kang->Step(CPU_WALKER_STEP_CNT, dps, max_dps);
+		for (int i = 0; i < cnt; i++)
+		{
+			dps[i].seed = 0;
+			dps[i].backend = DP_BACKEND_CPU;
+			dps[i].jumps = 0;
+		}
+		AddPointsToList(dps, cnt, ops);
+		csCpu.Enter();
+		CpuOps += ops;
+		csCpu.Leave();
+	}
+	free(dps);
+	kang->Release();
+	delete kang;
+}
+
+void RCSolver::AddCpuWalkers(int cnt)
+{
+#ifdef _WIN32
+	InterlockedExchangeAdd(&CpuWalkersReq, cnt);
+#else
+	__sync_fetch_and_add(&CpuWalkersReq, cnt);
+#endif
+}
+
+void RCSolver::UpdateCpuSpeed()
+{
+	csCpu.Enter();
+	u64 ops = CpuOps;
+	csCpu.Leave();
+	u64 tm = GetTickCount64();
+	if (tm - CpuOpsTime >= 1000)
+	{
+		CpuSpeed = (double)(ops - CpuOpsLast) / ((tm - CpuOpsTime) * 1000.0);
+		CpuOpsLast = ops;
+		CpuOpsTime = tm;
+	}
+}
+
+//called once per second from solving loop: restarts failed GPUs and starts requested CPU walkers
+//returns false if nothing works and nothing can be restarted
+bool RCSolver::CheckBackends()
+{
+	u64 tm = GetTickCount64();
+	for (int i = 0; i < GpuCnt; i++)
+	{
+		RCGpuKang* gk = GpuKangs[i];
+		if (GpuThrActive[i] && !gk->Running)
+		{
+			//thread exits only on error while we are solving
+#ifdef _WIN32
+			WaitForSingleObject(GpuThr[i], INFINITE);
+			CloseHandle(GpuThr[i]);
+#else
+			pthread_join(GpuThr[i], NULL);
+#endif
+			GpuThrActive[i] = false;
+			GpuFailTime[i] = tm;
+			if (GpuRestarts[i] < GPU_MAX_RESTARTS)
+				printf("GPU %d failed, its kangs are lost, restart in %d sec\r\n", gk->CudaIndex, GPU_RESTART_DELAY_MS / 1000);
+			else
+				printf("GPU %d failed, restarts limit reached, working without it\r\n", gk->CudaIndex);
+			continue;
+		}
+		if (GpuThrActive[i] || (GpuRestarts[i] >= GPU_MAX_RESTARTS) || (tm - GpuFailTime[i] < GPU_RESTART_DELAY_MS))
+			continue;
+		//device can be in sticky error state after failed kernel, so reset it and start new herd, old kangs cannot be restored from GPU memory
+		GpuRestarts[i]++;
+		cudaSetDevice(gk->CudaIndex);
+		cudaDeviceReset();
+		memcpy(gk->HerdParts, CurHerdParts, sizeof(CurHerdParts));
+		if (!gk->Prepare(PntToSolve, CurRange, DPBits, GetDPThr(), EcJumps1, EcJumps2, EcJumps3))
+		{
+			GpuFailTime[i] = tm;
+			printf("GPU %d restart failed (%d of %d)\r\n", gk->CudaIndex, GpuRestarts[i], GPU_MAX_RESTARTS);
+			continue;
+		}
+		StartGpuThread(i);
+		printf("GPU %d restarted with new herd (%d of %d)\r\n", gk->CudaIndex, GpuRestarts[i], GPU_MAX_RESTARTS);
+	}
+
+	if (CpuWalkerCnt < CpuWalkersReq)
+	{
+		//CPU walkers have no seed ids and cuda index, so compact DPs and scored tames are not possible for them
+		if (Params.Compact || (GenMode && (Params.TamesRam > 0)))
+		{
+			printf("CPU walkers are not supported with compact DPs and tames scoring, ignored\r\n");
+			CpuWalkersReq = CpuWalkerCnt;
+		}
+		else
+		{
+			RCThreadPool* pool = GetThreadPool();
+			int cnt = CpuWalkersReq;
+			if (cnt > pool->GetWorkerCnt())
+				cnt = pool->GetWorkerCnt();
+			for (int i = CpuWalkerCnt; i < cnt; i++)
+				pool->Submit(cpu_walker_task_proc, this, &CpuGroup);
+			if (cnt > CpuWalkerCnt)
+				printf("CPU walkers added: %d, total %d\r\n", cnt - CpuWalkerCnt, cnt);
+			CpuWalkerCnt = cnt;
+			CpuWalkersReq = cnt;
+		}
+	}
+
+	if (CpuWalkerCnt)
+		return true;
+	for (int i = 0; i < GpuCnt; i++)
+		if (GpuThrActive[i] || (GpuRestarts[i] < GPU_MAX_RESTARTS))
+			return true;
+	return false;
+}
+
+static bool KeepTameDP(u8* rec, void* ctx)
+{
+	int rec_len = *(int*)ctx;
+	return (rec[rec_len - 1] & DB_TYPE_MASK) == TAME;
+}
+
+//removes wild DPs of target from DB, they are kept while target is preempted and dropped when it's finished
+//tame DPs stay in DB because they are useful for all targets
+void RCSolver::SwapOutTarget(TTargetState* ts, bool finished)
+{
+	u64 t0 = GetTickCount64();
+	int rec_len = DPFormats[DPFmt].rec_len;
+	ts->wild_dps.clear();
+	u64 cnt = db.Prune(KeepTameDP, &rec_len, 0, finished ? NULL : &ts->wild_dps);
+	ts->wild_dps.shrink_to_fit();
+	if (finished)
+	{
+		for (int i = 0; i < GpuCnt; i++)
+			FreeKangCheckpoint(&ts->chk[i]);
+		return;
+	}
+	printf("Wild DPs swapped out: %lluK, %.1f MB, %llu ms\r\n", cnt / 1000, (double)ts->wild_dps.size() / (1024 * 1024), GetTickCount64() - t0);
+}
+
+//distance of DB record, compact records are replayed
+bool RCSolver::GetRecDist(u8* rec, EcInt& dist)
+{
+	if (Params.Compact)
+		return ReplayDP((DBRecCompact*)rec, dist);
+	DBRec* r = (DBRec*)rec;
+	dist.SetZero();
+	memcpy(dist.data, r->d, sizeof(r->d));
+	if (r->d[21] == 0xFF) memset(((u8*)dist.data) + 22, 0xFF, 18);
+	return true;
+}
+
+//adds wild DPs of resumed target back to DB, tames found by other targets can collide with them
+//returns true if key is found
+bool RCSolver::SwapInTarget(TTargetState* ts)
+{
+	if (ts->wild_dps.empty())
+		return false;
+	u64 t0 = GetTickCount64();
+	int len = DPFormats[DPFmt].rec_len + 3;
+	u64 cnt = ts->wild_dps.size() / len;
+	bool found = false;
+	for (u64 i = 0; (i < cnt) && !found; i++)
+	{
+		u8* rec = ts->wild_dps.data() + i * len;
+		if ((u32)(rec[len - 1] >> DB_LEVEL_SHIFT) >= (u32)DPMul)
+			continue; //DP was increased while target was preempted
+		u8* pref = db.FindOrAddDataBlock(rec);
+		if (!pref || ((pref[len - 4] & DB_TYPE_MASK) != TAME))
+			continue;
+		//in db we dont store first 3 bytes so restore them
+		u8 tame[64];
+		memcpy(tame, rec, 3);
+		memcpy(tame + 3, pref, len - 3);
+		if (Params.Compact)
+		{
+			SubmitReplay(tame, rec, NULL, rec[len - 1] & DB_TYPE_MASK);
+			continue;
+		}
+		EcInt d_tame, d_wild;
+		if (!GetRecDist(tame, d_tame) || !GetRecDist(rec, d_wild))
+		{
+			printf("DP replay failed\r\n");
+			TotalErrors++;
+			continue;
+		}
+		found = CheckCollision(d_tame, TAME, d_wild, rec[len - 1] & DB_TYPE_MASK);
+	}
+	ts->wild_dps.clear();
+	ts->wild_dps.shrink_to_fit();
+	printf("Wild DPs swapped in: %lluK, %llu ms\r\n", cnt / 1000, GetTickCount64() - t0);
+	if (found)
+		Solved = true;
+	return found;
+}
+
+void RCSolver::SetTargetWeight(int pnt_ind, int weight)
+{
+	csTargets.Enter();
+	if (Targets && (pnt_ind >= 0) && (pnt_ind < TargetCnt))
+		Targets[pnt_ind].weight = (weight > 0) ? weight : 0;
+	csTargets.Leave();
+}
+
+//time-sliced solving: targets work in turn, SliceSec * weight seconds each, preempted target keeps its herd and wild DPs
+//in host RAM and resumes them, so no work is lost. Tames are shared by all targets
+int RCSolver::SolveSliced(EcPoint* targets, EcPoint* pnts, int cnt, int* state)
+{
+	TTargetState* ts = new TTargetState[cnt]();
+	int left = 0;
+	for (int i = 0; i < cnt; i++)
+	{
+		ts[i].done = (state[i] != TARGET_LEFT);
+		left += !ts[i].done;
+		ts[i].weight = 1;
+		for (int j = 0; j < MAX_GPU_CNT; j++)
+			ts[i].chk[j].Exact = Params.Compact;
+	}
+	csTargets.Enter();
+	Targets = ts;
+	TargetCnt = cnt;
+	csTargets.Leave();
+	SliceSession = false;
+	SwitchStart = 0;
+	SwitchCnt = 0;
+	SwitchMs = 0;
+	printf("Time-sliced solving, slice %d sec\r\n", Params.SliceSec);
+
+	char sx[100], sy[100];
+	int solved = 0;
+	int cur = -1;
+	while (left && !CancelFlag)
+	{
+		int ind = -1;
+		int weight = 0;
+		csTargets.Enter();
+		for (int k = 1; k <= cnt; k++)
+		{
+			int i = (cur + k) % cnt;
+			if (!ts[i].done && ts[i].weight)
+			{
+				ind = i;
+				weight = ts[i].weight;
+				break;
+			}
+		}
+		csTargets.Leave();
+		if (ind < 0)
+		{
+			Sleep(100); //all targets that are left are paused
+			continue;
+		}
+		cur = ind;
+		SliceMs = (left > 1) ? (u64)Params.SliceSec * 1000 * weight : 0;
+		targets[ind].x.GetHexStr(sx);
+		targets[ind].y.GetHexStr(sy);
+		printf("\r\nSolving public key %d of %d, %d left\r\nX: %s\r\nY: %s\r\n", ind + 1, cnt, left, sx, sy);
+		CurPntInd = ind;
+		EcInt pk_found;
+		if (SolvePoint(pnts[ind], Params.Range, Params.DP, &pk_found, &ts[ind]))
+		{
+			ts[ind].done = true;
+			left--;
+			if (!ReportKey(ind, pk_found, targets[ind]))
+			{
+				state[ind] = NOT_FOUND_FAILED;
+				solved = -1;
+				break;
+			}
+			state[ind] = TARGET_SOLVED;
+			solved++;
+			continue;
+		}
+		if (IsPreempted)
+			continue;
+		ts[ind].done = true;
+		left--;
+		if (IsOpsLimit || CancelFlag)
+		{
+			state[ind] = IsOpsLimit ? NOT_FOUND_OPS_LIMIT : NOT_FOUND_CANCELLED;
+			continue;
+		}
+		printf("FATAL ERROR: SolvePoint failed\r\n");
+		state[ind] = NOT_FOUND_FAILED;
+		solved = -1;
+		break;
+	}
+	if (SwitchCnt)
+		printf("Target switches: %llu, average time %llu ms\r\n", SwitchCnt, SwitchMs / SwitchCnt);
+
+	csTargets.Enter();
+	Targets = NULL;
+	TargetCnt = 0;
+	csTargets.Leave();
+	for (int i = 0; i < cnt; i++)
+		for (int j = 0; j < MAX_GPU_CNT; j++)
+			FreeKangCheckpoint(&ts[i].chk[j]);
+	delete[] ts;
+	SliceSession = false;
+	SliceMs = 0;
+	SwitchStart = 0;
+	db.Clear();
+	return solved;
+}
+
+void RCSolver::StopBackends()
+{
+	for (int i = 0; i < GpuCnt; i++)
+		GpuKangs[i]->Stop();
+	CpuStopFlag = true;
+	if (CpuWalkerCnt)
+		GetThreadPool()->Wait(&CpuGroup);
+	CpuWalkerCnt = 0;
+	while (ThrCnt)
+		Sleep(10);
+	for (int i = 0; i < GpuCnt; i++)
+	{
+		if (!GpuThrActive[i])
+			continue;
+#ifdef _WIN32
+		WaitForSingleObject(GpuThr[i], INFINITE);
+		CloseHandle(GpuThr[i]);
+#else
+		pthread_join(GpuThr[i], NULL);
+#endif
+		GpuThrActive[i] = false;
+	}
+}
+
+bool RCSolver::Collision_SOTA(EcPoint& pnt, EcInt t, int TameType, EcInt w, int WildType, bool IsNeg)
+{
+	if (IsNeg)
+		t.Neg();
+	if (TameType == TAME)
+	{
+		PrivKey = t;
+		PrivKey.Sub(w);
+		EcInt sv = PrivKey;
+		PrivKey.Add(Int_HalfRange);
+		EcPoint P = ec.MultiplyG(PrivKey);
+		if (P.IsEqual(pnt))
+			return true;
+		PrivKey = sv;
+		PrivKey.Neg();
+		PrivKey.Add(Int_HalfRange);
+		P = ec.MultiplyG(PrivKey);
+		return P.IsEqual(pnt);
+	}
+	else
+	{
+		PrivKey = t;
+		PrivKey.Sub(w);
+		if (PrivKey.data[4] >> 63)
+			PrivKey.Neg();
+		PrivKey.ShiftRight(1);
+		EcInt sv = PrivKey;
+		PrivKey.Add(Int_HalfRange);
+		EcPoint P = ec.MultiplyG(PrivKey);
+		if (P.IsEqual(pnt))
+			return true;
+		PrivKey = sv;
+		PrivKey.Neg();
+		PrivKey.Add(Int_HalfRange);
+		P = ec.MultiplyG(PrivKey);
+		return P.IsEqual(pnt);
+	}
+}
+
+
+//d1 and d2 are distances of collided DPs, returns true if key is found
+bool RCSolver::CheckCollision(EcInt& d1, int type1, EcInt& d2, int type2)
+{
+	EcInt w, t;
+	int TameType, WildType;
+	if (type1 != TAME)
+	{
+		w = d1;
+		t = d2;
+		TameType = type2;
+		WildType = type1;
+	}
+	else
+	{
+		w = d2;
+		t = d1;
+		TameType = TAME;
+		WildType = type2;
+	}
+
+	bool res = Collision_SOTA(PntToSolve, t, TameType, w, WildType, false) || Collision_SOTA(PntToSolve, t, TameType, w, WildType, true);
+	if (!res)
+	{
+		bool w12 = ((type1 == WILD1) && (type2 == WILD2)) || ((type1 == WILD2) && (type2 == WILD1));
+		if (w12) //in rare cases WILD and WILD2 can collide in mirror, in this case there is no way to find K
+			;// ToLog("W1 and W2 collides in mirror");
+		else
+		{
+			printf("Collision Error\r\n");
+			TotalErrors++;
+		}
+	}
+	return res;
+}
+
+//kang of compact DP starts from its seed at kernel call boundary, replay its walk to get distance
+bool RCSolver::ReplayDP(DBRecCompact* rec, EcInt& dist)
+{
+	u64 steps = 0;
+	memcpy(&steps, rec->steps, 5);
+	EcInt d;
+	GetSeedDistance(d, RunSeed, rec->seed, Params.Range);
+	EcJPoint jstart = ec.MultiplyGJ(d);
+	int type = rec->type & DB_TYPE_MASK;
+	if (type != TAME)
+	{
+		EcPoint ofs = ec.AddPoints(PntToSolve, Pnt_NegHalfRange);
+		if (type == WILD2)
+			ofs.y.NegModP();
+		jstart = ec.AddPointsJA(jstart, ofs);
+	}
+	EcPoint start = ec.ToAffine(jstart);
+	RCCpuKang kang;
+	return kang.Replay(start, d, Params.Range, EcJumps1, EcJumps2, EcJumps3, GetKangCfg(), steps, rec->x, dist, &CancelFlag);
+}
+
+//collision of compact DP from DB (rec1) with new DP (d2 is known) or with other compact DP (rec2)
+struct TReplayTask
+{
+	RCSolver* solver;
+	DBRecCompact rec1;
+	DBRecCompact rec2;
+	bool replay2;
+	EcInt d2;
+	int type2;
+};
+
+static void replay_task_proc(void* data)
+{
+	TReplayTask* task = (TReplayTask*)data;
+	task->solver->ReplayCollision(task);
+	delete task;
+}
+
+//replay of long walk takes minutes on CPU, so it runs in thread pool and solving loop keeps ingesting DPs
+//task works with current point, so SolvePoint waits for replays before target is switched
+void RCSolver::SubmitReplay(u8* rec1, u8* rec2, EcInt* d2, int type2)
+{
+	TReplayTask* task = new TReplayTask();
+	task->solver = this;
+	memcpy(&task->rec1, rec1, sizeof(DBRecCompact));
+	task->replay2 = (rec2 != NULL);
+	if (rec2)
+		memcpy(&task->rec2, rec2, sizeof(DBRecCompact));
+	else
+		task->d2 = *d2;
+	task->type2 = type2;
+	GetThreadPool()->Submit(replay_task_proc, task, &ReplayGroup);
+}
+
+void RCSolver::ReplayCollision(TReplayTask* task)
+{
+	EcInt d1;
+	if (!ReplayDP(&task->rec1, d1) || (task->replay2 && !ReplayDP(&task->rec2, task->d2)))
+	{
+		if (!CancelFlag)
+		{
+			printf("DP replay failed\r\n");
+			TotalErrors++;
+		}
+		return;
+	}
+	csReplay.Enter();
+	if (!Solved && CheckCollision(d1, task->rec1.type & DB_TYPE_MASK, task->d2, task->type2))
+		Solved = true;
+	csReplay.Leave();
+}
+
+//replays of collisions found before stop can still solve the point, cancel stops them
+void RCSolver::WaitReplays()
+{
+	if (!ReplayGroup.Pending)
+		return;
+	printf("Waiting for %d DP replays...\r\n", ReplayGroup.Pending);
+	GetThreadPool()->Wait(&ReplayGroup);
+}
+
+//tames generation with pruning. Score of tame DP is number of points whose walks lead to it, so DPs reached by many walks
+//and DPs at the end of long walks are the most useful ones (Bernstein-Lange precomputation).
+//Kang that hits existing DP follows the walk of other kang, so it adds nothing to scores until it makes a new DP.
+//rec is DB record with list index, rec_len is its stored length without score
+void RCSolver::AddTameWithScore(u8* rec, int rec_len, TDPRec* p)
+{
+	u8 buf[64];
+	memcpy(buf, rec, 3 + rec_len);
+	TTameKangStat* ks = &TameKangStats[p->backend][p->kang];
+	u64 steps = p->jumps;
+	if (steps < ks->last_steps)
+		ks->following = false; //kang was reseeded
+	float seg = (float)(steps - ((steps < ks->last_steps) ? 0 : ks->last_steps));
+	ks->last_steps = steps;
+	u8* ptr = db.FindDataBlock(buf);
+	if (ptr)
+	{
+		if (!ks->following)
+			*(float*)(ptr + rec_len) += seg;
+		ks->following = true;
+		return;
+	}
+	*(float*)(buf + 3 + rec_len) = seg;
+	db.AddDataBlock(buf);
+	ks->following = false;
+}
+
+//DP of kang that hit DP of same-type kang, so both kangs walk the same path now; owning GPU reseeds it to keep herd size
+void RCSolver::ReseedMergedKang(TDPRec* p)
+{
+	for (int i = 0; i < GpuCnt; i++)
+		if (GpuKangs[i]->CudaIndex == (int)p->backend)
+		{
+			GpuKangs[i]->RequestReseed(p->kang, p->seed);
+			break;
+		}
+}
+
+u64 RCSolver::GetMergedKangs()
+{
+	u64 res = 0;
+	for (int i = 0; i < GpuCnt; i++)
+		res += GpuKangs[i]->MergedKangs;
+	return res;
+}
+
+//returns true if key is found
+bool RCSolver::CheckNewPointCompact(TDPRec* p, u32 level)
+{
+	DBRecCompact nrec;
+	u64 steps = p->jumps;
+	if (steps >= COMPACT_MAX_JUMPS)
+	{
+		DroppedDPs++; //too far from start, cannot be stored
+		return false;
+	}
+	memcpy(nrec.x, p->x, 12);
+	nrec.seed = p->seed;
+	memcpy(nrec.steps, &steps, 5);
+	nrec.d_chk = (u16)p->d[0];
+	nrec.type = GenMode ? TAME : (u8)p->type;
+	nrec.type |= level << DB_LEVEL_SHIFT;
+	if (GenMode && (Params.TamesRam > 0))
+	{
+		AddTameWithScore((u8*)&nrec, sizeof(DBRecCompact) - 3, p);
+		return false;
+	}
+
+	DBRecCompact* pref = (DBRecCompact*)db.FindOrAddDataBlock((u8*)&nrec);
+	if (!pref)
+		return false;
+	if (GenMode)
+	{
+		ReseedMergedKang(p);
+		return false;
+	}
+	//in db we dont store first 3 bytes so restore them
+	DBRecCompact tmp_pref;
+	memcpy(&tmp_pref, &nrec, 3);
+	memcpy(((u8*)&tmp_pref) + 3, pref, sizeof(DBRecCompact) - 3);
+	pref = &tmp_pref;
+	pref->type &= DB_TYPE_MASK;
+	nrec.type &= DB_TYPE_MASK;
+	if ((pref->type == nrec.type) && ((pref->type == TAME) || (pref->d_chk == nrec.d_chk)))
+	{
+		ReseedMergedKang(p);
+		return false;
+	}
+
+	EcInt d_new;
+	d_new.SetZero();
+	memcpy(d_new.data, p->d, 24);
+	if (d_new.data[2] >> 63)
+		d_new.data[3] = d_new.data[4] = 0xFFFFFFFFFFFFFFFFull;
+	SubmitReplay((u8*)pref, NULL, &d_new, nrec.type);
+	return false; //replay task sets Solved
+}
+
+void RCSolver::CheckNewPoints()
+{
+	csAddPoints.Enter();
+	if (!PntIndex)
+	{
+		csAddPoints.Leave();
+		return;
+	}
+
+	//swap lists instead of copying, producers continue to fill the other one
+	int cnt = PntIndex;
+	TDPRec* list = pPntList;
+	pPntList = pPntList2;
+	pPntList2 = list;
+	PntIndex = 0;
+	csAddPoints.Leave();
+
+	for (int i = 0; i < cnt; i++)
+	{
+		DBRec nrec;
+		TDPRec* p = pPntList2 + i;
+		u32 level = p->lvl_bits >> DP_LEVEL_SHIFT;
+		if (level >= (u32)DPMul)
+			continue; //found with old DP value before DP increase
+		if (Params.Compact)
+		{
+			if (!CheckNewPointCompact(p, level))
+				continue;
+			Solved = true;
+			break;
+		}
+		memcpy(nrec.x, p->x, 12);
+		memcpy(nrec.d, p->d, 22);
+		nrec.type = GenMode ? TAME : (u8)p->type;
+		nrec.type |= level << DB_LEVEL_SHIFT;
+		if (GenMode && (Params.TamesRam > 0))
+		{
+			AddTameWithScore((u8*)&nrec, sizeof(DBRec) - 3, p);
+			continue;
+		}
+
+		DBRec* pref = (DBRec*)db.FindOrAddDataBlock((u8*)&nrec);
+		if (GenMode)
+		{
+			if (pref)
+				ReseedMergedKang(p);
+			continue;
+		}
+		if (pref)
+		{
+			//in db we dont store first 3 bytes so restore them
+			DBRec tmp_pref;
+			memcpy(&tmp_pref, &nrec, 3);
+			memcpy(((u8*)&tmp_pref) + 3, pref, sizeof(DBRec) - 3);
+			pref = &tmp_pref;
+			pref->type &= DB_TYPE_MASK;
+			nrec.type &= DB_TYPE_MASK;
+
+			if (pref->type == nrec.type)
+			{
+				if (pref->type == TAME)
+				{
+					ReseedMergedKang(p);
+					continue;
+				}
+
+				//if it's wild, we can find the key from the same type if distances are different
+				if (*(u64*)pref->d == *(u64*)nrec.d)
+				{
+					ReseedMergedKang(p);
+					continue;
+				}
+				//else
+				//	ToLog("key found by same wild");
+			}
+
+			EcInt d1, d2;
+			GetRecDist((u8*)pref, d1);
+			GetRecDist((u8*)&nrec, d2);
+			if (!CheckCollision(d1, pref->type, d2, nrec.type))
+				continue;
+			Solved = true;
+			break;
+		}
+	}
+}
+
+void RCSolver::ShowStats(u64 tm_start, double exp_ops, double dp_val)
+{
+#ifdef DEBUG_MODE
+	for (int i = 0; i <= MAX_MD_LEN; i++)
+	{
+		u64 val = 0;
+		for (int j = 0; j < GpuCnt; j++)
+		{
+			val += GpuKangs[j]->dbg[i];
+		}
+		if (val)
+			printf("Loop size %d: %llu\r\n", i, val);
+	}
+#endif
+
+	//failed GPUs keep stats of last work
+	int speed = (int)CpuSpeed;
+	for (int i = 0; i < GpuCnt; i++)
+		if (GpuKangs[i]->Running)
+			speed += GpuKangs[i]->GetStatsSpeed();
+
+	u64 est_dps_cnt = (u64)(exp_ops / dp_val);
+	u64 exp_sec = 0xFFFFFFFFFFFFFFFFull;
+	if (speed)
+		exp_sec = (u64)((exp_ops / 1000000) / speed); //in sec
+	u64 exp_days = exp_sec / (3600 * 24);
+	int exp_hours = (int)(exp_sec - exp_days * (3600 * 24)) / 3600;
+	int exp_min = (int)(exp_sec - exp_days * (3600 * 24) - exp_hours * 3600) / 60;
+
+	u64 sec = (GetTickCount64() - tm_start) / 1000;
+	u64 days = sec / (3600 * 24);
+	int hours = (int)(sec - days * (3600 * 24)) / 3600;
+	int min = (int)(sec - days * (3600 * 24) - hours * 3600) / 60;
+	 
+	printf("%sSpeed: %d MKeys/s, Err: %d, Merged: %llu, DPs: %lluK/%lluK, Time: %llud:%02dh:%02dm/%llud:%02dh:%02dm\r\n", GenMode ? "GEN: " : (IsBench ? "BENCH: " : "MAIN: "), speed, TotalErrors, GetMergedKangs(), db.GetBlockCnt()/1000, est_dps_cnt/1000, days, hours, min, exp_days, exp_hours, exp_min);
+	if (CpuWalkerCnt || (GetActiveGpuCnt() < GpuCnt))
+		printf("Backends: GPUs %d/%d, CPU walkers %d (%.2f MKeys/s)\r\n", GetActiveGpuCnt(), GpuCnt, CpuWalkerCnt, CpuSpeed);
+	if (db.IsPruning())
+		printf("DB pruning: %.1f%%, %lluK DPs removed\r\n", 100.0 * db.GetPruneProgress(), db.GetPrunedCnt() / 1000);
+	if (ReplayGroup.Pending)
+		printf("DP replays in progress: %d\r\n", ReplayGroup.Pending);
+	if (DroppedDPs)
+		printf("Dropped DPs: %llu, kangs made 2^%.0f jumps from start, compact records cannot keep them\r\n", DroppedDPs, log2((double)COMPACT_MAX_JUMPS));
+	PrintThreadPoolStats();
+}
+
+void RCSolver::ReportProgress(u64 tm_start, double exp_ops)
+{
+	if (!Callbacks.OnProgress)
+		return;
+	TSolveProgress pr;
+	pr.pnt_ind = CurPntInd;
+	pr.speed = (int)CpuSpeed;
+	for (int i = 0; i < GpuCnt; i++)
+		if (GpuKangs[i]->Running)
+			pr.speed += GpuKangs[i]->GetStatsSpeed();
+	pr.ops = PntTotalOps;
+	pr.exp_ops = exp_ops;
+	pr.dps_cnt = db.GetBlockCnt();
+	pr.errors = TotalErrors;
+	pr.merged_kangs = GetMergedKangs();
+	pr.gpus_active = GetActiveGpuCnt();
+	pr.cpu_walkers = CpuWalkerCnt;
+	pr.db_prune = db.GetPruneProgress();
+	pr.dropped_dps = DroppedDPs;
+	pr.time_ms = GetTickCount64() - tm_start;
+	Callbacks.OnProgress(&pr, Callbacks.ctx);
+}
+
+//RAM for DB in GB
+static double CalcDBRam(double dps_cnt, int rec_size)
+{
+	double ram = rec_size * dps_cnt; //+4 for grow allocation and memory fragmentation
+	ram += sizeof(TListRec) * 256 * 256 * 256; //3byte-prefix table
+	return ram / (1024 * 1024 * 1024); //GB
+}
+
+double RCSolver::GetRamBudget()
+{
+	if (Params.RamLimit > 0)
+		return Params.RamLimit;
+	u64 phys = GetPhysMemSize();
+	return phys ? 0.75 * phys / (1024 * 1024 * 1024) : 16.0; //GB
+}
+
+//returns DP stored in tames file header or 0
+static double GetTamesDP(char* fn, int Range)
+{
+	u8 hdr[3];
+	FILE* fp = fopen(fn, "rb");
+	if (!fp)
+		return 0;
+	double res = 0;
+	if ((fread(hdr, 1, 3, fp) == 3) && (hdr[0] == Range) && hdr[1])
+		res = hdr[1] + log2(64.0 / (hdr[2] ? hdr[2] : 64));
+	fclose(fp);
+	return res;
+}
+
+//selects DP value with min expected K that fits RAM budget
+//when two kangs collide, the collision is detected at next DP only, so the whole herd makes about total_kangs * 2^DP extra jumps
+//low DP values reduce this overhead but DB grows, also GPUs must not overflow DP buffers
+//DP can be fractional so we check DP values with 1/8 step
+//max_gpu_jumps is max number of jumps made by one GPU in one kernel call
+//returns 0 if nothing fits
+double RCSolver::PlanDP(int Range, u64 total_kangs, u64 max_gpu_jumps, double ops)
+{
+	double ram_budget = GetRamBudget();
+	double tames_ram = 0;
+	if (!GenMode && Params.TamesFileName[0])
+		tames_ram = ((double)DPFormats[DPFmt].rec_size / DPFormats[DPFmt].rec_len) * GetFileSize64(Params.TamesFileName) / (1024 * 1024 * 1024);
+	//DB must hold all DPs if we are unlucky, 3x of expected ops is enough in most cases
+	double ops_horizon = ops * ((Params.Max > 0) ? Params.Max : 3.0);
+	printf("DP planner: RAM budget %.3f GB, tames %.3f GB, %llu kangaroos, ops for DB size: 2^%.3f\r\n", ram_budget, tames_ram, total_kangs, log2(ops_horizon));
+
+	double best_dp = 0;
+	int best_fmt = 0;
+	double best_k = 0;
+	double best_ram = 0;
+	for (int fmt = 0; fmt < DP_FORMATS_CNT; fmt++)
+	{
+		if (DPFormats[fmt].compact != Params.Compact)
+			continue; //compact records require replay on collision, so they are used only if requested
+		for (int dp8 = 14 * 8; dp8 <= 60 * 8; dp8++)
+		{
+			double dp = dp8 / 8.0;
+			double dp_val = pow(2.0, dp);
+			if (max_gpu_jumps / dp_val > MAX_DP_CNT / 2)
+				continue; //too many DPs for one kernel call
+			double ram = CalcDBRam(ops_horizon / dp_val, DPFormats[fmt].rec_size) + tames_ram;
+			if (ram > ram_budget)
+				continue;
+			double k = (ops + total_kangs * dp_val) / pow(2.0, Range / 2.0);
+			if (!best_dp || (k < best_k))
+			{
+				best_dp = dp;
+				best_fmt = fmt;
+				best_k = k;
+				best_ram = ram;
+			}
+		}
+	}
+	if (!best_dp)
+	{
+		printf("DP planner: cannot fit DPs into RAM budget, increase -ram or decrease -max value\r\n");
+		return 0;
+	}
+	printf("DP planner: selected DP %.3f, %s records, predicted K: %.3f, RAM: %.3f GB\r\n", best_dp, DPFormats[best_fmt].name, best_k, best_ram);
+	return best_dp;
+}
+
+static bool KeepDPLevel(u8* rec, void* ctx)
+{
+	TDPLevelCtx* c = (TDPLevelCtx*)ctx;
+	return (u32)(rec[c->rec_len - 1] >> DB_LEVEL_SHIFT) < c->level;
+}
+
+struct TTamesPruneCtx
+{
+	int rec_len;
+	float thr;
+	u64 ties; //number of DPs with score == thr to keep
+	double ops; //sum of scores of kept DPs
+	std::vector <float> scores;
+};
+
+static void GetTameScore(u8* rec, void* ctx)
+{
+	TTamesPruneCtx* c = (TTamesPruneCtx*)ctx;
+	c->scores.push_back(*(float*)(rec + c->rec_len));
+}
+
+static bool KeepUsefulTame(u8* rec, void* ctx)
+{
+	TTamesPruneCtx* c = (TTamesPruneCtx*)ctx;
+	float score = *(float*)(rec + c->rec_len);
+	if (score < c->thr)
+		return false;
+	if (score == c->thr)
+	{
+		if (!c->ties)
+			return false;
+		c->ties--;
+	}
+	c->ops += score;
+	return true;
+}
+
+//keeps most useful tame DPs that fit Params.TamesRam and removes scores from records, returns ops covered by kept DPs
+double RCSolver::PruneTames()
+{
+	TTamesPruneCtx ctx;
+	ctx.rec_len = DPFormats[DPFmt].rec_len;
+	ctx.ops = 0;
+	db.EnumRecs(GetTameScore, &ctx);
+	u64 total = ctx.scores.size();
+	double cnt = (Params.TamesRam * 1024 * 1024 * 1024 - sizeof(TListRec) * 256 * 256 * 256) / DPFormats[DPFmt].rec_size;
+	u64 keep_cnt = (cnt < 1) ? 1 : ((cnt < total) ? (u64)cnt : total);
+	ctx.thr = 0;
+	ctx.ties = 0;
+	if (keep_cnt && (keep_cnt < total))
+	{
+		std::nth_element(ctx.scores.begin(), ctx.scores.begin() + (total - keep_cnt), ctx.scores.end());
+		ctx.thr = ctx.scores[total - keep_cnt];
+		u64 above = 0;
+		for (u64 i = 0; i < total; i++)
+			if (ctx.scores[i] > ctx.thr)
+				above++;
+		ctx.ties = keep_cnt - above;
+	}
+	else
+		ctx.ties = total;
+	ctx.scores.clear();
+	ctx.scores.shrink_to_fit();
+	db.Prune(KeepUsefulTame, &ctx, ctx.rec_len);
+	printf("tames pruned: %lluK of %lluK DPs kept, they cover 2^%.3f ops\r\n", keep_cnt / 1000, total / 1000, log2(ctx.ops));
+	return ctx.ops;
+}
+
+//increases DP value by about 0.4, DPs that don't match new DP value are removed from DB by PruneDBStep
+bool RCSolver::RaiseDP()
+{
+	if (db.IsPruning())
+		return true; //previous increase is not finished yet
+	int step = GetDPMulStep(DPBits);
+	int new_mul = (3 * DPMul / 4);
+	new_mul -= new_mul % step;
+	if (new_mul < step)
+		new_mul = step;
+	if (new_mul >= DPMul)
+		return false; //DB keeps 6 level bits after DPBits, so DP cannot grow more
+
+	RaiseDPCtx.rec_len = DPFormats[DPFmt].rec_len;
+	RaiseDPCtx.level = new_mul;
+	db.StartPrune(KeepDPLevel, &RaiseDPCtx);
+	RaiseDPStart = GetTickCount64();
+	DPMul = new_mul;
+	for (int i = 0; i < GpuCnt; i++)
+		GpuKangs[i]->SetDPThr(GetDPThr());
+	CpuDPThr = GetDPThr();
+	printf("Memory pressure, DP increased to %.3f, DB pruning started\r\n", GetDPValue());
+	return true;
+}
+
+//DB stays usable between steps, new DPs with old levels are skipped by CheckNewPoints. max_us 0 - finish pruning now
+void RCSolver::PruneDBStep(u64 max_us)
+{
+	if (!db.IsPruning())
+		return;
+	if (db.PruneStep(max_us))
+		printf("DB pruning done: %lluK DPs removed, %llu ms\r\n", db.GetPrunedCnt() / 1000, GetTickCount64() - RaiseDPStart);
+}
+
+//selects herd composition, without preloaded tames 1:1:1 is optimal
+//collision rate is about (T0 + t*n)*(w1 + w2)*n + w1*w2*n^2 where T0 is path of loaded tames and n is ops we make
+//with w1 = w2 = w and t = 1 - 2w it is max for w = 1/3 + T0/(3n), so loaded tames reduce the part of new tames
+//returns estimated ops
+double RCSolver::SelectHerd(double* parts, double ops, double tames_ops)
+{
+	if (Params.Herd[TAME] + Params.Herd[WILD1] + Params.Herd[WILD2] > 0)
+	{
+		double sum = Params.Herd[TAME] + Params.Herd[WILD1] + Params.Herd[WILD2];
+		for (int i = 0; i < 3; i++)
+			parts[i] = Params.Herd[i] / sum;
+		return ops;
+	}
+	parts[TAME] = parts[WILD1] = parts[WILD2] = 1.0 / 3;
+	if (GenMode || (tames_ops <= 0))
+		return ops;
+	//we need same collision rate as without tames: ops^2/3, ops we make depend on w so iterate a bit
+	double n = ops;
+	for (int i = 0; i < 8; i++)
+	{
+		double w = 1.0 / 3 + tames_ops / (3 * n);
+		if (w > 0.5)
+			w = 0.5;
+		double a = 2 * w - 3 * w * w;
+		double b = 2 * w * tames_ops;
+		n = (sqrt(b * b + 4 * a * ops * ops / 3) - b) / (2 * a);
+		parts[TAME] = 1 - 2 * w;
+		parts[WILD1] = parts[WILD2] = w;
+	}
+	return n;
+}
+
+//sets DP, jumps, run seed and loads tames for solving of point
+bool RCSolver::PrepareSolve(int Range, double DP, u64 total_kangs, u64 max_gpu_jumps, double ops)
+{
+	if (!DP && !GenMode && Params.TamesFileName[0])
+	{
+		DP = GetTamesDP(Params.TamesFileName, Range);
+		if (DP)
+			printf("Use DP %.3f from tames file\r\n", DP);
+	}
+	if (!DP)
+		DP = PlanDP(Range, total_kangs, max_gpu_jumps, ops);
+	if ((DP < 14) || (DP > 60)) 
+	{
+		printf("Unsupported DP value (%.3f)!\r\n", DP);
+		return false;
+	}
+	SetDPValue(DP);
+
+	printf("\r\nSolving point: Range %d bits, DP %.3f, start...\r\n", Range, GetDPValue());
+	double dp_val = pow(2.0, GetDPValue());
+	double ram = CalcDBRam(ops / dp_val, DPFormats[DPFmt].rec_size);
+	printf("SOTA method, estimated ops: 2^%.3f, RAM for DPs: %.3f GB. DP and GPU overheads not included!\r\n", log2(ops), ram);
+	if (Params.Max > 0)
+	{
+		double max_ops = Params.Max * ops;
+		double ram_max = CalcDBRam(max_ops / dp_val, DPFormats[DPFmt].rec_size);
+		printf("Max allowed number of ops: 2^%.3f, max RAM for DPs: %.3f GB\r\n", log2(max_ops), ram_max);
+	}
+
+	double path_single_kang = ops / total_kangs;	
+	double DPs_per_kang = path_single_kang / dp_val;
+	printf("Estimated DPs per kangaroo: %.3f.%s\r\n", DPs_per_kang, (DPs_per_kang < 5) ? " DP overhead is big, use less DP value if possible!" : "");
+	if (Params.Compact)
+	{
+		double max_path = path_single_kang * ((Params.Max > 0) ? Params.Max : 1.0);
+		printf("Compact DPs: distance is recovered by replay of kang walk on CPU, up to 2^%.1f jumps per collision\r\n", log2(max_path));
+		if (max_path > COMPACT_MAX_JUMPS / 2)
+			printf("WARNING: kangs make more than 2^%.0f jumps, they are reseeded at this limit and their DP replays are long, compact DPs are not recommended for this range and herd\r\n", log2((double)(COMPACT_MAX_JUMPS / 2)));
+	}
+
+//prepare jumps
+	TJmpStrategy jmp_st;
+	SetDefaultJmpStrategy(&jmp_st);
+	if (Params.JmpProfileName[0])
+	{
+		TJmpProfile profile;
+		int herd_bits = (int)(log2((double)total_kangs) + 0.5);
+		TJmpProfileRec* rec = profile.LoadFromFile(Params.JmpProfileName) ? profile.Find(Range, herd_bits) : NULL;
+		if (rec)
+		{
+			jmp_st = rec->st;
+			if ((rec->range != Range) || (rec->herd_bits != herd_bits))
+				printf("No jumps profile for range %d and herd 2^%d, use closest one: range %d, herd 2^%d\r\n", Range, herd_bits, rec->range, rec->herd_bits);
+		}
+		else
+			printf("Cannot load jumps profile, use default jumps\r\n");
+	}
+	char jmp_str[128];
+	GetJmpStrategyStr(&jmp_st, jmp_str);
+	printf("Jumps: %s\r\n", jmp_str);
+
+	PrepareJumps(&jmp_st, Range, GetKangCfg()->JmpCnt);
+	SetRndSeed(GetTickCount64());
+	EcInt rnd;
+	rnd.RndBits(64);
+	RunSeed = rnd.data[0];
+	NextSeedId = 0;
+	db.SetRecLen(DPFormats[DPFmt].rec_len + ((GenMode && (Params.TamesRam > 0)) ? TAME_SCORE_LEN : 0));
+
+	if (!GenMode && Params.TamesFileName[0])
+	{
+		printf("load tames...\r\n");
+		if (db.LoadFromFile(Params.TamesFileName))
+		{
+			printf("tames loaded\r\n");
+			if (db.Header[0] != Params.Range)
+			{
+				printf("loaded tames have different range, they cannot be used, clear\r\n");
+				db.Clear();
+			}
+			else
+				if (*(u32*)(db.Header + TAMES_HDR_JMP_HASH) && (*(u32*)(db.Header + TAMES_HDR_JMP_HASH) != JumpsHash))
+				{
+					printf("loaded tames were made with different jumps, they cannot be used, clear\r\n");
+					db.Clear();
+				}
+				else
+					if (db.GetRecLen() != DPFormats[DPFmt].rec_len)
+					{
+						printf("loaded tames have different records format (use -compact option for compact tames), they cannot be used, clear\r\n");
+						db.SetRecLen(DPFormats[DPFmt].rec_len);
+					}
+					else
+						if (Params.Compact && ((*(u32*)(db.Header + TAMES_HDR_MD_LEN) != GetKangCfg()->MdLen) || (*(u32*)(db.Header + TAMES_HDR_STEP_CNT) != GetKangCfg()->StepCnt)))
+						{
+							printf("loaded tames were made with different MdLen or StepCnt, they cannot be replayed, clear\r\n");
+							db.Clear();
+						}
+						else
+						{
+							if (db.Header[1] && (db.Header[1] != DPBits))
+								printf("loaded tames have different DP, DP cannot be increased during work\r\n");
+							if (Params.Compact)
+							{
+								RunSeed = *(u64*)(db.Header + TAMES_HDR_RUN_SEED);
+								NextSeedId = *(u32*)(db.Header + TAMES_HDR_SEED_CNT);
+							}
+						}
+		}
+		else
+		{
+			printf("tames loading failed\r\n");
+			db.SetRecLen(DPFormats[DPFmt].rec_len);
+		}
+	}
+	return true;
+}
+
+bool RCSolver::SolvePoint(EcPoint pnt, int Range, double DP, EcInt* pk_res, TTargetState* ts)
+{
+	IsPreempted = false;
+	if ((Range < 32) || (Range > 180))
+	{
+		printf("Unsupported Range value (%d)!\r\n", Range);
+		return false;
+	}
+
+	u64 total_kangs = 0;
+	u64 max_gpu_jumps = 0;
+	for (int i = 0; i < GpuCnt; i++)
+	{
+		u64 cnt = GpuKangs[i]->CalcKangCnt();
+		total_kangs += cnt;
+		if (cnt * GpuKangs[i]->Cfg.StepCnt > max_gpu_jumps)
+			max_gpu_jumps = cnt * GpuKangs[i]->Cfg.StepCnt;
+	}
+	//without GPUs herd is made by CPU walkers only, CheckBackends limits them by thread pool size
+	if (!GpuCnt)
+	{
+		int thr_cnt = (CpuWalkersReq < GetThreadPool()->GetWorkerCnt()) ? CpuWalkersReq : GetThreadPool()->GetWorkerCnt();
+		total_kangs = (u64)thr_cnt * CpuWalkerKangs;
+		if (!total_kangs || Params.Compact || (GenMode && (Params.TamesRam > 0)))
+		{
+			printf("No supported GPUs detected and no CPU walkers can be used!\r\n");
+			return false;
+		}
+	}
+	double ops = 1.15 * pow(2.0, Range / 2.0);
+	DPFmt = Params.Compact ? DP_FMT_COMPACT : DP_FMT_FULL;
+	//replay of compact DPs is made with config of first GPU
+	if (Params.Compact)
+		for (int i = 1; i < GpuCnt; i++)
+			if ((GpuKangs[i]->Cfg.MdLen != GpuKangs[0]->Cfg.MdLen) || (GpuKangs[i]->Cfg.StepCnt != GpuKangs[0]->Cfg.StepCnt))
+			{
+				printf("Compact DPs require same MdLen and StepCnt for all GPUs!\r\n");
+				return false;
+			}
+
+	//in time-sliced solving DP, jumps, run seed and tames are set once for all targets, DB keeps tames of all targets
+	if (!ts || !SliceSession)
+	{
+		if (!PrepareSolve(Range, DP, total_kangs, max_gpu_jumps, ops))
+			return false;
+		SliceSession = (ts != NULL);
+	}
+	else
+		if (ts->started)
+			printf("\r\nResuming point: Range %d bits, DP %.3f, done 2^%.3f ops\r\n", Range, GetDPValue(), log2((double)ts->ops + 1));
+		else
+			printf("\r\nSolving point: Range %d bits, DP %.3f, %lluK DPs in DB\r\n", Range, GetDPValue(), db.GetBlockCnt() / 1000);
+	IsOpsLimit = false;
+	double MaxTotalOps = (Params.Max > 0) ? Params.Max * ops : 0.0;
+
+	double tames_dp = db.Header[1] ? (db.Header[1] + log2(64.0 / (db.Header[2] ? db.Header[2] : 64))) : GetDPValue();
+	double tames_ops = db.GetBlockCnt() * pow(2.0, tames_dp);
+	if (db.GetBlockCnt() && (*(double*)(db.Header + TAMES_HDR_OPS) > 0))
+		tames_ops = *(double*)(db.Header + TAMES_HDR_OPS); //pruned tames
+	double herd_parts[3];
+	if (ts && ts->started)
+		memcpy(herd_parts, ts->herd_parts, sizeof(herd_parts)); //resumed herd keeps its composition
+	else
+	{
+		double herd_ops = SelectHerd(herd_parts, ops, tames_ops);
+		printf("Herd: tames %.1f%%, wild1 %.1f%%, wild2 %.1f%%", 100 * herd_parts[TAME], 100 * herd_parts[WILD1], 100 * herd_parts[WILD2]);
+		if (herd_ops < ops)
+			printf(", estimated ops with loaded tames: 2^%.3f", log2(herd_ops));
+		printf("\r\n");
+	}
+
+	PntTotalOps = ts ? ts->ops : 0;
+	DroppedDPs = 0;
+	PntIndex = 0;
+
+	Int_HalfRange.Set(1);
+	Int_HalfRange.ShiftLeft(Range - 1);
+	Pnt_HalfRange = ec.MultiplyG(Int_HalfRange);
+	Pnt_NegHalfRange = Pnt_HalfRange;
+	Pnt_NegHalfRange.y.NegModP();
+	Int_TameOffset.Set(1);
+	Int_TameOffset.ShiftLeft(Range - 1);
+	EcInt tt;
+	tt.Set(1);
+	tt.ShiftLeft(Range - 5); //half of tame range width
+	Int_TameOffset.Sub(tt);
+	PntToSolve = pnt;
+
+	CurRange = Range;
+	memcpy(CurHerdParts, herd_parts, sizeof(herd_parts));
+	CpuDPThr = GetDPThr();
+
+	Solved = false;
+	if (ts)
+	{
+		memcpy(ts->herd_parts, herd_parts, sizeof(herd_parts));
+		ts->started = true;
+		SwapInTarget(ts);
+	}
+
+//prepare GPUs
+	for (int i = 0; i < GpuCnt; i++)
+	{
+		GpuKangs[i]->Checkpoint = ts ? &ts->chk[i] : NULL;
+		GpuKangs[i]->MaxKangJumps = Params.Compact ? COMPACT_MAX_JUMPS / 2 : 0;
+		memcpy(GpuKangs[i]->HerdParts, herd_parts, sizeof(herd_parts));
+		if (!GpuKangs[i]->Prepare(PntToSolve, Range, DPBits, GetDPThr(), EcJumps1, EcJumps2, EcJumps3))
+		{
+			GpuKangs[i]->Failed = true;
+			printf("GPU %d Prepare failed\r\n", GpuKangs[i]->CudaIndex);
+		}
+		if (GenMode && (Params.TamesRam > 0))
+			TameKangStats[GpuKangs[i]->CudaIndex] = (TTameKangStat*)calloc(GpuKangs[i]->CalcKangCnt(), sizeof(TTameKangStat));
+	}
+
+	u64 tm0 = GetTickCount64();
+	printf("GPUs started...\r\n");
+
+	ThrCnt = 0;
+	for (int i = 0; (i < GpuCnt) && !Solved; i++)
+	{
+		GpuRestarts[i] = 0;
+		StartGpuThread(i);
+	}
+	if (SwitchStart)
+	{
+		int ms = (int)(GetTickCount64() - SwitchStart);
+		SwitchMs += ms;
+		SwitchCnt++;
+		SwitchStart = 0;
+		printf("Target switched in %d ms\r\n", ms);
+	}
+	u64 slice_end = SliceMs ? tm0 + SliceMs : 0;
+	CpuStopFlag = false;
+	CpuWalkerCnt = 0;
+	CpuGroup.Pending = 0;
+	CpuOps = 0;
+	CpuOpsLast = 0;
+	CpuOpsTime = GetTickCount64();
+	CpuSpeed = 0;
+
+	bool can_raise_dp = !db.Header[1] || (db.Header[1] == DPBits);
+	bool dp_at_max = false;
+	double ram_budget = GetRamBudget();
+	u64 tm_stats = GetTickCount64();
+	u64 tm_progress = tm_stats;
+	while (!Solved)
+	{
+		CheckNewPoints();
+		PruneDBStep(DB_PRUNE_STEP_US);
+		Sleep(10);
+		if (GetTickCount64() - tm_progress > 1000)
+		{
+			if (!CheckBackends())
+			{
+				printf("All GPUs failed and no CPU walkers, solving stopped\r\n");
+				break;
+			}
+			UpdateCpuSpeed();
+			ReportProgress(tm0, ops);
+			tm_progress = GetTickCount64();
+		}
+		if (GetTickCount64() - tm_stats > 10 * 1000)
+		{
+			ShowStats(tm0, ops, pow(2.0, GetDPValue()));
+			tm_stats = GetTickCount64();
+			double db_ram = CalcDBRam((double)db.GetBlockCnt(), DPFormats[DPFmt].rec_size);
+			if (!dp_at_max && !db.IsPruning() && (db_ram > 0.8 * ram_budget) && (!can_raise_dp || !RaiseDP()))
+			{
+				printf("WARNING: DB is close to RAM budget, but DP cannot be increased (%s)\r\n", can_raise_dp ? "max DP for this run is reached" : "loaded tames have different DP");
+				dp_at_max = true;
+			}
+			//DB in swap makes work very slow, so stop, in tames generation mode tames are saved as on ops limit
+			if (dp_at_max && !db.IsPruning() && (db_ram > ram_budget))
+			{
+				printf("DB exceeds RAM budget %.3f GB and DP cannot be increased, %s stopped\r\n", ram_budget, GenMode ? "tames generation" : "solving");
+				IsOpsLimit = GenMode;
+				break;
+			}
+		}
+
+		if ((MaxTotalOps > 0.0) && (PntTotalOps > MaxTotalOps))
+		{
+			IsOpsLimit = true;
+			printf("Operations limit reached\r\n");
+			break;
+		}
+		if (CancelFlag)
+		{
+			printf("Solving cancelled\r\n");
+			break;
+		}
+		if (ts && ((slice_end && (GetTickCount64() >= slice_end)) || !ts->weight))
+		{
+			IsPreempted = true;
+			SwitchStart = GetTickCount64();
+			printf("Time slice is over, point is preempted\r\n");
+			break;
+		}
+	}
+
+	printf("Stopping work ...\r\n");
+	StopBackends();
+	PruneDBStep(0);
+	for (int i = 0; i < GpuCnt; i++)
+		GpuKangs[i]->Checkpoint = NULL;
+	if (ts && IsPreempted)
+		CheckNewPoints(); //DPs sent by GPUs before stop
+	WaitReplays();
+	if (Solved)
+	{
+		IsOpsLimit = false;
+		IsPreempted = false;
+	}
+	if (ts)
+	{
+		ts->ops = PntTotalOps;
+		SwapOutTarget(ts, Solved || !IsPreempted);
+	}
+
+	if (IsOpsLimit || !Solved)
+	{
+		if (GenMode && IsOpsLimit)
+		{
+			*(double*)(db.Header + TAMES_HDR_OPS) = 0;
+			if (Params.TamesRam > 0)
+			{
+				printf("pruning tames...\r\n");
+				*(double*)(db.Header + TAMES_HDR_OPS) = PruneTames();
+			}
+			printf("saving tames...\r\n");
+			db.Header[0] = Params.Range; 
+			db.Header[1] = DPBits;
+			db.Header[2] = DPMul;
+			*(u32*)(db.Header + TAMES_HDR_JMP_HASH) = JumpsHash;
+			if (Params.Compact)
+			{
+				*(u64*)(db.Header + TAMES_HDR_RUN_SEED) = RunSeed;
+				*(u32*)(db.Header + TAMES_HDR_SEED_CNT) = NextSeedId;
+				*(u32*)(db.Header + TAMES_HDR_MD_LEN) = GetKangCfg()->MdLen;
+				*(u32*)(db.Header + TAMES_HDR_STEP_CNT) = GetKangCfg()->StepCnt;
+			}
+			if (db.SaveToFile(Params.TamesFileName))
+				printf("tames saved\r\n");
+			else
+				printf("tames saving failed\r\n");
+		}
+		if (!ts)
+			db.Clear();
+		for (int i = 0; i < MAX_GPU_CNT; i++)
+		{
+			free(TameKangStats[i]);
+			TameKangStats[i] = NULL;
+		}
+		return false;
+	}
+
+	double K = (double)PntTotalOps / pow(2.0, Range / 2.0);
+	printf("Point solved, K: %.3f (with DP and GPU overheads)\r\n\r\n", K);
+	if (!ts)
+		db.Clear();
+	*pk_res = PrivKey;
+	return true;
+}
+
+TMachineProfileRec* RCSolver::FindCpuProfile()
+{
+	char hw_id[128];
+	GetCpuHwId(hw_id);
+	return MachineProfile.Find(hw_id);
+}
+
+//threads for CPU work, from machine profile, 0 - all CPUs
+int RCSolver::GetCpuThrCnt()
+{
+	TMachineProfileRec* rec = FindCpuProfile();
+	return rec ? rec->thr_cnt : 0;
+}
+
+//MKeys/s from machine profile if GPU was autotuned
+double RCSolver::EstimateGpusSpeed()
+{
+	double speed = 0;
+	for (int i = 0; i < GpuCnt; i++)
+	{
+		char hw_id[128];
+		GetGpuHwId(GpuKangs[i]->CudaIndex, hw_id);
+		TMachineProfileRec* rec = MachineProfile.Find(hw_id);
+		speed += (rec && (rec->speed > 0)) ? rec->speed : 50.0 * GpuKangs[i]->mpCnt;
+	}
+	return speed;
+}
+
+//BSGS is faster for small ranges and for many points because baby table is built once for all points
+//kangaroo time includes setup and DP overhead of every kang, returns -1 if no engine can be used
+int RCSolver::SelectEngine(int pnt_cnt, int* baby_bits)
+{
+	*baby_bits = CalcBsgsBits(Params.Range, pnt_cnt, GetRamBudget());
+	if (Params.Engine == ENGINE_BSGS)
+	{
+		if (*baby_bits)
+			return ENGINE_BSGS;
+		printf("BSGS cannot be used: range must be %d bits or less and baby table must fit RAM\r\n", BSGS_MAX_RANGE);
+		return -1;
+	}
+	//without GPUs kangaroo method works on CPU walkers only, it's used if requested or if BSGS cannot be used
+	if (!GpuCnt)
+	{
+		if (*baby_bits && (Params.Engine != ENGINE_KANG))
+			return ENGINE_BSGS;
+		if (Params.CpuThreads > 0)
+			return ENGINE_KANG;
+		printf("No supported GPUs detected, BSGS cannot be used for this range and no CPU walkers requested (-cpu)\r\n");
+		return -1;
+	}
+	if ((Params.Engine == ENGINE_KANG) || !*baby_bits)
+		return ENGINE_KANG;
+
+	u64 total_kangs = 0;
+	for (int i = 0; i < GpuCnt; i++)
+		total_kangs += GpuKangs[i]->CalcKangCnt();
+	double kang_ops = 1.15 * pow(2.0, Params.Range / 2.0) + total_kangs * pow(2.0, (Params.DP > 0) ? Params.DP : 14);
+	double t_kang = pnt_cnt * (1.0 + kang_ops / (1000000 * EstimateGpusSpeed()));
+	//CPU walker jump and BSGS step are both one point addition with batch inversion, so autotuned walker speed is used for BSGS
+	TMachineProfileRec* rec = FindCpuProfile();
+	int thr_cnt = rec ? rec->thr_cnt : 0;
+	double thr_speed = (thr_cnt && (rec->speed > 0)) ? rec->speed * 1000000 / thr_cnt : 0;
+	double t_bsgs = EstimateBsgsTime(Params.Range, *baby_bits, pnt_cnt, thr_cnt ? thr_cnt : GetCpuCnt(), thr_speed);
+	printf("Estimated time: kangaroo %.1f sec, BSGS %.1f sec (baby table %.3f GB)\r\n", t_kang, t_bsgs, CalcBsgsRam(*baby_bits));
+	return (t_bsgs < t_kang) ? ENGINE_BSGS : ENGINE_KANG;
+}
+
+//pk is relative to Params.Start, checks the key and passes it to callback
+bool RCSolver::ReportKey(int pnt_ind, EcInt& pk, EcPoint& pub)
+{
+	EcInt pk_found = pk;
+	pk_found.AddModP(Params.Start);
+	EcPoint tmp = ec.MultiplyG(pk_found);
+	if (!tmp.IsEqual(pub))
+	{
+		printf("FATAL ERROR: incorrect key found\r\n");
+		return false;
+	}
+	if (Callbacks.OnKeyFound)
+		Callbacks.OnKeyFound(pnt_ind, pk_found, Callbacks.ctx);
+	return true;
+}
+
+void RCSolver::ReportNotFound(int pnt_ind, int cnt, int reason)
+{
+	const char* reasons[4] = { "key is out of range", "operations limit reached", "cancelled", "solving failed" };
+	printf("Public key %d of %d: NOT FOUND, %s\r\n", pnt_ind + 1, cnt, reasons[reason]);
+	if (Callbacks.OnKeyNotFound)
+		Callbacks.OnKeyNotFound(pnt_ind, reason, Callbacks.ctx);
+}
+
+RCSolver::RCSolver()
+{
+	pPntList = (TDPRec*)malloc(MAX_CNT_LIST * sizeof(TDPRec));
+	pPntList2 = (TDPRec*)malloc(MAX_CNT_LIST * sizeof(TDPRec));
+	PntIndex = 0;
+	DroppedDPs = 0;
+	GpuCnt = 0;
+	ThrCnt = 0;
+	LastJmpKeyValid = false;
+	Bsgs = NULL;
+	CancelFlag = false;
+	TotalErrors = 0;
+	CurPntInd = -1;
+	Targets = NULL;
+	TargetCnt = 0;
+	SliceSession = false;
+	SliceMs = 0;
+	SwitchStart = 0;
+	IsPreempted = false;
+	CpuWalkersReq = 0;
+	CpuWalkerCnt = 0;
+	CpuStopFlag = false;
+	CpuGroup.Pending = 0;
+	ReplayGroup.Pending = 0;
+	CpuOps = 0;
+	CpuSpeed = 0;
+	memset(GpuThrActive, 0, sizeof(GpuThrActive));
+	IsBench = false;
+	GenMode = false;
+	IsAutotune = false;
+	NextSeedId = 0;
+	SetDefaultSolveParams(&Params);
+	memset(&Callbacks, 0, sizeof(Callbacks));
+	memset(&WalkCfg, 0, sizeof(WalkCfg));
+	SetDefaultWalkCfg(&CpuCfg, false);
+	CpuWalkerKangs = CPU_WALKER_KANGS;
+	memset(GPUs_Mask, 1, sizeof(GPUs_Mask));
+	memset(TameKangStats, 0, sizeof(TameKangStats));
+}
+
+RCSolver::~RCSolver()
+{
+	Release();
+	free(pPntList2);
+	free(pPntList);
+}
+
+void RCSolver::Release()
+{
+	for (int i = 0; i < GpuCnt; i++)
+		delete GpuKangs[i];
+	GpuCnt = 0;
+}
+
+//enumerates GPUs once, they are used by all solves of this context
+//gpus_mask - MAX_GPU_CNT flags, walk_cfg - non-zero fields override configs from machine profile
+//in autotune mode autotuner sets GPU configs itself
+void RCSolver::Init(u8* gpus_mask, TWalkCfg* walk_cfg, TMachineProfile* profile, bool autotune)
+{
+	Release();
+	memcpy(GPUs_Mask, gpus_mask, sizeof(GPUs_Mask));
+	WalkCfg = *walk_cfg;
+	if (profile)
+		MachineProfile = *profile;
+	IsAutotune = autotune;
+	InitGpus();
+	//autotuned CPU walkers: kangs per walker, and JmpCnt and MdLen if there are no GPUs and user didn't set them
+	TMachineProfileRec* rec = FindCpuProfile();
+	//older profiles keep default GPU config for CPU, GroupCnt is 1 for CPU autotune results
+	CpuWalkerKangs = (rec && (rec->cfg.GroupCnt == 1) && rec->cfg.BlockSize) ? rec->cfg.BlockSize : CPU_WALKER_KANGS;
+	GetWalkCfg(&CpuCfg, false, NULL, &WalkCfg);
+	if (rec && !WalkCfg.JmpCnt && !WalkCfg.MdLen)
+	{
+		CpuCfg.JmpCnt = rec->cfg.JmpCnt;
+		CpuCfg.MdLen = rec->cfg.MdLen;
+	}
+}
+
+//can be called from any thread, current solve stops as soon as possible
+void RCSolver::Cancel()
+{
+	CancelFlag = true;
+	csBsgs.Enter();
+	if (Bsgs)
+		Bsgs->Stop();
+	csBsgs.Leave();
+}
+
+//main mode, keys of targets are in [Start, Start + 2^Range)
+//returns number of solved targets, -1 if solving failed
+int RCSolver::Solve(EcPoint* targets, int cnt, TSolveParams* params, TSolveCallbacks* cb)
+{
+	Params = *params;
+	CpuWalkersReq = Params.CpuThreads;
+	if (cb)
+		Callbacks = *cb;
+	else
+		memset(&Callbacks, 0, sizeof(Callbacks));
+	CancelFlag = false;
+	GenMode = false;
+	IsBench = false;
+	char sx[100];
+	Params.Start.GetHexStr(sx);
+	printf("Public keys to solve: %d, range %d bits, offset: %s\r\n", cnt, Params.Range, sx);
+
+	//points with keys in [0, 2^Range), target equal to Start has zero offset and is solved here, engines cannot take infinity
+	std::vector <EcPoint> pnts(cnt);
+	std::vector <int> state(cnt, TARGET_LEFT);
+	int solved = 0;
+	int left = 0;
+	EcPoint PntStart, PntOfs;
+	if (!Params.Start.IsZero())
+	{
+		PntStart = ec.MultiplyG(Params.Start);
+		PntOfs = PntStart;
+		PntOfs.y.NegModP();
+	}
+	for (int i = 0; i < cnt; i++)
+	{
+		if (Params.Start.IsZero())
+			pnts[i] = targets[i];
+		else
+		if (targets[i].IsEqual(PntStart))
+		{
+			EcInt zero;
+			zero.SetZero();
+			if (!ReportKey(i, zero, targets[i]))
+				return -1;
+			state[i] = TARGET_SOLVED;
+			solved++;
+			continue;
+		}
+		else
+		if (targets[i].x.IsEqual(PntStart.x))
+			pnts[i] = ec.DoublePoint(PntOfs); //target is -Start*G
+		else
+			pnts[i] = ec.AddPoints(targets[i], PntOfs);
+		left++;
+	}
+
+	int res = left ? SolveLeft(targets, pnts.data(), cnt, state.data(), left) : 0;
+	for (int i = 0; i < cnt; i++)
+	{
+		if (state[i] == TARGET_SOLVED)
+			continue;
+		if (state[i] == TARGET_LEFT)
+			state[i] = CancelFlag ? NOT_FOUND_CANCELLED : NOT_FOUND_FAILED;
+		ReportNotFound(i, cnt, state[i]);
+	}
+	CurPntInd = -1;
+	return (res < 0) ? -1 : solved + res;
+}
+
+//solves targets with TARGET_LEFT state by selected engine and sets their states, left is number of such targets
+//returns number of solved targets, -1 if solving failed
+int RCSolver::SolveLeft(EcPoint* targets, EcPoint* pnts, int cnt, int* state, int left)
+{
+	int baby_bits;
+	int engine = SelectEngine(left, &baby_bits);
+	if (engine < 0)
+		return -1;
+	int solved = 0;
+	if (engine == ENGINE_BSGS)
+	{
+		printf("\r\nBSGS engine\r\n");
+		RCBsgs* bsgs = new RCBsgs();
+		csBsgs.Enter();
+		Bsgs = bsgs;
+		csBsgs.Leave();
+		std::vector <int> inds;
+		std::vector <EcPoint> bpnts;
+		for (int i = 0; i < cnt; i++)
+			if (state[i] == TARGET_LEFT)
+			{
+				inds.push_back(i);
+				bpnts.push_back(pnts[i]);
+			}
+		std::vector <EcInt> keys(left);
+		bool* found = new bool[left];
+		memset(found, 0, left);
+		bool built = !CancelFlag && bsgs->Build(Params.Range, baby_bits, GetCpuThrCnt());
+		if (built)
+			bsgs->Solve(bpnts.data(), left, keys.data(), found);
+		csBsgs.Enter();
+		Bsgs = NULL;
+		csBsgs.Leave();
+		delete bsgs;
+		for (int k = 0; k < left; k++)
+		{
+			int i = inds[k];
+			if (found[k])
+			{
+				if (ReportKey(i, keys[k], targets[i]))
+				{
+					state[i] = TARGET_SOLVED;
+					solved++;
+				}
+				else
+					state[i] = NOT_FOUND_FAILED;
+			}
+			else
+			if (built && !CancelFlag)
+				state[i] = NOT_FOUND_OUT_OF_RANGE; //BSGS checks whole range
+		}
+		delete[] found;
+		if (!built && !CancelFlag)
+		{
+			printf("FATAL ERROR: BSGS table building failed\r\n");
+			return -1;
+		}
+		return solved;
+	}
+
+	if ((Params.SliceSec > 0) && (left > 1))
+		return SolveSliced(targets, pnts, cnt, state);
+
+	char sx[100], sy[100];
+	for (int i = 0; (i < cnt) && !CancelFlag; i++)
+	{
+		if (state[i] != TARGET_LEFT)
+			continue;
+		targets[i].x.GetHexStr(sx);
+		targets[i].y.GetHexStr(sy);
+		printf("\r\nSolving public key %d of %d\r\nX: %s\r\nY: %s\r\n", i + 1, cnt, sx, sy);
+		CurPntInd = i;
+		EcInt pk_found;
+		if (!SolvePoint(pnts[i], Params.Range, Params.DP, &pk_found))
+		{
+			if (IsOpsLimit || CancelFlag)
+			{
+				state[i] = IsOpsLimit ? NOT_FOUND_OPS_LIMIT : NOT_FOUND_CANCELLED;
+				continue;
+			}
+			printf("FATAL ERROR: SolvePoint failed\r\n");
+			state[i] = NOT_FOUND_FAILED;
+			return -1;
+		}
+		if (!ReportKey(i, pk_found, targets[i]))
+		{
+			state[i] = NOT_FOUND_FAILED;
+			return -1;
+		}
+		state[i] = TARGET_SOLVED;
+		solved++;
+	}
+	return solved;
+}
+
+//solves random point until ops limit (Params.Max) is reached and saves tames to Params.TamesFileName
+bool RCSolver::GenerateTames(TSolveParams* params, TSolveCallbacks* cb)
+{
+	Params = *params;
+	CpuWalkersReq = Params.CpuThreads;
+	if (cb)
+		Callbacks = *cb;
+	else
+		memset(&Callbacks, 0, sizeof(Callbacks));
+	CancelFlag = false;
+	GenMode = true;
+	IsBench = false;
+	printf("\r\nTAMES GENERATION MODE\r\n");
+	if (!Params.Range)
+		Params.Range = 78;
+	if (!Params.DP && (Params.RamLimit == 0.0))
+		Params.DP = 16;
+	EcInt pk, pk_found;
+	pk.RndBits(Params.Range);
+	EcPoint pnt = ec.MultiplyG(pk);
+	if (!SolvePoint(pnt, Params.Range, Params.DP, &pk_found) && !IsOpsLimit && !CancelFlag)
+		printf("FATAL ERROR: SolvePoint failed\r\n");
+	GenMode = false;
+	return IsOpsLimit;
+}
+
+//solves random points and shows K, pnt_cnt - 0 means until Cancel
+void RCSolver::Bench(TSolveParams* params, TSolveCallbacks* cb, int pnt_cnt)
+{
+	Params = *params;
+	CpuWalkersReq = Params.CpuThreads;
+	if (cb)
+		Callbacks = *cb;
+	else
+		memset(&Callbacks, 0, sizeof(Callbacks));
+	CancelFlag = false;
+	GenMode = false;
+	IsBench = true;
+	printf("\r\nBENCHMARK MODE\r\n");
+	if (!Params.Range)
+		Params.Range = 78;
+	if (!Params.DP && (Params.RamLimit == 0.0))
+		Params.DP = 16;
+	u64 TotalOps = 0;
+	u32 TotalSolved = 0;
+	while (!CancelFlag && (!pnt_cnt || ((int)TotalSolved < pnt_cnt)))
+	{
+		EcInt pk, pk_found;
+		EcPoint pnt;
+
+		//generate random pk
+		pk.RndBits(Params.Range);
+		pnt = ec.MultiplyG(pk);
+
+		if (!SolvePoint(pnt, Params.Range, Params.DP, &pk_found))
+		{
+			if (!IsOpsLimit && !CancelFlag)
+				printf("FATAL ERROR: SolvePoint failed\r\n");
+			break;
+		}
+		if (!pk_found.IsEqual(pk))
+		{
+			printf("FATAL ERROR: Found key is wrong!\r\n");
+			break;
+		}
+		TotalOps += PntTotalOps;
+		TotalSolved++;
+		u64 ops_per_pnt = TotalOps / TotalSolved;
+		double K = (double)ops_per_pnt / pow(2.0, Params.Range / 2.0);
+		printf("Points solved: %d, average K: %.3f (with DP and GPU overheads)\r\n", TotalSolved, K);
+	}
+	IsBench = false;
+}
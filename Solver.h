@@ -0,0 +1,237 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#pragma once
+
+#include <vector>
+#include "defs.h"
+#include "utils.h"
+#include "GpuKang.h"
+#include "Jumps.h"
+#include "Autotune.h"
+#include "ThreadPool.h"
+
+//engines for main mode
+#define ENGINE_AUTO			0
+#define ENGINE_KANG			1
+#define ENGINE_BSGS			2
+
+//parameters of one solve, zero values - auto
+struct TSolveParams
+{
+	int Range;
+	double DP;
+	EcInt Start; //keys of targets are in [Start, Start + 2^Range)
+	double Max; //ops limit in 1.15*2^(Range/2) units
+	double RamLimit; //RAM budget for DPs in GB
+	char TamesFileName[1024];
+	double Herd[3]; //TAME, WILD1, WILD2 parts of herd
+	char JmpProfileName[1024];
+	bool Compact; //compact DPs without distances
+	double TamesRam; //RAM for pruned tames in GB, tames generation only
+	int Engine;
+	int SliceSec; //time slice of target when many targets are solved by kangaroos, 0 - targets are solved one by one
+	int CpuThreads; //CPU walkers that work together with GPUs in kangaroo mode, more can be added by AddCpuWalkers during solving
+};
+
+void SetDefaultSolveParams(TSolveParams* params);
+
+struct TSolveProgress
+{
+	int pnt_ind; //index of target, -1 in benchmark and tames generation
+	int speed; //MKeys/s
+	u64 ops; //ops of current point
+	double exp_ops;
+	u64 dps_cnt;
+	u32 errors;
+	u64 merged_kangs; //kangs reseeded because they followed same-type kangs
+	int gpus_active; //GPUs that work now, failed GPUs are restarted with new herd
+	int cpu_walkers;
+	double db_prune; //progress of DB pruning after DP increase 0..1, 1 - not active
+	u64 dropped_dps; //compact DPs that were too far from kang start
+	u64 time_ms;
+};
+
+//reasons for OnKeyNotFound
+#define NOT_FOUND_OUT_OF_RANGE	0 //whole range was checked by BSGS
+#define NOT_FOUND_OPS_LIMIT		1 //TSolveParams.Max is reached
+#define NOT_FOUND_CANCELLED		2
+#define NOT_FOUND_FAILED		3 //solving error
+
+//callbacks are called from the thread that runs solve, ctx is passed as is
+struct TSolveCallbacks
+{
+	void* ctx;
+	void (*OnProgress)(TSolveProgress* progress, void* ctx); //once per second
+	void (*OnKeyFound)(int pnt_ind, EcInt& key, void* ctx); //key is checked and includes Start
+	void (*OnKeyNotFound)(int pnt_ind, int reason, void* ctx); //called for every target that is not solved, see NOT_FOUND_xxx
+};
+
+void GetWalkCfg(TWalkCfg* cfg, bool old_gpu, TMachineProfileRec* rec, TWalkCfg* user_cfg);
+
+struct TTameKangStat;
+struct TTargetState;
+struct DBRecCompact;
+struct TReplayTask;
+
+//keeps DPs with level below new DP multiplier when DP is increased
+struct TDPLevelCtx
+{
+	int rec_len;
+	u32 level;
+};
+
+//solver context, keeps GPUs, jumps and DB between solves, so many solves can run in one process
+//it's big (DB index), create it by new. InitEc must be called before.
+class RCSolver
+{
+private:
+	EcJMP EcJumps1[MAX_JMP_CNT];
+	EcJMP EcJumps2[MAX_JMP_CNT];
+	EcJMP EcJumps3[MAX_JMP_CNT];
+	u32 JumpsHash; //hash of current jump tables, stored in tames header
+	TJmpTablesKey LastJmpKey;
+	bool LastJmpKeyValid;
+
+	volatile bool Solved;
+	volatile bool CancelFlag;
+	class RCBsgs* Bsgs; //BSGS solver while it works, for Cancel
+	CriticalSection csBsgs;
+	EcInt Int_HalfRange;
+	EcPoint Pnt_HalfRange;
+	EcPoint Pnt_NegHalfRange;
+	EcInt Int_TameOffset;
+	Ec ec;
+
+	CriticalSection csAddPoints;
+	TTaskGroup ReplayGroup; //replays of compact DPs for collisions, they run in thread pool
+	CriticalSection csReplay;
+	TDPRec* pPntList;
+	TDPRec* pPntList2;
+	volatile int PntIndex;
+	TFastBase db;
+	EcPoint PntToSolve;
+	EcInt PrivKey;
+
+	u64 PntTotalOps;
+	u64 DroppedDPs;
+	bool IsBench;
+	TSolveParams Params;
+	TSolveCallbacks Callbacks;
+	int CurPntInd;
+	u8 GPUs_Mask[MAX_GPU_CNT];
+	TWalkCfg WalkCfg; //walk config from user, zero fields - default for GPU
+	TWalkCfg CpuCfg; //walk config of CPU walkers if there are no GPUs
+	bool IsAutotune;
+	bool IsOpsLimit;
+	u32 NextSeedId;
+	CriticalSection csSeeds;
+	TTameKangStat* TameKangStats[MAX_GPU_CNT]; //by cuda index of GPU
+	int DPBits;
+	int DPMul;
+	int DPFmt;
+	//DB pruning after DP increase is done by steps between DP batches, so ingestion is not stopped
+	TDPLevelCtx RaiseDPCtx;
+	u64 RaiseDPStart;
+	int CurRange;
+	double CurHerdParts[3];
+
+	//backends of running solve: GPU threads are restarted after failure, CPU walkers can be added at any time
+	HHANDLER GpuThr[MAX_GPU_CNT];
+	bool GpuThrActive[MAX_GPU_CNT]; //thread was started and not joined yet
+	int GpuRestarts[MAX_GPU_CNT];
+	u64 GpuFailTime[MAX_GPU_CNT];
+	volatile long CpuWalkersReq;
+	int CpuWalkerCnt;
+	int CpuWalkerKangs; //kangs per CPU walker, from machine profile
+	volatile bool CpuStopFlag;
+	volatile u64 CpuDPThr;
+	TTaskGroup CpuGroup;
+	CriticalSection csCpu;
+	u64 CpuOps;
+	u64 CpuOpsLast;
+	u64 CpuOpsTime;
+	double CpuSpeed; //MKeys/s
+
+	//time-sliced solving of many targets
+	TTargetState* Targets;
+	int TargetCnt;
+	CriticalSection csTargets;
+	bool SliceSession; //DP, jumps and tames are prepared for all targets
+	u64 SliceMs; //0 - no preemption
+	bool IsPreempted;
+	u64 SwitchStart;
+	u64 SwitchCnt;
+	u64 SwitchMs;
+
+	void SetDPValue(double dp);
+	double GetDPValue();
+	u64 GetDPThr();
+	void PrepareJumps(TJmpStrategy* st, int Range, int jmp_cnt);
+	void InitGpus();
+	bool Collision_SOTA(EcPoint& pnt, EcInt t, int TameType, EcInt w, int WildType, bool IsNeg);
+	bool CheckCollision(EcInt& d1, int type1, EcInt& d2, int type2);
+	bool ReplayDP(DBRecCompact* rec, EcInt& dist);
+	void SubmitReplay(u8* rec1, u8* rec2, EcInt* d2, int type2);
+	void WaitReplays();
+	void AddTameWithScore(u8* rec, int rec_len, TDPRec* p);
+	bool CheckNewPointCompact(TDPRec* p, u32 level);
+	void ReseedMergedKang(TDPRec* p);
+	u64 GetMergedKangs();
+	void CheckNewPoints();
+	void ShowStats(u64 tm_start, double exp_ops, double dp_val);
+	void ReportProgress(u64 tm_start, double exp_ops);
+	double GetRamBudget();
+	double PlanDP(int Range, u64 total_kangs, u64 max_gpu_jumps, double ops);
+	double PruneTames();
+	bool RaiseDP();
+	void PruneDBStep(u64 max_us);
+	double SelectHerd(double* parts, double ops, double tames_ops);
+	bool PrepareSolve(int Range, double DP, u64 total_kangs, u64 max_gpu_jumps, double ops);
+	bool SolvePoint(EcPoint pnt, int Range, double DP, EcInt* pk_res, TTargetState* ts = NULL);
+	bool GetRecDist(u8* rec, EcInt& dist);
+	void SwapOutTarget(TTargetState* ts, bool finished);
+	bool SwapInTarget(TTargetState* ts);
+	int SolveSliced(EcPoint* targets, EcPoint* pnts, int cnt, int* state);
+	int SolveLeft(EcPoint* targets, EcPoint* pnts, int cnt, int* state, int left);
+	double EstimateGpusSpeed();
+	void StartGpuThread(int ind);
+	bool CheckBackends();
+	void StopBackends();
+	void UpdateCpuSpeed();
+	int GetActiveGpuCnt();
+	TMachineProfileRec* FindCpuProfile();
+	TWalkCfg* GetKangCfg();
+	int SelectEngine(int pnt_cnt, int* baby_bits);
+	bool ReportKey(int pnt_ind, EcInt& pk, EcPoint& pub);
+	void ReportNotFound(int pnt_ind, int cnt, int reason);
+public:
+	RCGpuKang* GpuKangs[MAX_GPU_CNT];
+	int GpuCnt;
+	volatile long ThrCnt; //working GPU threads
+	TMachineProfile MachineProfile;
+	void ReplayCollision(TReplayTask* task);
+	bool GenMode; //tames generation mode
+	u64 RunSeed; //start distances of all kangs are derived from it and seed id of kang
+	u32 TotalErrors;
+
+	RCSolver();
+	~RCSolver();
+	void Init(u8* gpus_mask, TWalkCfg* walk_cfg, TMachineProfile* profile, bool autotune);
+	void Release();
+	int Solve(EcPoint* targets, int cnt, TSolveParams* params, TSolveCallbacks* cb);
+	bool GenerateTames(TSolveParams* params, TSolveCallbacks* cb);
+	void Bench(TSolveParams* params, TSolveCallbacks* cb, int pnt_cnt);
+	void Cancel();
+	int GetCpuThrCnt();
+	void AddCpuWalkers(int cnt); //can be called from any thread, walkers join running solve within a second
+	void SetTargetWeight(int pnt_ind, int weight); //time-sliced solving, can be called from any thread during Solve, 0 - pause
+
+	//called by GPU threads
+	u32 AllocSeedIds(u32 cnt);
+	void AddPointsToList(TDPRec* data, int pnt_cnt, u64 ops_cnt);
+	void CpuWalk();
+};
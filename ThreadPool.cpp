@@ -0,0 +1,383 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#include <algorithm>
+#include <vector>
+#include "ThreadPool.h"
+
+#ifdef _WIN32
+	#define ATOMIC_ADD32(ptr, val)	InterlockedExchangeAdd((volatile LONG*)(ptr), (LONG)(val))
+#else
+	#define ATOMIC_ADD32(ptr, val)	__sync_fetch_and_add((ptr), (u32)(val))
+#endif
+
+//worker index of current thread, -1 for threads outside of the pool
+static thread_local int tlsWorkerInd = -1;
+static thread_local RCThreadPool* tlsPool = NULL;
+
+#ifdef _WIN32
+u32 __stdcall pool_thr_proc(void* data)
+#else
+void* pool_thr_proc(void* data)
+#endif
+{
+	TPoolWorker* w = (TPoolWorker*)data;
+	w->pool->WorkerProc(w->ind);
+	return 0;
+}
+
+RCThreadPool::RCThreadPool()
+{
+	Workers = NULL;
+	WorkerCnt = 0;
+	NodeCnt = 0;
+	QueuedCnt = 0;
+	NextWorker = 0;
+	StopFlag = false;
+	tm_stats = 0;
+#ifdef _WIN32
+	InitializeCriticalSection(&WakeCS);
+	InitializeConditionVariable(&WakeCV);
+#else
+	pthread_mutex_init(&WakeCS, NULL);
+	pthread_cond_init(&WakeCV, NULL);
+#endif
+}
+
+RCThreadPool::~RCThreadPool()
+{
+	Stop();
+#ifdef _WIN32
+	DeleteCriticalSection(&WakeCS);
+#else
+	pthread_cond_destroy(&WakeCV);
+	pthread_mutex_destroy(&WakeCS);
+#endif
+}
+
+//thr_cnt - 0 means all CPUs, workers are pinned only if there are not more workers than CPUs
+bool RCThreadPool::Start(int thr_cnt, bool pin)
+{
+	if (Workers)
+		return true;
+	int cpu_cnt = GetCpuCnt();
+	if (!thr_cnt)
+		thr_cnt = cpu_cnt;
+	if (thr_cnt > cpu_cnt)
+		pin = false;
+	//neighbour workers share NUMA node, so stealing from neighbours first keeps data local
+	std::vector <int> cpus(cpu_cnt);
+	std::vector <int> nodes(cpu_cnt);
+	for (int i = 0; i < cpu_cnt; i++)
+	{
+		cpus[i] = i;
+		nodes[i] = GetCpuNode(i);
+	}
+	std::stable_sort(cpus.begin(), cpus.end(), [&nodes](int a, int b) { return nodes[a] < nodes[b]; });
+
+	StopFlag = false;
+	QueuedCnt = 0;
+	NodeCnt = 0;
+	WorkerCnt = thr_cnt;
+	Workers = new TPoolWorker[WorkerCnt];
+	for (int i = 0; i < WorkerCnt; i++)
+	{
+		TPoolWorker* w = Workers + i;
+		int cpu = cpus[i % cpu_cnt];
+		w->pool = this;
+		w->ind = i;
+		w->cpu = pin ? cpu : -1;
+		w->node = nodes[cpu];
+		w->busy_us = 0;
+		w->task_start_us = 0;
+		w->task_depth = 0;
+		w->task_cnt = 0;
+		w->steal_cnt = 0;
+		w->last_busy_us = 0;
+		if (w->node + 1 > NodeCnt)
+			NodeCnt = w->node + 1;
+	}
+	tm_stats = GetTimeUs();
+	for (int i = 0; i < WorkerCnt; i++)
+	{
+#ifdef _WIN32
+		u32 ThreadID;
+		Workers[i].thr = (HANDLE)_beginthreadex(NULL, 0, pool_thr_proc, (void*)&Workers[i], 0, &ThreadID);
+#else
+		pthread_create(&Workers[i].thr, NULL, pool_thr_proc, (void*)&Workers[i]);
+#endif
+	}
+	return true;
+}
+
+//waits for running tasks, queued tasks are dropped
+void RCThreadPool::Stop()
+{
+	if (!Workers)
+		return;
+#ifdef _WIN32
+	EnterCriticalSection(&WakeCS);
+	StopFlag = true;
+	WakeAllConditionVariable(&WakeCV);
+	LeaveCriticalSection(&WakeCS);
+	for (int i = 0; i < WorkerCnt; i++)
+	{
+		WaitForSingleObject(Workers[i].thr, INFINITE);
+		CloseHandle(Workers[i].thr);
+	}
+#else
+	pthread_mutex_lock(&WakeCS);
+	StopFlag = true;
+	pthread_cond_broadcast(&WakeCV);
+	pthread_mutex_unlock(&WakeCS);
+	for (int i = 0; i < WorkerCnt; i++)
+		pthread_join(Workers[i].thr, NULL);
+#endif
+	delete[] Workers;
+	Workers = NULL;
+	WorkerCnt = 0;
+}
+
+bool RCThreadPool::PopTask(TPoolWorker* w, int pri, TPoolTask* task, bool steal)
+{
+	w->cs.Enter();
+	std::deque <TPoolTask>& q = w->tasks[pri];
+	if (q.empty())
+	{
+		w->cs.Leave();
+		return false;
+	}
+	if (steal)
+	{
+		*task = q.front();
+		q.pop_front();
+	}
+	else
+	{
+		*task = q.back();
+		q.pop_back();
+	}
+	w->cs.Leave();
+	ATOMIC_ADD32(&QueuedCnt, -1);
+	return true;
+}
+
+//own deque first, then steal from workers of the same node, then from other nodes; ind is -1 for threads outside of the pool
+bool RCThreadPool::FindTask(int ind, TPoolTask* task)
+{
+	int node = (ind >= 0) ? Workers[ind].node : -1;
+	for (int pri = 0; pri < TASK_PRI_CNT; pri++)
+	{
+		if ((ind >= 0) && PopTask(Workers + ind, pri, task, false))
+			return true;
+		//pass 0 - same node, pass 1 - other nodes
+		for (int pass = 0; pass < 2; pass++)
+			for (int i = 1; i <= WorkerCnt; i++)
+			{
+				TPoolWorker* w = Workers + (ind + i + WorkerCnt) % WorkerCnt;
+				if (w->ind == ind)
+					continue;
+				bool same = (node < 0) || (w->node == node);
+				if (same != (pass == 0))
+					continue;
+				if (PopTask(w, pri, task, true))
+				{
+					if (ind >= 0)
+						Workers[ind].steal_cnt++;
+					return true;
+				}
+			}
+	}
+	return false;
+}
+
+void RCThreadPool::RunTask(int ind, TPoolTask* task)
+{
+	TPoolWorker* w = (ind >= 0) ? Workers + ind : NULL;
+	if (w && !w->task_depth++)
+	{
+		w->cs.Enter();
+		w->task_start_us = GetTimeUs();
+		w->cs.Leave();
+	}
+	task->func(task->ctx);
+	if (w)
+	{
+		w->task_cnt++;
+		if (!--w->task_depth)
+		{
+			w->cs.Enter();
+			w->busy_us += GetTimeUs() - w->task_start_us;
+			w->task_start_us = 0;
+			w->cs.Leave();
+		}
+	}
+	if (task->group)
+		ATOMIC_ADD32(&task->group->Pending, -1);
+}
+
+void RCThreadPool::WorkerProc(int ind)
+{
+	TPoolWorker* w = Workers + ind;
+	tlsWorkerInd = ind;
+	tlsPool = this;
+	if (w->cpu >= 0)
+		SetThreadCpu(w->cpu);
+	while (1)
+	{
+		TPoolTask task;
+		if (FindTask(ind, &task))
+		{
+			RunTask(ind, &task);
+			continue;
+		}
+		//QueuedCnt is increased under WakeCS, so wakeup cannot be lost
+#ifdef _WIN32
+		EnterCriticalSection(&WakeCS);
+		while (!QueuedCnt && !StopFlag)
+			SleepConditionVariableCS(&WakeCV, &WakeCS, INFINITE);
+		LeaveCriticalSection(&WakeCS);
+#else
+		pthread_mutex_lock(&WakeCS);
+		while (!QueuedCnt && !StopFlag)
+			pthread_cond_wait(&WakeCV, &WakeCS);
+		pthread_mutex_unlock(&WakeCS);
+#endif
+		if (StopFlag)
+			break;
+	}
+}
+
+//tasks from pool workers go to own deque (others steal them), other tasks are spread over workers of requested node or all workers
+void RCThreadPool::Submit(TTaskFunc func, void* ctx, TTaskGroup* group, int pri, int node)
+{
+	if (group)
+		ATOMIC_ADD32(&group->Pending, 1);
+	TPoolTask task;
+	task.func = func;
+	task.ctx = ctx;
+	task.group = group;
+	int ind;
+	if ((node < 0) && (tlsPool == this) && (tlsWorkerInd >= 0))
+		ind = tlsWorkerInd;
+	else
+	{
+		ind = ATOMIC_ADD32(&NextWorker, 1) % WorkerCnt;
+		if (node >= 0)
+			for (int i = 0; i < WorkerCnt; i++)
+				if (Workers[(ind + i) % WorkerCnt].node == node)
+				{
+					ind = (ind + i) % WorkerCnt;
+					break;
+				}
+	}
+	Workers[ind].cs.Enter();
+	Workers[ind].tasks[pri].push_back(task);
+	Workers[ind].cs.Leave();
+#ifdef _WIN32
+	EnterCriticalSection(&WakeCS);
+	ATOMIC_ADD32(&QueuedCnt, 1);
+	WakeConditionVariable(&WakeCV);
+	LeaveCriticalSection(&WakeCS);
+#else
+	pthread_mutex_lock(&WakeCS);
+	ATOMIC_ADD32(&QueuedCnt, 1);
+	pthread_cond_signal(&WakeCV);
+	pthread_mutex_unlock(&WakeCS);
+#endif
+}
+
+//calling thread runs queued tasks while waiting, so waiting inside a task cannot block the pool
+void RCThreadPool::Wait(TTaskGroup* group)
+{
+	int ind = (tlsPool == this) ? tlsWorkerInd : -1;
+	while (group->Pending)
+	{
+		TPoolTask task;
+		if (FindTask(ind, &task))
+			RunTask(ind, &task);
+		else
+			Sleep(1);
+	}
+}
+
+//runs func(ctx) as task_cnt tasks and waits for all of them
+void RCThreadPool::Run(TTaskFunc func, void* ctx, int task_cnt, int pri)
+{
+	TTaskGroup group;
+	group.Pending = 0;
+	for (int i = 0; i < task_cnt; i++)
+		Submit(func, ctx, &group, pri);
+	Wait(&group);
+}
+
+//utilization of every worker since last call, tasks and steals since start, nothing is printed if workers were idle
+void RCThreadPool::PrintStats()
+{
+	u64 tm = GetTimeUs();
+	u64 dt = tm - tm_stats;
+	tm_stats = tm;
+	if (!dt)
+		return;
+	u64 busy = 0, tasks = 0, steals = 0;
+	u64* cur_busy = new u64[WorkerCnt];
+	for (int i = 0; i < WorkerCnt; i++)
+	{
+		TPoolWorker* w = Workers + i;
+		w->cs.Enter();
+		cur_busy[i] = w->busy_us + (w->task_start_us ? tm - w->task_start_us : 0);
+		w->cs.Leave();
+		busy += cur_busy[i] - w->last_busy_us;
+		tasks += w->task_cnt;
+		steals += w->steal_cnt;
+	}
+	if (!busy)
+	{
+		delete[] cur_busy;
+		return;
+	}
+	printf("CPU pool: %d workers, %d node(s), load %d%%, tasks %llu, steals %llu, by worker:", WorkerCnt, NodeCnt, (int)(100 * busy / (dt * WorkerCnt)), tasks, steals);
+	for (int i = 0; i < WorkerCnt; i++)
+	{
+		printf(" %d", (int)(100 * (cur_busy[i] - Workers[i].last_busy_us) / dt));
+		Workers[i].last_busy_us = cur_busy[i];
+	}
+	delete[] cur_busy;
+	printf("%%\r\n");
+}
+
+static RCThreadPool* gThreadPool = NULL;
+static CriticalSection csThreadPool;
+
+//shared pool for all CPU engines, started on first call with worker per CPU
+RCThreadPool* GetThreadPool()
+{
+	csThreadPool.Enter();
+	if (!gThreadPool)
+	{
+		gThreadPool = new RCThreadPool();
+		gThreadPool->Start(0, true);
+	}
+	csThreadPool.Leave();
+	return gThreadPool;
+}
+
+void StopThreadPool()
+{
+	csThreadPool.Enter();
+	delete gThreadPool;
+	gThreadPool = NULL;
+	csThreadPool.Leave();
+}
+
+//for stats output, does nothing if pool was not used
+void PrintThreadPoolStats()
+{
+	csThreadPool.Enter();
+	if (gThreadPool)
+		gThreadPool->PrintStats();
+	csThreadPool.Leave();
+}
@@ -0,0 +1,89 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#pragma once
+
+#include <deque>
+#include "defs.h"
+#include "utils.h"
+
+//priority classes, workers always take high priority tasks first (from own deque, then steal)
+#define TASK_PRI_HIGH		0 //short latency-sensitive work: keys parsing, herd restore from checkpoint
+#define TASK_PRI_NORMAL		1 //bulk work: CPU walkers, BSGS, tuning, compact DP replays
+#define TASK_PRI_CNT		2
+
+typedef void (*TTaskFunc)(void* ctx);
+
+//counter of unfinished tasks, Wait returns when it's zero
+struct TTaskGroup
+{
+	volatile u32 Pending;
+};
+
+struct TPoolTask
+{
+	TTaskFunc func;
+	void* ctx;
+	TTaskGroup* group;
+};
+
+struct TPoolWorker
+{
+	class RCThreadPool* pool;
+	int ind;
+	int cpu; //pinned CPU or -1
+	int node; //NUMA node
+	CriticalSection cs;
+	std::deque <TPoolTask> tasks[TASK_PRI_CNT]; //owner takes from back, other workers steal from front
+	HHANDLER thr;
+	volatile u64 busy_us; //time of finished tasks
+	volatile u64 task_start_us; //start of running task, 0 if idle, so long tasks (CPU walkers) are counted while they run
+	int task_depth; //tasks run by Wait inside task are part of outer task time
+	volatile u64 task_cnt;
+	volatile u64 steal_cnt;
+	u64 last_busy_us; //for utilization since last PrintStats
+};
+
+//shared task scheduler for CPU work: per-worker deques with stealing, workers pinned to CPUs and ordered by NUMA nodes
+//tasks that wait for each other (all must run at the same time) are allowed only if their number is not above GetWorkerCnt()
+class RCThreadPool
+{
+private:
+	TPoolWorker* Workers;
+	int WorkerCnt;
+	int NodeCnt;
+	volatile u32 QueuedCnt;
+	volatile u32 NextWorker;
+	volatile bool StopFlag;
+	u64 tm_stats;
+#ifdef _WIN32
+	CRITICAL_SECTION WakeCS;
+	CONDITION_VARIABLE WakeCV;
+#else
+	pthread_mutex_t WakeCS;
+	pthread_cond_t WakeCV;
+#endif
+
+	bool PopTask(TPoolWorker* w, int pri, TPoolTask* task, bool steal);
+	bool FindTask(int ind, TPoolTask* task);
+	void RunTask(int ind, TPoolTask* task);
+public:
+	RCThreadPool();
+	~RCThreadPool();
+	bool Start(int thr_cnt, bool pin);
+	void Stop();
+	void Submit(TTaskFunc func, void* ctx, TTaskGroup* group, int pri = TASK_PRI_NORMAL, int node = -1);
+	void Wait(TTaskGroup* group);
+	void Run(TTaskFunc func, void* ctx, int task_cnt, int pri = TASK_PRI_NORMAL);
+	int GetWorkerCnt() { return WorkerCnt; };
+	int GetNodeCnt() { return NodeCnt; };
+	void PrintStats();
+	void WorkerProc(int ind);
+};
+
+RCThreadPool* GetThreadPool();
+void StopThreadPool();
+void PrintThreadPoolStats();
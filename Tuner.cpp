@@ -0,0 +1,297 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#include <math.h>
+#include "Tuner.h"
+#include "CpuKang.h"
+#include "Jumps.h"
+#include "ThreadPool.h"
+
+//jumps for solve are checked every TUNER_STEP_CNT jumps, so we don't lose much ops after collision
+#define TUNER_STEP_CNT		20
+//stop solving if no collision after this number of expected ops
+#define TUNER_MAX_K			20
+
+struct TTunerRec
+{
+	u64 x;
+	u64 d[3];
+	u32 type;
+};
+
+//small hash table of DPs, x is never 0 because x[3] is checked for DP and low 64 bits are random
+class TTunerDB
+{
+private:
+	std::vector <TTunerRec> recs;
+	u64 cnt;
+public:
+	void Clear(int bits) { recs.assign(1ull << bits, TTunerRec()); for (size_t i = 0; i < recs.size(); i++) recs[i].x = 0; cnt = 0; }
+	//returns existing record with same x or NULL if rec was added
+	TTunerRec* FindOrAdd(TTunerRec& rec)
+	{
+		if (2 * (cnt + 1) > recs.size())
+		{
+			std::vector <TTunerRec> old;
+			old.swap(recs);
+			Clear((int)log2((double)old.size()) + 1);
+			for (size_t i = 0; i < old.size(); i++)
+				if (old[i].x)
+					FindOrAdd(old[i]);
+		}
+		u64 mask = recs.size() - 1;
+		u64 ind = rec.x & mask;
+		while (recs[ind].x)
+		{
+			if (recs[ind].x == rec.x)
+				return &recs[ind];
+			ind = (ind + 1) & mask;
+		}
+		recs[ind] = rec;
+		cnt++;
+		return NULL;
+	}
+};
+
+struct TTunerCandidate
+{
+	TJmpStrategy st;
+	double k_sum;
+	double k2_sum;
+	int solved;
+	int failed;
+	u64 jumps;
+	u64 loops_s2;
+	u64 loops_big;
+};
+
+struct TTunerTask
+{
+	TTunerCandidate* cand;
+	int Range;
+	int KangCnt;
+	int DPBits;
+	int SolveCnt;
+	TWalkCfg Cfg;
+	volatile int NextSolve;
+	CriticalSection cs;
+};
+
+static void LoadDist(EcInt& res, u64* d)
+{
+	res.SetZero();
+	memcpy(res.data, d, 24);
+	if (d[2] >> 63)
+		res.data[3] = res.data[4] = 0xFFFFFFFFFFFFFFFF;
+}
+
+//same as Collision_SOTA, but we know the key so just compare
+static bool CheckKey(EcInt& key, EcInt& half_range, TTunerRec* r1, TTunerRec* r2)
+{
+	TTunerRec* tr = (r1->type == TAME) ? r1 : r2;
+	TTunerRec* wr = (tr == r1) ? r2 : r1;
+	for (int neg = 0; neg < 2; neg++)
+	{
+		EcInt t, w, k;
+		LoadDist(t, tr->d);
+		LoadDist(w, wr->d);
+		if (neg)
+			t.Neg();
+		t.Sub(w);
+		if (tr->type != TAME)
+		{
+			if (t.data[4] >> 63)
+				t.Neg();
+			t.ShiftRight(1);
+		}
+		k = t;
+		k.Add(half_range);
+		if (k.IsEqual(key))
+			return true;
+		k = t;
+		k.Neg();
+		k.Add(half_range);
+		if (k.IsEqual(key))
+			return true;
+	}
+	return false;
+}
+
+//returns ops or 0 if failed
+static u64 TunerSolve(TTunerTask* task, RCCpuKang* kang, TDPRec* dps, TTunerDB* db)
+{
+	int Range = task->Range;
+	int jmp_cnt = task->Cfg.JmpCnt;
+	EcJMP* jumps = new EcJMP[3 * jmp_cnt];
+	GenerateJumps(&task->cand->st, Range, jmp_cnt, jumps, jumps + jmp_cnt, jumps + 2 * jmp_cnt);
+
+	Ec ec;
+	EcInt key, half_range;
+	key.RndBits(Range);
+	EcPoint pnt = ec.MultiplyG(key);
+	half_range.Set(1);
+	half_range.ShiftLeft(Range - 1);
+
+	double herd_parts[3] = { 1.0 / 3, 1.0 / 3, 1.0 / 3 };
+	u64 dp_thr = (task->DPBits > 0) ? (1ull << (64 - task->DPBits)) : 0xFFFFFFFFFFFFFFFF;
+	kang->Prepare(pnt, Range, task->DPBits, dp_thr, jumps, jumps + jmp_cnt, jumps + 2 * jmp_cnt, task->KangCnt, herd_parts, &task->Cfg);
+	db->Clear(16);
+
+	u64 ops = 0;
+	u64 max_ops = (u64)(TUNER_MAX_K * pow(2.0, Range / 2.0));
+	bool solved = false;
+	while (!solved && (ops < max_ops))
+	{
+		int cnt = kang->Step(TUNER_STEP_CNT, dps, task->KangCnt * TUNER_STEP_CNT);
+		ops += (u64)task->KangCnt * TUNER_STEP_CNT;
+		for (int i = 0; i < cnt; i++)
+		{
+			TDPRec* dp = dps + i;
+			TTunerRec rec;
+			rec.x = *(u64*)dp->x;
+			memcpy(rec.d, dp->d, 24);
+			rec.type = dp->type;
+			TTunerRec* pref = db->FindOrAdd(rec);
+			if (!pref)
+				continue;
+			if ((pref->type == rec.type) && ((pref->type == TAME) || (pref->d[0] == rec.d[0])))
+				continue;
+			if (CheckKey(key, half_range, pref, &rec))
+			{
+				solved = true;
+				break;
+			}
+		}
+	}
+	delete[] jumps;
+	return solved ? ops : 0;
+}
+
+static void tuner_task_proc(void* data)
+{
+	TTunerTask* task = (TTunerTask*)data;
+	RCCpuKang* kang = new RCCpuKang();
+	TDPRec* dps = (TDPRec*)malloc((size_t)task->KangCnt * TUNER_STEP_CNT * sizeof(TDPRec));
+	TTunerDB* db = new TTunerDB();
+	while (1)
+	{
+		task->cs.Enter();
+		int ind = task->NextSolve++;
+		task->cs.Leave();
+		if (ind >= task->SolveCnt)
+			break;
+		u64 ops = TunerSolve(task, kang, dps, db);
+		task->cs.Enter();
+		TTunerCandidate* cand = task->cand;
+		if (ops)
+		{
+			double k = ops / pow(2.0, task->Range / 2.0);
+			cand->k_sum += k;
+			cand->k2_sum += k * k;
+			cand->solved++;
+		}
+		else
+			cand->failed++;
+		cand->jumps += ops ? ops : (u64)(TUNER_MAX_K * pow(2.0, task->Range / 2.0));
+		cand->loops_s2 += kang->LoopStats[2];
+		for (int i = 3; i <= MAX_MD_LEN; i++)
+			cand->loops_big += kang->LoopStats[i];
+		task->cs.Leave();
+	}
+	delete db;
+	free(dps);
+	delete kang;
+}
+
+static void RunCandidate(TTunerTask* task, int thr_cnt)
+{
+	task->NextSolve = 0;
+	GetThreadPool()->Run(tuner_task_proc, task, thr_cnt);
+}
+
+//solves many small-range points on CPU for every jump strategy candidate and saves the best one to profile
+//only JmpCnt and MdLen are used from cfg, tuned profile is for these values
+//thr_cnt - 0 means all CPUs
+bool RunJmpTuner(char* profile_fn, int Range, int kang_cnt, int solve_cnt, TWalkCfg* cfg, int thr_cnt)
+{
+	int herd_bits = (int)(log2((double)kang_cnt) + 0.5);
+	//about 16 DPs per kang, so DP overhead is small
+	int dp_bits = Range / 2 - herd_bits - 4;
+	if (dp_bits < 0)
+		dp_bits = 0;
+	if (!thr_cnt)
+		thr_cnt = GetCpuCnt();
+	printf("Jumps tuner: range %d, %d kangs, DP %d, %d solves per candidate, %d threads, JmpCnt %d, MdLen %d\r\n", Range, kang_cnt, dp_bits, solve_cnt, thr_cnt, cfg->JmpCnt, cfg->MdLen);
+
+	std::vector <TTunerCandidate> cands;
+	for (int distr = 0; distr < JMP_DISTR_CNT; distr++)
+		for (int mean = -2; mean <= 2; mean++)
+		{
+			TTunerCandidate cand;
+			memset(&cand, 0, sizeof(cand));
+			cand.st.distr = distr;
+			cand.st.mean = JMP_DEF_MEAN + mean;
+			cands.push_back(cand);
+		}
+
+	TTunerTask* task = new TTunerTask();
+	task->Range = Range;
+	task->KangCnt = kang_cnt;
+	task->DPBits = dp_bits;
+	task->SolveCnt = solve_cnt;
+	task->Cfg = *cfg;
+	int best = -1;
+	double best_k = 0;
+	for (int i = 0; i < (int)cands.size(); i++)
+	{
+		TTunerCandidate* cand = &cands[i];
+		task->cand = cand;
+		u64 tm = GetTickCount64();
+		RunCandidate(task, thr_cnt);
+		char s[128];
+		GetJmpStrategyStr(&cand->st, s);
+		if (!cand->solved)
+		{
+			printf("%s: not solved\r\n", s);
+			continue;
+		}
+		//failed solves are counted as TUNER_MAX_K
+		double k = (cand->k_sum + TUNER_MAX_K * cand->failed) / (cand->solved + cand->failed);
+		double dev = sqrt(fabs(cand->k2_sum / cand->solved - (cand->k_sum / cand->solved) * (cand->k_sum / cand->solved)) / cand->solved);
+		printf("%s: K %.3f +/- %.3f, failed %d, loops per 1M jumps: L1S2 %.1f, >2 %.4f, time %llus\r\n", s, k, dev, cand->failed,
+			1000000.0 * cand->loops_s2 / cand->jumps, 1000000.0 * cand->loops_big / cand->jumps, (GetTickCount64() - tm) / 1000);
+		if ((best < 0) || (k < best_k))
+		{
+			best = i;
+			best_k = k;
+		}
+	}
+	delete task;
+	if (best < 0)
+	{
+		printf("Jumps tuner: nothing solved\r\n");
+		return false;
+	}
+
+	TJmpProfile profile;
+	profile.LoadFromFile(profile_fn);
+	TJmpProfileRec rec;
+	rec.range = Range;
+	rec.herd_bits = herd_bits;
+	rec.st = cands[best].st;
+	rec.k = best_k;
+	profile.Set(rec);
+	char s[128];
+	GetJmpStrategyStr(&rec.st, s);
+	printf("Best jumps: %s, K %.3f\r\n", s, best_k);
+	if (!profile.SaveToFile(profile_fn))
+	{
+		printf("Jumps tuner: cannot save profile to %s\r\n", profile_fn);
+		return false;
+	}
+	printf("Profile saved to %s\r\n", profile_fn);
+	return true;
+}
@@ -0,0 +1,11 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#pragma once
+
+#include "defs.h"
+
+bool RunJmpTuner(char* profile_fn, int Range, int kang_cnt, int solve_cnt, TWalkCfg* cfg, int thr_cnt);
@@ -21,28 +21,37 @@ typedef char i8;
 
 #define MAX_GPU_CNT			32
 
-//must be divisible by MD_LEN
-#define STEP_CNT			1000
-
-#define JMP_CNT				512
-
-//use different options for cards older than RTX 40xx
+//walk parameters are selected at runtime, kernels (GPU and CPU) are prebuilt for these configurations only:
+//BlockSize, GroupCnt (kangs per thread), JmpCnt, MdLen (loops up to this size are detected), StepCnt (jumps per kernel call)
+//GroupCnt can be 8, 16, 24, 32 for RTX 40xx and newer, up to 64 for older cards
+//JmpCnt must be power of 2, MdLen must be even, StepCnt must be divisible by MdLen
+#define WALK_CFG_LIST(X) \
+	X(256, 24, 512, 10, 1000) /* default for RTX 40xx and newer */ \
+	X(512, 64, 512, 10, 1000) /* default for older cards */ \
+	X(256, 16, 512, 10, 1000) \
+	X(256, 32, 512, 10, 1000) \
+	X(512, 32, 512, 10, 1000) \
+	X(256, 24, 256, 10, 1000) \
+	X(512, 64, 256, 10, 1000) \
+	X(256, 24, 512, 12, 1200) \
+	X(512, 64, 512, 12, 1200) \
+	X(256, 24, 512, 10, 500) \
+	X(512, 64, 512, 10, 500)
+
+#define DEF_JMP_CNT			512
+#define DEF_MD_LEN			10
+#define DEF_STEP_CNT		1000
+
+//jmp2 table is in constant memory and jmp3 table is in LDS, so 512 is max
+#define MAX_JMP_CNT			512
+//LoopedKangs keeps index in LastPnts in 4 bits
+#define MAX_MD_LEN			16
+
+//use different KernelA for cards older than RTX 40xx
 #ifdef __CUDA_ARCH__
 	#if __CUDA_ARCH__ < 890
 		#define OLD_GPU
 	#endif
-	#ifdef OLD_GPU
-		#define BLOCK_SIZE			512
-		//can be 8, 16, 24, 32, 40, 48, 56, 64
-		#define PNT_GROUP_CNT		64	
-	#else
-		#define BLOCK_SIZE			256
-		//can be 8, 16, 24, 32
-		#define PNT_GROUP_CNT		24
-	#endif
-#else //CPU, fake values
-	#define BLOCK_SIZE			512
-	#define PNT_GROUP_CNT		64
 #endif
 
 // kang type
@@ -50,11 +59,27 @@ typedef char i8;
 #define WILD1				1  // Wild kangs1 
 #define WILD2				2  // Wild kangs2
 
-#define GPU_DP_SIZE			48
+//DP record, the only DP format from kernels and CPU walkers to DB ingestion, buffers of DPs are arrays of it
+//all fields are naturally aligned, so there is no packing and kernels write it with vector stores
+struct TDPRec
+{
+	u8 x[12]; //low 96 bits of x
+	u32 lvl_bits; //bits of x[3] after DPBits zero bits, DP level is in high 6 bits
+	u64 d[3]; //distance, signed
+	u16 type; //kang type
+	u16 step; //jump index in kernel call
+	u32 kang; //kang index in backend
+	//filled on CPU
+	u32 seed; //seed id of kang
+	u32 backend; //cuda index of GPU or DP_BACKEND_CPU
+	u64 jumps; //jumps from kang start
+};
+#define GPU_DP_SIZE			64
+static_assert(sizeof(TDPRec) == GPU_DP_SIZE, "TDPRec size");
+#define DP_LEVEL_SHIFT		26
+#define DP_BACKEND_CPU		0xFFFFFFFF //CPU walkers have no seed ids, so their DPs cannot be replayed or reseeded
 #define MAX_DP_CNT			(256 * 1024)
 
-#define JMP_MASK			(JMP_CNT-1)
-
 #define DPTABLE_MAX_CNT		16
 
 #define MAX_CNT_LIST		(512 * 1024)
@@ -63,10 +88,17 @@ typedef char i8;
 #define INV_FLAG			0x4000
 #define JMP2_FLAG			0x2000
 
-#define MD_LEN				10
-
 //#define DEBUG_MODE
 
+struct TWalkCfg
+{
+	u32 BlockSize;
+	u32 GroupCnt;
+	u32 JmpCnt;
+	u32 MdLen;
+	u32 StepCnt;
+};
+
 //gpu kernel parameters
 struct TKparams
 {
@@ -75,8 +107,12 @@ struct TKparams
 	u32 BlockCnt;
 	u32 BlockSize;
 	u32 GroupCnt;
+	u32 JmpCnt;
+	u32 MdLen;
+	u32 StepCnt;
 	u64* L2;
-	u64 DP;
+	u64 DPThr; //point is DP if x[3] < DPThr, allows fractional DP values
+	u32 DPBits; //integer part of DP, bits of x[3] after it are stored with DP to check DP level on CPU
 	u32* DPs_out;
 	u64* Jumps1; //x(32b), y(32b), d(32b)
 	u64* Jumps2; //x(32b), y(32b), d(32b)
@@ -6,6 +6,9 @@
 
 #include "utils.h"
 #include <wchar.h>
+#ifndef _WIN32
+	#include <cpuid.h>
+#endif
 
 #ifdef _WIN32
 
@@ -64,12 +67,11 @@ u64 GetTickCount64()
 //everything will be stable up to about 8TB RAM
 
 #define MEM_PAGE_SIZE		(128 * 1024)
-#define RECS_IN_PAGE		(MEM_PAGE_SIZE / DB_REC_LEN)
-#define MAX_PAGES_CNT		(0xFFFFFFFF / RECS_IN_PAGE)
 
 MemPool::MemPool()
 {
 	pnt = 0;
+	SetRecLen(DB_REC_LEN);
 }
 
 MemPool::~MemPool()
@@ -86,34 +88,59 @@ void MemPool::Clear()
 	pnt = 0;
 }
 
+//pool must be empty
+void MemPool::SetRecLen(u32 len)
+{
+	rec_len = len;
+	recs_in_page = MEM_PAGE_SIZE / len;
+}
+
+void MemPool::Swap(MemPool& mp)
+{
+	pages.swap(mp.pages);
+	u32 tmp = pnt;
+	pnt = mp.pnt;
+	mp.pnt = tmp;
+	tmp = rec_len;
+	rec_len = mp.rec_len;
+	mp.rec_len = tmp;
+	tmp = recs_in_page;
+	recs_in_page = mp.recs_in_page;
+	mp.recs_in_page = tmp;
+}
+
 void* MemPool::AllocRec(u32* cmp_ptr)
 {
 	void* mem;
-	if (pages.empty() || (pnt + DB_REC_LEN > MEM_PAGE_SIZE))
+	if (pages.empty() || (pnt + rec_len > MEM_PAGE_SIZE))
 	{
-		if (pages.size() >= MAX_PAGES_CNT)
+		if (pages.size() >= 0xFFFFFFFF / recs_in_page)
 			return NULL; //overflow
 		pages.push_back(malloc(MEM_PAGE_SIZE));
 		pnt = 0;
 	}
 	u32 page_ind = (u32)pages.size() - 1;
 	mem = (u8*)pages[page_ind] + pnt;
-	*cmp_ptr = (page_ind * RECS_IN_PAGE) | (pnt / DB_REC_LEN);
-	pnt += DB_REC_LEN;
+	*cmp_ptr = page_ind * recs_in_page + pnt / rec_len;
+	pnt += rec_len;
 	return mem;
 }
 
 void* MemPool::GetRecPtr(u32 cmp_ptr)
 {
-	u32 page_ind = cmp_ptr / RECS_IN_PAGE;
-	u32 rec_ind = cmp_ptr % RECS_IN_PAGE;
-	return (u8*)pages[page_ind] + DB_REC_LEN * rec_ind;
+	u32 page_ind = cmp_ptr / recs_in_page;
+	u32 rec_ind = cmp_ptr % recs_in_page;
+	return (u8*)pages[page_ind] + rec_len * rec_ind;
 }
 
 TFastBase::TFastBase()
 {
 	memset(lists, 0, sizeof(lists));
 	memset(Header, 0, sizeof(Header));
+	RecLen = DB_REC_LEN;
+	RecCnt = 0;
+	Pruning = false;
+	PruneRemoved = 0;
 }
 
 TFastBase::~TFastBase()
@@ -136,20 +163,125 @@ void TFastBase::Clear()
 			}
 		mps[i].Clear();
 	}
+	PrunePool.Clear();
+	Pruning = false;
+	RecCnt = 0;
 }
 
-u64 TFastBase::GetBlockCnt()
+//DB is cleared, length is DB_FIND_LEN or more, files support up to DB_REC_LEN
+void TFastBase::SetRecLen(int len)
 {
-	u64 blockCount = 0;
+	Clear();
+	RecLen = len;
+	for (int i = 0; i < 256; i++)
+		mps[i].SetRecLen(len);
+}
+
+void TFastBase::BeginPrune(TKeepRecFunc keep_func, void* ctx, int new_rec_len, std::vector <u8>* removed_recs)
+{
+	if (Pruning)
+		PruneStep(0);
+	PruneFunc = keep_func;
+	PruneCtx = ctx;
+	PruneLen = new_rec_len ? new_rec_len : RecLen;
+	PruneRemovedRecs = removed_recs;
+	PruneI = 0;
+	PruneJ = 0;
+	PruneRemoved = 0;
+	PrunePool.Clear();
+	PrunePool.SetRecLen(PruneLen);
+	Pruning = true;
+}
+
+//removes records rejected by keep_func, returns number of removed records
+//records are copied to new pages so memory is really released, lists stay sorted
+//new_rec_len can cut the tail of records, 0 - keep length
+//removed_recs gets removed records with 3-byte list index, so they can be added back by AddDataBlock
+u64 TFastBase::Prune(TKeepRecFunc keep_func, void* ctx, int new_rec_len, std::vector <u8>* removed_recs)
+{
+	BeginPrune(keep_func, ctx, new_rec_len, removed_recs);
+	PruneStep(0);
+	return PruneRemoved;
+}
+
+//same as Prune but done by PruneStep calls, records can be added and found between them
+//DB is consistent at any time: moved lists use PrunePool until their first-byte pool is finished
+void TFastBase::StartPrune(TKeepRecFunc keep_func, void* ctx)
+{
+	BeginPrune(keep_func, ctx, 0, NULL);
+}
+
+//moves lists by 256 (1/65536 of DB) until max_us is spent, 0 - no limit
+//returns true if pruning is finished
+bool TFastBase::PruneStep(u64 max_us)
+{
+	if (!Pruning)
+		return true;
+	u64 t0 = GetTimeUs();
+	while (PruneI < 256)
+	{
+		int i = PruneI;
+		for (int k = 0; k < 256; k++)
+		{
+			TListRec* list = &lists[i][PruneJ][k];
+			int cnt = 0;
+			for (int m = 0; m < list->cnt; m++)
+			{
+				u8* ptr = (u8*)mps[i].GetRecPtr(list->data[m]);
+				if (!PruneFunc(ptr, PruneCtx))
+				{
+					PruneRemoved++;
+					if (PruneRemovedRecs)
+					{
+						u8 ind[3] = { (u8)i, (u8)PruneJ, (u8)k };
+						PruneRemovedRecs->insert(PruneRemovedRecs->end(), ind, ind + 3);
+						PruneRemovedRecs->insert(PruneRemovedRecs->end(), ptr, ptr + RecLen);
+					}
+					continue;
+				}
+				u32 cmp_ptr;
+				void* new_ptr = PrunePool.AllocRec(&cmp_ptr);
+				memcpy(new_ptr, ptr, PruneLen);
+				list->data[cnt++] = cmp_ptr;
+			}
+			RecCnt -= list->cnt - cnt;
+			list->cnt = cnt;
+		}
+		PruneJ++;
+		if (PruneJ == 256)
+		{
+			mps[i].Swap(PrunePool);
+			PrunePool.Clear();
+			PrunePool.SetRecLen(PruneLen);
+			PruneJ = 0;
+			PruneI++;
+		}
+		if (max_us && (GetTimeUs() - t0 >= max_us))
+			break;
+	}
+	if (PruneI < 256)
+		return false;
+	RecLen = PruneLen;
+	Pruning = false;
+	return true;
+}
+
+void TFastBase::EnumRecs(TEnumRecFunc enum_func, void* ctx)
+{
+	if (Pruning)
+		PruneStep(0);
 	for (int i = 0; i < 256; i++)
 		for (int j = 0; j < 256; j++)
 			for (int k = 0; k < 256; k++)
-			blockCount += lists[i][j][k].cnt;
-	return blockCount;
+			{
+				TListRec* list = &lists[i][j][k];
+				for (int m = 0; m < list->cnt; m++)
+					enum_func((u8*)mps[i].GetRecPtr(list->data[m]), ctx);
+			}
 }
 
 // http://en.cppreference.com/w/cpp/algorithm/lower_bound
-int TFastBase::lower_bound(TListRec* list, int mps_ind, u8* data)
+int TFastBase::lower_bound(TListRec* list, MemPool* mp, u8* data)
 {
 	int count = list->cnt;
 	int it, first, step;
@@ -159,7 +291,7 @@ int TFastBase::lower_bound(TListRec* list, int mps_ind, u8* data)
 		it = first;
 		step = count / 2;   
 		it += step;
-		void* ptr = mps[mps_ind].GetRecPtr(list->data[it]);
+		void* ptr = mp->GetRecPtr(list->data[it]);
 		if (memcmp(ptr, data, DB_FIND_LEN) < 0)
 		{
 			first = ++it;
@@ -187,13 +319,15 @@ u8* TFastBase::AddDataBlock(u8* data, int pos)
 		list->data = (u32*)realloc(list->data, newcap * sizeof(u32));
 		list->capacity = newcap;
 	}
-	int first = (pos < 0) ? lower_bound(list, data[0], data + 3) : pos;
+	MemPool* mp = GetPool(data);
+	int first = (pos < 0) ? lower_bound(list, mp, data + 3) : pos;
 	memmove(list->data + first + 1, list->data + first, (list->cnt - first) * sizeof(u32));
 	u32 cmp_ptr;
-	void* ptr = mps[data[0]].AllocRec(&cmp_ptr);
+	void* ptr = mp->AllocRec(&cmp_ptr);
 	list->data[first] = cmp_ptr;
-	memcpy(ptr, data + 3, DB_REC_LEN);
+	memcpy(ptr, data + 3, RecLen);
 	list->cnt++;
+	RecCnt++;
 	return (u8*)ptr;
 }
 
@@ -201,10 +335,11 @@ u8* TFastBase::FindDataBlock(u8* data)
 {
 	bool res = false;
 	TListRec* list = &lists[data[0]][data[1]][data[2]];
-	int first = lower_bound(list, data[0], data + 3);
+	MemPool* mp = GetPool(data);
+	int first = lower_bound(list, mp, data + 3);
 	if (first == list->cnt)
 		return NULL;
-	void* ptr = mps[data[0]].GetRecPtr(list->data[first]);
+	void* ptr = mp->GetRecPtr(list->data[first]);
 	if (memcmp(ptr, data + 3, DB_FIND_LEN))
 		return NULL;
 	return (u8*)ptr;
@@ -214,10 +349,11 @@ u8* TFastBase::FindOrAddDataBlock(u8* data)
 {
 	void* ptr;
 	TListRec* list = &lists[data[0]][data[1]][data[2]];
-	int first = lower_bound(list, data[0], data + 3);
+	MemPool* mp = GetPool(data);
+	int first = lower_bound(list, mp, data + 3);
 	if (first == list->cnt)
 		goto label_not_found;
-	ptr = mps[data[0]].GetRecPtr(list->data[first]);
+	ptr = mp->GetRecPtr(list->data[first]);
 	if (memcmp(ptr, data + 3, DB_FIND_LEN))
 		goto label_not_found;
 	return (u8*)ptr;
@@ -238,12 +374,20 @@ bool TFastBase::LoadFromFile(char* fn)
 		fclose(fp);
 		return false;
 	}
+	int len = Header[DB_HDR_REC_LEN] ? Header[DB_HDR_REC_LEN] : DB_REC_LEN;
+	if ((len < DB_FIND_LEN) || (len > DB_REC_LEN))
+	{
+		fclose(fp);
+		return false;
+	}
+	SetRecLen(len);
 	for (int i = 0; i < 256; i++)
 		for (int j = 0; j < 256; j++)
 			for (int k = 0; k < 256; k++)
 			{
 				TListRec* list = &lists[i][j][k];
 				fread(&list->cnt, 1, 2, fp);
+				RecCnt += list->cnt;
 				if (list->cnt)
 				{
 					u32 grow = list->cnt / 2;
@@ -260,7 +404,7 @@ bool TFastBase::LoadFromFile(char* fn)
 						u32 cmp_ptr;
 						void* ptr = mps[i].AllocRec(&cmp_ptr);
 						list->data[m] = cmp_ptr;
-						if (fread(ptr, 1, DB_REC_LEN, fp) != DB_REC_LEN)
+						if (fread(ptr, 1, RecLen, fp) != (size_t)RecLen)
 						{
 							fclose(fp);
 							return false;
@@ -274,9 +418,12 @@ bool TFastBase::LoadFromFile(char* fn)
 
 bool TFastBase::SaveToFile(char* fn)
 {
+	if (Pruning)
+		PruneStep(0);
 	FILE* fp = fopen(fn, "wb");
 	if (!fp)
 		return false;
+	Header[DB_HDR_REC_LEN] = (RecLen == DB_REC_LEN) ? 0 : RecLen;
 	if (fwrite(Header, 1, sizeof(Header), fp) != sizeof(Header))
 	{
 		fclose(fp);
@@ -291,7 +438,7 @@ bool TFastBase::SaveToFile(char* fn)
 				for (int m = 0; m < list->cnt; m++)
 				{
 					void* ptr = mps[i].GetRecPtr(list->data[m]);
-					if (fwrite(ptr, 1, DB_REC_LEN, fp) != DB_REC_LEN)
+					if (fwrite(ptr, 1, RecLen, fp) != (size_t)RecLen)
 					{
 						fclose(fp);
 						return false;
@@ -309,4 +456,118 @@ bool IsFileExist(char* fn)
 		return false;
 	fclose(fp);
 	return true;
-}
\ No newline at end of file
+}
+
+u64 GetFileSize64(char* fn)
+{
+	FILE* fp = fopen(fn, "rb");
+	if (!fp)
+		return 0;
+#ifdef _WIN32
+	_fseeki64(fp, 0, SEEK_END);
+	u64 size = _ftelli64(fp);
+#else
+	fseeko(fp, 0, SEEK_END);
+	u64 size = ftello(fp);
+#endif
+	fclose(fp);
+	return size;
+}
+
+//total physical RAM in bytes, 0 if unknown
+u64 GetPhysMemSize()
+{
+#ifdef _WIN32
+	MEMORYSTATUSEX ms;
+	ms.dwLength = sizeof(ms);
+	if (!GlobalMemoryStatusEx(&ms))
+		return 0;
+	return ms.ullTotalPhys;
+#else
+	long pages = sysconf(_SC_PHYS_PAGES);
+	long page_size = sysconf(_SC_PAGE_SIZE);
+	if ((pages <= 0) || (page_size <= 0))
+		return 0;
+	return (u64)pages * page_size;
+#endif
+}
+int GetCpuCnt()
+{
+#ifdef _WIN32
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	return (int)si.dwNumberOfProcessors;
+#else
+	long cnt = sysconf(_SC_NPROCESSORS_ONLN);
+	return (cnt > 0) ? (int)cnt : 1;
+#endif
+}
+
+//microseconds, for short intervals
+u64 GetTimeUs()
+{
+#ifdef _WIN32
+	LARGE_INTEGER cnt, freq;
+	QueryPerformanceCounter(&cnt);
+	QueryPerformanceFrequency(&freq);
+	return (u64)(cnt.QuadPart / freq.QuadPart) * 1000000ull + (u64)(cnt.QuadPart % freq.QuadPart) * 1000000ull / freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return (u64)(ts.tv_nsec / 1000) + ((u64)ts.tv_sec * 1000000ull);
+#endif
+}
+
+//NUMA node of logical CPU, 0 if unknown
+int GetCpuNode(int cpu)
+{
+#ifdef _WIN32
+	UCHAR node;
+	if ((cpu < 64) && GetNumaProcessorNode((UCHAR)cpu, &node) && (node != 0xFF))
+		return node;
+	return 0;
+#else
+	char path[128];
+	for (int node = 0; node < 64; node++)
+	{
+		sprintf(path, "/sys/devices/system/cpu/cpu%d/node%d", cpu, node);
+		if (access(path, F_OK) == 0)
+			return node;
+	}
+	return 0;
+#endif
+}
+
+//pins calling thread to logical CPU
+bool SetThreadCpu(int cpu)
+{
+#ifdef _WIN32
+	if (cpu >= 64)
+		return false;
+	return SetThreadAffinityMask(GetCurrentThread(), 1ull << cpu) != 0;
+#else
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+}
+
+//CPU brand string from cpuid, used as part of hardware id
+void GetCpuName(char* name)
+{
+	u32 regs[12];
+	memset(regs, 0, sizeof(regs));
+	for (u32 i = 0; i < 3; i++)
+	{
+#ifdef _WIN32
+		__cpuid((int*)(regs + 4 * i), 0x80000002 + i);
+#else
+		__get_cpuid(0x80000002 + i, regs + 4 * i, regs + 4 * i + 1, regs + 4 * i + 2, regs + 4 * i + 3);
+#endif
+	}
+	memcpy(name, regs, 48);
+	name[48] = 0;
+	if (!name[0])
+		strcpy(name, "unknown");
+}
@@ -75,32 +75,72 @@ class MemPool
 private:
 	std::vector <void*> pages;
 	u32 pnt;
+	u32 rec_len;
+	u32 recs_in_page;
 public:
 	MemPool();
 	~MemPool();
+	void SetRecLen(u32 len);
 	void Clear();
+	void Swap(MemPool& mp);
 	inline void* AllocRec(u32* cmp_ptr);
 	inline void* GetRecPtr(u32 cmp_ptr);
 };
 
+//returns false if record must be removed from DB
+typedef bool (*TKeepRecFunc)(u8* rec, void* ctx);
+typedef void (*TEnumRecFunc)(u8* rec, void* ctx);
+
+//offset of record length in header, 0 - default DB_REC_LEN (old files)
+#define DB_HDR_REC_LEN		8
+
 class TFastBase
 {
 private:
 	MemPool mps[256];
 	TListRec lists[256][256][256];
-	int lower_bound(TListRec* list, int mps_ind, u8* data);
+	int RecLen; //stored length of records, first 3 bytes of data are not stored
+	u64 RecCnt;
+	//incremental pruning: lists [PruneI][0..PruneJ) are already moved to PrunePool, others are in mps
+	bool Pruning;
+	TKeepRecFunc PruneFunc;
+	void* PruneCtx;
+	int PruneLen;
+	std::vector <u8>* PruneRemovedRecs;
+	int PruneI, PruneJ;
+	u64 PruneRemoved;
+	MemPool PrunePool;
+	MemPool* GetPool(u8* data) { return (Pruning && (data[0] == PruneI) && (data[1] < PruneJ)) ? &PrunePool : &mps[data[0]]; };
+	int lower_bound(TListRec* list, MemPool* mp, u8* data);
+	void BeginPrune(TKeepRecFunc keep_func, void* ctx, int new_rec_len, std::vector <u8>* removed_recs);
 public:
 	u8 Header[256];
 
 	TFastBase();
 	~TFastBase();
 	void Clear();
+	void SetRecLen(int len);
+	int GetRecLen() { return RecLen; };
 	u8* AddDataBlock(u8* data, int pos = -1);
 	u8* FindDataBlock(u8* data);
 	u8* FindOrAddDataBlock(u8* data);
-	u64 GetBlockCnt();
+	u64 GetBlockCnt() { return RecCnt; };
+	u64 Prune(TKeepRecFunc keep_func, void* ctx, int new_rec_len = 0, std::vector <u8>* removed_recs = NULL);
+	void StartPrune(TKeepRecFunc keep_func, void* ctx);
+	bool PruneStep(u64 max_us);
+	bool IsPruning() { return Pruning; };
+	double GetPruneProgress() { return Pruning ? (PruneI * 256 + PruneJ) / 65536.0 : 1.0; };
+	u64 GetPrunedCnt() { return PruneRemoved; };
+	void EnumRecs(TEnumRecFunc enum_func, void* ctx);
 	bool LoadFromFile(char* fn);
 	bool SaveToFile(char* fn);
 };
 
-bool IsFileExist(char* fn);
\ No newline at end of file
+bool IsFileExist(char* fn);
+u64 GetFileSize64(char* fn);
+u64 GetPhysMemSize();
+int GetCpuCnt();
+u64 GetTimeUs();
+int GetCpuNode(int cpu);
+bool SetThreadCpu(int cpu);
+void GetCpuName(char* name); //name must have at least 49 chars
\ No newline at end of file